@@ -0,0 +1,39 @@
+// access_log.h
+// The access log: one record per answered request. A session fills an
+// AccessRecord in as the request moves through it and emits the record
+// once the response is ready, instead of logging a line at each step.
+#ifndef ACCESS_LOG_H
+#define ACCESS_LOG_H
+
+#include <chrono>
+#include <ostream>
+#include <string_view>
+
+struct AccessRecord {
+  using Clock = std::chrono::steady_clock;
+
+  // Views into the request and the session, which outlive the record
+  std::string_view method;
+  // The location the request was routed to, if any
+  std::string_view location;
+  std::string_view path;
+  std::string_view peer;
+  const char *handler = "";
+  int status_code = 0;
+  // Backend tier that answered, when the handler reports one
+  const char *cache_tier = nullptr;
+  // Parsed, handed to the handler (unset if it never was), answered
+  Clock::time_point received;
+  Clock::time_point dispatched;
+  Clock::time_point answered;
+
+  // Log the record at info, or append it to the binary access log if one
+  // is set, stamping answered if it is unset
+  void emit();
+};
+
+// [ResponseMetrics] status_code=... path="..." ip="..." handler="..."
+// followed by the method, location, cache tier and timings in microseconds
+std::ostream &operator<<(std::ostream &os, const AccessRecord &record);
+
+#endif  // ACCESS_LOG_H
@@ -0,0 +1,79 @@
+// admission_control.h
+// Limits on how much work the server accepts before answering 503.
+#ifndef ADMISSION_CONTROL_H
+#define ADMISSION_CONTROL_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+
+#define DEFAULT_SHED_INTERVAL_MS 100
+
+// Counts open connections across every Server sharing it. A connection
+// holds its slot until the slot is destroyed.
+class ConnectionLimiter {
+ public:
+  using Slot = std::shared_ptr<void>;
+
+  // max_connections of 0 never refuses a connection
+  explicit ConnectionLimiter(size_t max_connections);
+
+  // nullptr when max_connections slots are already held
+  Slot try_acquire();
+  size_t active() const;
+
+ private:
+  struct State {
+    std::atomic<size_t> active{0};
+  };
+
+  size_t max_connections_;
+  std::shared_ptr<State> state_;  // outlives the limiter while slots exist
+};
+
+// Admission for one location: a cap on requests being handled at once,
+// and optional CoDel-style shedding of requests that waited too long in
+// the location's handler pool queue.
+//
+// Shedding looks at the shortest queueing delay seen in each interval. A
+// burst drains within an interval and leaves a short one behind; a
+// standing queue does not. Once the shortest delay of an interval exceeds
+// target the location counts as overloaded, and queued requests that have
+// waited longer than target are answered with 503 instead of being run.
+// Otherwise only requests that waited longer than a whole interval are.
+class InflightLimiter {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  // max_inflight of 0 is unlimited; a target of 0 disables shedding
+  InflightLimiter(size_t max_inflight, std::chrono::milliseconds target,
+                  std::chrono::milliseconds interval =
+                      std::chrono::milliseconds(DEFAULT_SHED_INTERVAL_MS));
+
+  InflightLimiter(const InflightLimiter&) = delete;
+  InflightLimiter& operator=(const InflightLimiter&) = delete;
+
+  // Every successful try_acquire() must be paired with a release()
+  bool try_acquire();
+  void release();
+
+  // Called as a queued request is about to run after waiting queued
+  bool should_shed(Clock::duration queued);
+
+  size_t inflight() const;
+
+ private:
+  size_t max_inflight_;
+  std::atomic<size_t> inflight_{0};
+
+  Clock::duration target_;
+  Clock::duration interval_;
+  std::mutex mutex_;  // guards the shedding state below
+  Clock::time_point interval_end_;
+  Clock::duration min_delay_ = Clock::duration::zero();
+  bool overloaded_ = false;
+};
+
+#endif  // ADMISSION_CONTROL_H
@@ -0,0 +1,193 @@
+// binary_access_log.h
+// The access log as binary records, for traffic analysis that would
+// otherwise parse billions of text lines (see creeper_logstat).
+//
+// A file starts with ACCESS_LOG_MAGIC and holds records laid out as
+//     u32 size            whole record, this field included
+//     u64 unix_us         when the record was written
+//     u32 total_us        parsed to answered
+//     u32 handler_us      ACCESS_LOG_NO_HANDLER if no handler ran
+//     u16 status_code
+// followed by method, location, path, peer, handler and cache tier, each a
+// u16 length and that many bytes. Integers are little endian.
+#ifndef BINARY_ACCESS_LOG_H
+#define BINARY_ACCESS_LOG_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+
+#include "access_log.h"
+#include "mpsc_ring.h"
+
+#define ACCESS_LOG_MAGIC "CRPACC01"
+#define ACCESS_LOG_MAGIC_SIZE 8
+#define ACCESS_LOG_NO_HANDLER UINT32_MAX
+// A file is closed for the next once it would grow past this
+#define DEFAULT_ACCESS_LOG_ROTATION (64 * 1024 * 1024)
+// Records are buffered until this many bytes are pending
+#define DEFAULT_ACCESS_LOG_BATCH (64 * 1024)
+// Records waiting for the writer before further ones are dropped
+#define DEFAULT_ACCESS_LOG_QUEUE 65536
+
+// One record read back from a file; the strings view the file's contents
+struct BinaryAccessEntry {
+  uint64_t unix_us = 0;
+  uint32_t total_us = 0;
+  uint32_t handler_us = ACCESS_LOG_NO_HANDLER;
+  uint16_t status_code = 0;
+  std::string_view method;
+  std::string_view location;
+  std::string_view path;
+  std::string_view peer;
+  std::string_view handler;
+  std::string_view cache_tier;
+};
+
+// Appends records to prefix_<start time>_<n>.bin files, moving to the next
+// file once one reaches rotation_size bytes. Records are encoded by the
+// thread that appends them and queued without locking. A thread of the
+// log's own owns the file and writes them batch_size bytes at a time, or
+// within a second of the first of a batch being appended, whether or not
+// more records arrive.
+class BinaryAccessLog {
+ public:
+  explicit BinaryAccessLog(std::string prefix,
+                           size_t rotation_size = DEFAULT_ACCESS_LOG_ROTATION,
+                           size_t batch_size = DEFAULT_ACCESS_LOG_BATCH,
+                           size_t queue_size = DEFAULT_ACCESS_LOG_QUEUE);
+  // Writes what is still queued
+  ~BinaryAccessLog();
+  BinaryAccessLog(const BinaryAccessLog&) = delete;
+  BinaryAccessLog& operator=(const BinaryAccessLog&) = delete;
+
+  // Thread safe. Records are dropped while the queue is full or no file
+  // can be opened.
+  void append(const AccessRecord& record);
+  // Returns once every record appended before the call is written
+  void flush();
+  // The file being written, empty if none could be opened
+  std::string current_file();
+  // Records dropped because the queue was full
+  uint64_t dropped() const;
+
+  // Encodes record as written at unix_us onto the end of out
+  static void encode(const AccessRecord& record, uint64_t unix_us,
+                     std::string& out);
+
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  void run();
+  // The rest is only called on the writer thread
+  void take(std::string& record);
+  void write_pending();
+  bool open_next();
+
+  const std::string prefix_;
+  const size_t rotation_size_;
+  const size_t batch_size_;
+  MpscRing<std::string> ring_;
+  std::atomic<uint64_t> dropped_{0};
+
+  // Only touched by the writer thread, and by the constructor before it
+  // starts
+  std::string pending_;
+  Clock::time_point pending_deadline_;
+  int fd_ = -1;
+  size_t file_size_ = 0;
+  int file_index_ = 0;
+  std::string start_time_;
+  uint64_t reported_dropped_ = 0;
+
+  std::mutex file_mutex_;
+  std::string current_file_;  // Guarded by file_mutex_
+
+  // Guards the flush and stop requests below; appends never take it
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::condition_variable flushed_;
+  bool stopping_ = false;
+  uint64_t flush_requested_ = 0;
+  uint64_t flush_completed_ = 0;
+  std::thread writer_;
+};
+
+// Files from CREEPER_ACCESS_LOG=<prefix>, rotated at
+// CREEPER_ACCESS_LOG_ROTATION bytes; nullptr if it is unset
+std::shared_ptr<BinaryAccessLog> binary_access_log_from_env();
+
+// Send AccessRecord::emit() to log instead of the text log, or back to the
+// text log with nullptr. The previous log is flushed; only call this while
+// no requests are being answered.
+void set_binary_access_log(std::shared_ptr<BinaryAccessLog> log);
+// The log set by set_binary_access_log(), if any
+BinaryAccessLog* binary_access_log();
+
+namespace binary_access_log_detail {
+
+inline uint64_t get_le(const char* p, int bytes) {
+  uint64_t value = 0;
+  for (int i = bytes - 1; i >= 0; --i) {
+    value = (value << 8) | static_cast<unsigned char>(p[i]);
+  }
+  return value;
+}
+
+}  // namespace binary_access_log_detail
+
+// Calls visit(entry) for every record of a file's contents. Returns false
+// if data is not an access log or ends in a partial record, which is
+// skipped along with anything after it.
+template <typename Visit>
+bool for_each_access_entry(std::string_view data, Visit&& visit) {
+  using binary_access_log_detail::get_le;
+  if (data.substr(0, ACCESS_LOG_MAGIC_SIZE) != ACCESS_LOG_MAGIC) {
+    return false;
+  }
+  const size_t fixed = 4 + 8 + 4 + 4 + 2;
+  size_t pos = ACCESS_LOG_MAGIC_SIZE;
+  while (pos < data.size()) {
+    if (data.size() - pos < fixed) {
+      return false;
+    }
+    const char* record = data.data() + pos;
+    size_t size = get_le(record, 4);
+    if (size < fixed || size > data.size() - pos) {
+      return false;
+    }
+    BinaryAccessEntry entry;
+    entry.unix_us = get_le(record + 4, 8);
+    entry.total_us = static_cast<uint32_t>(get_le(record + 12, 4));
+    entry.handler_us = static_cast<uint32_t>(get_le(record + 16, 4));
+    entry.status_code = static_cast<uint16_t>(get_le(record + 20, 2));
+    std::string_view* fields[] = {&entry.method,  &entry.location,
+                                  &entry.path,    &entry.peer,
+                                  &entry.handler, &entry.cache_tier};
+    size_t offset = fixed;
+    for (std::string_view* field : fields) {
+      if (size - offset < 2) {
+        return false;
+      }
+      size_t length = get_le(record + offset, 2);
+      offset += 2;
+      if (size - offset < length) {
+        return false;
+      }
+      *field = std::string_view(record + offset, length);
+      offset += length;
+    }
+    visit(static_cast<const BinaryAccessEntry&>(entry));
+    pos += size;
+  }
+  return true;
+}
+
+#endif  // BINARY_ACCESS_LOG_H
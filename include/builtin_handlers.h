@@ -0,0 +1,75 @@
+// builtin_handlers.h
+// The handlers compiled into the server, listed as types so a request for
+// one of them is dispatched with a switch over a std::variant instead of a
+// virtual call. Handlers registered only through REGISTER_HANDLER (plugins)
+// keep going through RequestHandler's virtual interface.
+#ifndef BUILTIN_HANDLERS_H
+#define BUILTIN_HANDLERS_H
+
+#include <type_traits>
+#include <typeinfo>
+#include <utility>
+#include <variant>
+
+#include "blocking_request_handler.h"
+#include "echo_request_handler.h"
+#include "health_request_handler.h"
+#include "http_header.h"
+#include "not_found_request_handler.h"
+#include "request_handler.h"
+#include "static_request_handler.h"
+
+template <typename... Handlers>
+struct HandlerTypeList {
+  // A handler of exactly one of the listed types, or monostate for any
+  // other handler
+  using Variant = std::variant<std::monostate, Handlers *...>;
+
+  static Variant resolve(RequestHandler *handler) {
+    Variant resolved;
+    // Exact type only: a subclass may override what the listed class does
+    if (handler != nullptr) {
+      ((typeid(*handler) == typeid(Handlers)
+            ? void(resolved = static_cast<Handlers *>(handler))
+            : void()),
+       ...);
+    }
+    return resolved;
+  }
+};
+
+using BuiltinHandlers =
+    HandlerTypeList<HealthRequestHandler, EchoRequestHandler,
+                    StaticRequestHandler, NotFoundRequestHandler,
+                    BlockingRequestHandler>;
+using BuiltinHandler = BuiltinHandlers::Variant;
+
+// Whether H answers from handle_request() on the calling thread, i.e. uses
+// RequestHandler's handle_request_view() and handle_request_async()
+template <typename H>
+constexpr bool answers_inline =
+    std::is_same_v<decltype(&H::handle_request_view),
+                   decltype(&RequestHandler::handle_request_view)> &&
+    std::is_same_v<decltype(&H::handle_request_async),
+                   decltype(&RequestHandler::handle_request_async)>;
+
+// handler->handle_request_view(req, callback) with every call resolved at
+// compile time. An inline handler is handed a copy of req directly instead
+// of through the shared copy and wrapped callback the default
+// handle_request_view() allocates.
+template <typename H>
+void handle_builtin(H *handler, const RequestView &req,
+                    RequestHandler::ResponseCallback callback) {
+  if constexpr (answers_inline<H>) {
+    callback(handler->H::handle_request(req.to_request()));
+  } else {
+    handler->H::handle_request_view(req, std::move(callback));
+  }
+}
+
+template <typename H>
+RequestHandler::HandlerType builtin_type(H *handler) {
+  return handler->H::get_type();
+}
+
+#endif  // BUILTIN_HANDLERS_H
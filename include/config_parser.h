@@ -8,8 +8,18 @@
 #include <string>
 #include <vector>
 
+#include "parser_backend.h"
 #include "request_handler.h"
 
+// Number of io worker threads used when the config has no threads directive
+#define DEFAULT_NUM_THREADS 2
+
+// Connection defaults, in seconds; 0 disables a timeout or the request limit
+#define DEFAULT_KEEPALIVE_TIMEOUT 60
+#define DEFAULT_HEADER_TIMEOUT 10
+#define DEFAULT_BODY_TIMEOUT 30
+#define DEFAULT_KEEPALIVE_REQUESTS 1000
+
 class NginxConfig;
 
 // The parsed representation of a single config statement.
@@ -20,10 +30,47 @@ class NginxConfigStatement {
   std::unique_ptr<NginxConfig> child_block_;
 };
 
+// How io worker threads share the network reactor.
+//   SHARED:  all threads run one io_service and one acceptor.
+//   SHARDED: each thread owns an io_service and a SO_REUSEPORT acceptor.
+enum class IoMode { SHARED, SHARDED, INVALID };
+
+// Whether each io worker thread is pinned to its own core
+enum class CpuAffinity { OFF, ON, INVALID };
+
 struct NginxLocation {
   std::string path;
   std::string handler;
   std::shared_ptr<RequestHandlerArgs> args;
+  // "handler_threads <n>;" inside the location block. 0 runs the handler
+  // inline on the io thread, otherwise on a dedicated pool of n threads.
+  int handler_threads = 0;
+  // "handler_queue <n>;" bounds the pool's backlog; 0 keeps the default.
+  int handler_queue = 0;
+  // "max_inflight <n>;" answers 503 while n requests are being handled;
+  // 0 is unlimited.
+  int max_inflight = 0;
+  // "shed_target_ms <ms>;" turns on adaptive shedding of requests queued on
+  // the handler pool, "shed_interval_ms <ms>;" sets its window.
+  int shed_target_ms = 0;
+  int shed_interval_ms = 0;
+};
+
+// Top-level per-connection directives:
+//   keepalive_timeout <s>;   idle time allowed between requests
+//   header_timeout <s>;      time allowed to receive a request's headers
+//   body_timeout <s>;        time allowed between reads of a request body
+//   keepalive_requests <n>;  requests served before the connection closes
+//   max_connections <n>;     open connections before new ones get a 503
+//   parser beast|simd;       RequestParser backend, beast by default
+struct ConnectionSettings {
+  bool valid = true;
+  int keepalive_timeout = DEFAULT_KEEPALIVE_TIMEOUT;
+  int header_timeout = DEFAULT_HEADER_TIMEOUT;
+  int body_timeout = DEFAULT_BODY_TIMEOUT;
+  int keepalive_requests = DEFAULT_KEEPALIVE_REQUESTS;
+  int max_connections = 0;  // unlimited
+  ParserBackend parser = ParserBackend::BEAST;
 };
 
 struct NginxLocationResult {
@@ -37,7 +84,26 @@ class NginxConfig {
   std::string to_string(int depth = 0);
   std::vector<std::shared_ptr<NginxConfigStatement>> statements_;
   int get_port() const;
+  // Top-level "threads <n>|auto;" directive. Returns DEFAULT_NUM_THREADS if
+  // absent, the hardware concurrency for "auto", and -1 if invalid.
+  int get_threads() const;
+  // Top-level "cpu_affinity on|off;" directive. Defaults to OFF.
+  CpuAffinity get_cpu_affinity() const;
+  // Top-level "io_mode shared|sharded;" directive. Defaults to SHARED.
+  IoMode get_io_mode() const;
+  // Per-connection directives; valid is false if a numeric one is not a
+  // non-negative integer or the parser is unknown
+  ConnectionSettings get_connection_settings() const;
   NginxLocationResult get_locations() const;
+
+ private:
+  // Strip location-level directives (handler_threads, max_inflight, ...)
+  // into location and return the remaining statement for the handler's
+  // create_from_config. Returns false if a directive is invalid.
+  static bool extract_location_options(
+      const std::shared_ptr<NginxConfigStatement>& statement,
+      NginxLocation* location,
+      std::shared_ptr<NginxConfigStatement>* handler_statement);
 };
 
 // The driver that parses a config file and generates an NginxConfig.
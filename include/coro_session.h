@@ -0,0 +1,40 @@
+// coro_session.h
+// A Session whose read / handle / write loop is a single C++20 coroutine
+// instead of a chain of bound completion handlers. Only built with the
+// CREEPER_COROUTINE_SESSION cmake option.
+#ifndef CORO_SESSION_H
+#define CORO_SESSION_H
+
+// Boost 1.74's awaitable.hpp, which boost/asio.hpp pulls in under C++20,
+// uses std::exchange without including <utility>, so every header that
+// includes asio includes <utility> first
+#include <utility>
+#include <boost/asio.hpp>
+#include <boost/asio/awaitable.hpp>
+#include <memory>
+#include <string>
+
+#include "session.h"
+
+class CoroSession : public Session {
+ public:
+  explicit CoroSession(boost::asio::io_service &io_service,
+                       std::shared_ptr<RequestHandlerDispatcher> dispatcher,
+                       std::shared_ptr<TimerWheel> wheel = nullptr,
+                       ConnectionSettings settings = ConnectionSettings());
+
+  // ISession interface -----------------------------------------------
+  // Spawns run() on strand_, where timeouts are delivered too; the
+  // coroutine frame keeps the session alive until the connection closes
+  void start() override;
+  // -------------------------------------------------------------------
+
+ private:
+  boost::asio::awaitable<void> run(std::shared_ptr<CoroSession> self);
+  // Suspend until the request's handler (inline, on a handler pool, or via
+  // an async backend) produces its response
+  boost::asio::awaitable<Outgoing> async_handle(RequestView req,
+                                                bool keep_alive);
+};
+
+#endif  // CORO_SESSION_H
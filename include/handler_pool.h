@@ -0,0 +1,54 @@
+// handler_pool.h
+// A bounded thread pool that runs request handlers off the io threads.
+#ifndef HANDLER_POOL_H
+#define HANDLER_POOL_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#define DEFAULT_HANDLER_QUEUE_SIZE 1024
+
+// Fixed number of worker threads draining a bounded FIFO of tasks.
+// submit() never blocks the caller: when the queue is full it returns false
+// so the io thread can answer 503 instead of stalling.
+class HandlerPool {
+ public:
+  using Task = std::function<void()>;
+
+  HandlerPool(size_t num_threads,
+              size_t max_queue_size = DEFAULT_HANDLER_QUEUE_SIZE);
+  ~HandlerPool();
+
+  HandlerPool(const HandlerPool&) = delete;
+  HandlerPool& operator=(const HandlerPool&) = delete;
+
+  // Queue a task; returns false if the queue is full or the pool stopped
+  bool submit(Task task);
+
+  size_t num_threads() const;
+  size_t max_queue_size() const;
+
+ private:
+  // Queue state lives in its own shared block so a worker that outlives
+  // the pool (see ~HandlerPool) never touches freed memory
+  struct State {
+    std::deque<Task> tasks;
+    bool stopping = false;
+    std::mutex mutex;
+    std::condition_variable cv;
+  };
+
+  static void worker_loop(std::shared_ptr<State> state);
+
+  size_t max_queue_size_;
+  std::shared_ptr<State> state_;
+  std::vector<std::thread> workers_;
+};
+
+#endif  // HANDLER_POOL_H
@@ -0,0 +1,40 @@
+// header_scanner.h
+// Delimiter searches for the SIMD RequestParser backend. Each search has
+// an AVX2, an SSE4.2 and a plain C++ version; the widest one the CPU
+// supports is picked at runtime.
+#ifndef HEADER_SCANNER_H
+#define HEADER_SCANNER_H
+
+enum class ScannerIsa { SCALAR, SSE42, AVX2 };
+
+class HeaderScanner {
+ public:
+  // Uses best_isa()
+  HeaderScanner();
+  // Uses isa, or the widest narrower one if the CPU lacks it
+  explicit HeaderScanner(ScannerIsa isa);
+
+  // First CR, LF or other control character except tab in [begin, end),
+  // or end. Ends the request line and header lines.
+  const char *find_line_end(const char *begin, const char *end) const {
+    return find_line_end_(begin, end);
+  }
+  // First ':' or control character except tab in [begin, end), or end.
+  // Ends a header name.
+  const char *find_colon(const char *begin, const char *end) const {
+    return find_colon_(begin, end);
+  }
+
+  ScannerIsa isa() const { return isa_; }
+  static ScannerIsa best_isa();
+  static const char *isa_name(ScannerIsa isa);
+
+ private:
+  using FindFn = const char *(*)(const char *, const char *);
+
+  ScannerIsa isa_;
+  FindFn find_line_end_;
+  FindFn find_colon_;
+};
+
+#endif  // HEADER_SCANNER_H
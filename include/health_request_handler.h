@@ -20,7 +20,13 @@ class HealthRequestHandler : public RequestHandler {
   HealthRequestHandler(std::string base_uri,
                        std::shared_ptr<HealthRequestHandlerArgs> args);
   std::unique_ptr<Response> handle_request(const Request& req) override;
+  // Never looks at more than the version, so no copy of req is needed
+  void handle_request_view(const RequestView& req,
+                           ResponseCallback callback) override;
   RequestHandler::HandlerType get_type() const override;
+
+ private:
+  static std::unique_ptr<Response> make_response(std::string version);
 };
 
 #endif  // HEALTH_REQUEST_HANDLER_H
\ No newline at end of file
@@ -1,10 +1,17 @@
 #ifndef HTTP_HEADER_H
 #define HTTP_HEADER_H
 
+#include <array>
+#include <cstdint>
+#include <initializer_list>
+#include <memory>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <vector>
 
+#include "small_vector.h"
+
 const std::string CRLF = "\r\n";
 const std::string HTTP_VERSION = "HTTP/1.1";
 const std::string METHOD_GET = "GET";
@@ -20,18 +27,154 @@ struct Header {
   std::string value;
 };
 
+struct HeaderView {
+  std::string_view name;
+  std::string_view value;
+};
+
+// Case-insensitive comparison, as header names and most values need
+bool iequals(std::string_view a, std::string_view b);
+
+// Request header names the server looks up by name
+enum class KnownHeader {
+  HOST,
+  CONNECTION,
+  CONTENT_TYPE,
+  CONTENT_LENGTH,
+  TRANSFER_ENCODING,
+  ACCEPT,
+  ACCEPT_ENCODING,
+  USER_AGENT,
+  COOKIE,
+  OTHER,  // any other name; also the number of known names
+};
+
+// Which KnownHeader name is, ignoring case
+KnownHeader known_header(std::string_view name);
+
+// Requests rarely carry more headers than this, so up to this many are
+// stored without a heap allocation
+#define INLINE_HEADERS 16
+
+// The headers of a request, in order. The first header with each
+// KnownHeader name is indexed as headers are added, so finding one does
+// not scan the list.
+template <typename H>
+class HeaderList {
+ public:
+  HeaderList() = default;
+  HeaderList(std::initializer_list<H> init) { assign(init.begin(), init.end()); }
+  HeaderList &operator=(std::initializer_list<H> init) {
+    assign(init.begin(), init.end());
+    return *this;
+  }
+
+  template <typename It>
+  void assign(It first, It last) {
+    clear();
+    for (; first != last; ++first) {
+      push_back(*first);
+    }
+  }
+
+  void push_back(H header) {
+    size_t known = static_cast<size_t>(known_header(header.name));
+    if (known < first_.size() && first_[known] == 0) {
+      first_[known] = static_cast<uint16_t>(headers_.size() + 1);
+    }
+    headers_.push_back(std::move(header));
+  }
+
+  void reserve(size_t capacity) { headers_.reserve(capacity); }
+  void clear() {
+    headers_.clear();
+    first_.fill(0);
+  }
+
+  // First header called name, or nullptr
+  const H *find(KnownHeader name) const {
+    size_t known = static_cast<size_t>(name);
+    if (known >= first_.size() || first_[known] == 0) {
+      return nullptr;
+    }
+    return &headers_[first_[known] - 1];
+  }
+  const H *find(std::string_view name) const {
+    KnownHeader known = known_header(name);
+    if (known != KnownHeader::OTHER) {
+      return find(known);
+    }
+    for (const H &header : headers_) {
+      if (iequals(header.name, name)) {
+        return &header;
+      }
+    }
+    return nullptr;
+  }
+
+  size_t size() const { return headers_.size(); }
+  bool empty() const { return headers_.empty(); }
+  const H &operator[](size_t i) const { return headers_[i]; }
+  const H *begin() const { return headers_.begin(); }
+  const H *end() const { return headers_.end(); }
+
+ private:
+  SmallVector<H, INLINE_HEADERS> headers_;
+  // Index + 1 of the first header with each known name, 0 if none
+  std::array<uint16_t, static_cast<size_t>(KnownHeader::OTHER)> first_{};
+};
+
 struct Request {
   // HTTP Request line
   std::string method;
   std::string uri;
   std::string version;
-  std::vector<Header> headers;
+  HeaderList<Header> headers;
   std::string body;
   bool valid = false;  // default valid to false
 
+  // Case-insensitive; nullptr if the request has no such header
+  const Header *find_header(KnownHeader name) const {
+    return headers.find(name);
+  }
+  const Header *find_header(std::string_view name) const {
+    return headers.find(name);
+  }
+
   std::string to_string() const;
+  // Whether the client expects the connection to stay open afterwards:
+  // HTTP/1.1 unless "Connection: close", HTTP/1.0 only with
+  // "Connection: keep-alive"
+  bool keep_alive() const;
+};
+
+// A parsed request whose fields point into the buffer it was parsed from
+// instead of owning copies. Only valid while that buffer is, which for a
+// Session is until the request has been answered.
+struct RequestView {
+  std::string_view method;
+  std::string_view uri;
+  std::string_view version;
+  HeaderList<HeaderView> headers;
+  std::string_view body;
+  bool valid = false;
+  // A chunked body has to be decoded, so body views this instead
+  std::shared_ptr<const std::string> decoded_body;
+
+  const HeaderView *find_header(KnownHeader name) const {
+    return headers.find(name);
+  }
+  const HeaderView *find_header(std::string_view name) const {
+    return headers.find(name);
+  }
+
+  bool keep_alive() const;
+  // Owning copy for handlers that work on a Request
+  Request to_request() const;
 };
 
+class EncodedResponse;
+
 struct Response {
   // HTTP Response line
   std::string version;
@@ -39,11 +182,30 @@ struct Response {
   std::string status_message;
   std::vector<Header> headers;
   std::string body;
+  // Backend tier that produced the answer ("redis", "db"), for the access
+  // log; never sent
+  const char* cache_tier = nullptr;
+
+  // STOCK_RESPONSE.at(status_code), already serialized
+  static Response stock(int status_code);
 
   Response();
   Response(std::string version, int status_code, std::string status_message,
            std::vector<Header> headers, std::string body);
   std::string to_string() const;
+  // Everything to_string() puts before the body, written into head. head
+  // is cleared first but keeps its capacity, so a reused buffer stops
+  // allocating once it has grown to fit.
+  void serialize_head(std::string& head) const;
+  // The EncodedResponse this is a copy of, such as for stock(), so a
+  // session can write its shared bytes instead of serializing the fields.
+  // nullptr if there is none or the status, headers or body have been
+  // changed since; the version may differ.
+  const EncodedResponse* encoded() const;
+
+ private:
+  friend class EncodedResponse;
+  const EncodedResponse* encoded_ = nullptr;
 };
 
 const std::unordered_map<unsigned int, Response> STOCK_RESPONSE = {
@@ -53,12 +215,59 @@ const std::unordered_map<unsigned int, Response> STOCK_RESPONSE = {
                    {{"Content-Type", "text/plain"}}, "404 Not Found")},
     {405, Response(HTTP_VERSION, 405, "Method Not Allowed",
                    {{"Content-Type", "text/plain"}}, "405 Method Not Allowed")},
+    {413, Response(HTTP_VERSION, 413, "Payload Too Large",
+                   {{"Content-Type", "text/plain"}}, "413 Payload Too Large")},
     {415,
      Response(HTTP_VERSION, 415, "Unsupported Media Type",
               {{"Content-Type", "text/plain"}}, "415 Unsupported Media Type")},
+    {431, Response(HTTP_VERSION, 431, "Request Header Fields Too Large",
+                   {{"Content-Type", "text/plain"}},
+                   "431 Request Header Fields Too Large")},
     {500,
      Response(HTTP_VERSION, 500, "Internal Server Error",
               {{"Content-Type", "text/plain"}}, "500 Internal Server Error")},
+    {503, Response(HTTP_VERSION, 503, "Service Unavailable",
+                   {{"Content-Type", "text/plain"}}, "503 Service Unavailable")},
 };
 
+// Tell the client whether the connection survives res. HTTP/1.1 clients
+// assume it does, HTTP/1.0 ones need to be told.
+void set_connection_header(Response& res, std::string_view version,
+                           bool keep_alive);
+
+// A Response serialized once per Connection header variant and shared
+// read-only by every session and thread, so sending it neither copies
+// nor serializes anything. Copies of response() point back here, so an
+// EncodedResponse has to outlive them; keep it in static storage.
+class EncodedResponse {
+ public:
+  explicit EncodedResponse(Response res);
+  EncodedResponse(const EncodedResponse&) = delete;
+  EncodedResponse& operator=(const EncodedResponse&) = delete;
+
+  // The fields, for handlers and logging. The version is not part of the
+  // bytes, which always start with HTTP/1.1, so it may be changed freely.
+  const Response& response() const { return res_; }
+  // res with set_connection_header(version, keep_alive) applied
+  const std::string& bytes(std::string_view version, bool keep_alive) const;
+
+ private:
+  Response res_;
+  std::string keep_alive_11_;
+  std::string keep_alive_10_;
+  std::string close_;
+};
+
+// STOCK_RESPONSE.at(status_code), encoded once
+const EncodedResponse& encoded_stock_response(int status_code);
+
+// Seconds a shed client is asked to wait before retrying
+#define RETRY_AFTER_SECONDS 1
+
+// STOCK_RESPONSE 503 plus Retry-After, so load can be shed without
+// building a Response. The Connection header matches keep_alive for a
+// request of the given HTTP version.
+const std::string& overloaded_response(std::string_view version,
+                                       bool keep_alive);
+
 #endif  // HTTP_HEADER_H
\ No newline at end of file
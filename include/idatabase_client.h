@@ -1,6 +1,7 @@
 #ifndef IDATABASE_CLIENT_H
 #define IDATABASE_CLIENT_H
 
+#include <functional>
 #include <optional>
 #include <string>
 
@@ -9,6 +10,8 @@
 ///
 class IDatabaseClient {
  public:
+  using LookupCallback = std::function<void(std::optional<std::string>)>;
+
   virtual ~IDatabaseClient() = default;
 
   /// Upsert (short_code -> long_url). Return true on success, false on error.
@@ -17,6 +20,13 @@ class IDatabaseClient {
 
   /// Return std::nullopt if not found; otherwise the stored long URL.
   virtual std::optional<std::string> lookup(const std::string& short_code) = 0;
+
+  /// Non-blocking variant of lookup(); callback may run on another thread.
+  /// Defaults to calling lookup() inline.
+  virtual void lookup_async(const std::string& short_code,
+                            LookupCallback callback) {
+    callback(lookup(short_code));
+  }
 };
 
 #endif  // IDATABASE_CLIENT_H
@@ -1,6 +1,7 @@
 #ifndef IREDIS_CLIENT_H
 #define IREDIS_CLIENT_H
 
+#include <functional>
 #include <optional>
 #include <string>
 
@@ -9,6 +10,8 @@
 ///
 class IRedisClient {
  public:
+  using GetCallback = std::function<void(std::optional<std::string>)>;
+
   virtual ~IRedisClient() = default;
 
   /// Return std::nullopt if not found; otherwise the stored long URL.
@@ -17,6 +20,12 @@ class IRedisClient {
   /// Store (short_code -> long_url); no return value.
   virtual void set(const std::string& short_code,
                    const std::string& long_url) = 0;
+
+  /// Non-blocking variant of get(); callback may run on another thread.
+  /// Defaults to calling get() inline.
+  virtual void get_async(const std::string& short_code, GetCallback callback) {
+    callback(get(short_code));
+  }
 };
 
 #endif  // IREDIS_CLIENT_H
@@ -4,7 +4,9 @@
 #ifndef ISESSION_H
 #define ISESSION_H
 
+#include <utility>  // before asio; see coro_session.h
 #include <boost/asio.hpp>
+#include <memory>
 using boost::asio::ip::tcp;
 
 class ISession {
@@ -16,6 +18,10 @@ class ISession {
     // by default just forward to the real socket
     return socket().remote_endpoint();
   }
+  // Keep slot alive as long as the session is; Server counts connections
+  // against max_connections by the slots still held. Sessions that drop
+  // it are not counted.
+  virtual void hold_connection_slot(std::shared_ptr<void>) {}
 };
 
 #endif  // ISESSION_H
@@ -0,0 +1,73 @@
+// latency_histogram.h
+// Latencies in microseconds in log-linear buckets, HDR histogram style:
+// values below 16 get a bucket each, and every power of two above is split
+// into 16 buckets, so a percentile is off by at most about 6% and the
+// buckets span the whole uint32_t range in 464 counts. Merging two
+// histograms is adding their buckets.
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+class LatencyHistogram {
+ public:
+  static constexpr int SUB_BUCKETS = 16;
+  static constexpr size_t BUCKETS = (32 - 3) * SUB_BUCKETS;
+
+  void record(uint32_t micros) { add(bucket_of(micros), 1, micros); }
+  // Adds count values, summing to sum, to bucket
+  void add(size_t bucket, uint64_t count, uint64_t sum) {
+    buckets_[bucket] += count;
+    count_ += count;
+    sum_ += sum;
+  }
+  void merge(const LatencyHistogram& other) {
+    for (size_t i = 0; i < BUCKETS; ++i) {
+      buckets_[i] += other.buckets_[i];
+    }
+    count_ += other.count_;
+    sum_ += other.sum_;
+  }
+
+  uint64_t count() const { return count_; }
+  uint64_t sum() const { return sum_; }
+  // Upper end of the bucket holding the q quantile, 0 if empty
+  uint64_t percentile(double q) const {
+    uint64_t rank = static_cast<uint64_t>(q * count_);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKETS; ++i) {
+      seen += buckets_[i];
+      if (seen > rank) {
+        return upper_bound(i);
+      }
+    }
+    return 0;
+  }
+
+  static size_t bucket_of(uint32_t value) {
+    if (value < SUB_BUCKETS) {
+      return value;
+    }
+    int magnitude = 31 - __builtin_clz(value);  // >= 4
+    int shift = magnitude - 4;
+    return (magnitude - 3) * SUB_BUCKETS + ((value >> shift) - SUB_BUCKETS);
+  }
+  static uint64_t upper_bound(size_t bucket) {
+    if (bucket < SUB_BUCKETS) {
+      return bucket;
+    }
+    int magnitude = static_cast<int>(bucket / SUB_BUCKETS) + 3;
+    uint64_t sub = bucket % SUB_BUCKETS + SUB_BUCKETS;
+    int shift = magnitude - 4;
+    return ((sub + 1) << shift) - 1;
+  }
+
+ private:
+  std::array<uint64_t, BUCKETS> buckets_{};
+  uint64_t count_ = 0;
+  uint64_t sum_ = 0;
+};
+
+#endif  // LATENCY_HISTOGRAM_H
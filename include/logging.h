@@ -3,12 +3,35 @@
 
 #include <boost/log/core.hpp>
 #include <boost/log/trivial.hpp>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
 #include <iostream>
 #include <ostream>
 #include <string>
 
 namespace logging {
 
+#define DEFAULT_LOG_QUEUE_SIZE 8192
+
+// What a thread logging into a full queue does
+enum class LogOverflow { DROP, BLOCK };
+
+// With enabled set, LOG hands records to a bounded lock-free queue and
+// one writer thread formats and writes them in batches, flushing the
+// files once per batch rather than once per record.
+struct AsyncLogOptions {
+  bool enabled = false;
+  size_t queue_size = DEFAULT_LOG_QUEUE_SIZE;
+  LogOverflow overflow = LogOverflow::DROP;
+};
+
+// From the environment:
+//   CREEPER_LOG_ASYNC=drop   → asynchronous, drop records when full
+//   CREEPER_LOG_ASYNC=block  → asynchronous, wait for room when full
+//   CREEPER_LOG_QUEUE=<n>    → queue size (default DEFAULT_LOG_QUEUE_SIZE)
+AsyncLogOptions async_options_from_env();
+
 // Call this once at program startup.
 // By default it installs a console sink to `std::clog`
 // and a file sink to `logs/server_…`.
@@ -17,12 +40,34 @@ namespace logging {
 // or pass your own `std::ostream*` to capture logs.
 void init_logging(
     std::ostream* console_stream = &std::clog,
-    const std::string& file_pattern = "logs/server_%Y%m%d_%H%M%S_%N.log");
+    const std::string& file_pattern = "logs/server_%Y%m%d_%H%M%S_%N.log",
+    const AsyncLogOptions& async = async_options_from_env());
+
+// Records dropped by asynchronous logging since the process started
+uint64_t dropped_records();
+
+// LOG call sites below this severity are compiled out, stream arguments
+// included: 0 trace, 1 debug, 2 info, 3 warning, 4 error, 5 fatal.
+// Configure with cmake -DCREEPER_MIN_LOG_LEVEL=<n>.
+#ifndef CREEPER_MIN_LOG_LEVEL
+#define CREEPER_MIN_LOG_LEVEL 0
+#endif
+
+// Lowest severity an installed sink accepts, kept by init_logging(). Below
+// it LOG skips the record before Boost.Log opens one.
+inline std::atomic<int> min_sink_severity{0};
+
+inline bool sink_accepts(boost::log::trivial::severity_level level) {
+  return level >= min_sink_severity.load(std::memory_order_relaxed);
+}
 
 // Convenience macro to include file/line automatically
-#define LOG(severity)         \
-  BOOST_LOG_TRIVIAL(severity) \
-      << "[" << __FILE__ << ":" << __LINE__ << "@" << __func__ << "] "
+#define LOG(severity)                                                    \
+  if constexpr (::boost::log::trivial::severity < CREEPER_MIN_LOG_LEVEL) { \
+  } else if (!::logging::sink_accepts(::boost::log::trivial::severity)) {  \
+  } else                                                                 \
+    BOOST_LOG_TRIVIAL(severity)                                          \
+        << "[" << __FILE__ << ":" << __LINE__ << "@" << __func__ << "] "
 
 }  // namespace logging
 
@@ -0,0 +1,125 @@
+// metrics.h
+// Process-wide counters for the /metrics endpoint. Every thread counts into
+// a block of its own, laid out so no two threads write the same cache line,
+// with plain loads and stores instead of read-modify-write atomics; a
+// scrape adds up every thread's block. Counting is never contended, and a
+// scrape may see a count a few increments behind.
+//
+// Request latencies are kept the same way, in a LatencyHistogram per stage
+// for each location and each handler type.
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "latency_histogram.h"
+#include "request_handler.h"
+
+namespace metrics {
+
+enum class Counter {
+  BYTES_RECEIVED,
+  BYTES_SENT,
+  SESSIONS_OPENED,
+  SESSIONS_CLOSED,
+  // Requests that could not be framed or parsed
+  PARSE_FAILURES,
+  REDIS_CALLS,
+  DATABASE_CALLS,
+  COUNT
+};
+
+// Requests are counted per handler type plus one slot for requests no
+// handler answered (no location, overload, bad request), and per status
+// code from MIN_STATUS_CODE to MAX_STATUS_CODE
+#define METRICS_HANDLER_SLOTS \
+  (static_cast<int>(RequestHandler::HandlerType::METRICS_REQUEST_HANDLER) + 2)
+#define MIN_STATUS_CODE 100
+#define MAX_STATUS_CODE 599
+// Distinct location names timed over the process' life, reloads included;
+// requests to locations past the limit are not timed
+#define MAX_TIMED_LOCATIONS 256
+
+// The stages a request's latency is split into
+enum class Stage {
+  PARSE,     // parsing the framed request
+  DISPATCH,  // routing and waiting for a handler pool, until the handler runs
+  HANDLER,   // the handler, until it answers
+  WRITE,     // until the batch holding the response has been written
+  TOTAL,     // from parsing until written
+  COUNT
+};
+const char* stage_to_string(Stage stage);
+
+using StageLatencies =
+    std::array<LatencyHistogram, static_cast<size_t>(Stage::COUNT)>;
+
+struct LocationLatencies {
+  std::string location;
+  StageLatencies stages;
+};
+
+// Sums over every thread, past and present
+struct Snapshot {
+  std::array<uint64_t, static_cast<size_t>(Counter::COUNT)> counters{};
+  // requests[handler slot][status code - MIN_STATUS_CODE]
+  std::array<std::array<uint64_t, MAX_STATUS_CODE - MIN_STATUS_CODE + 1>,
+             METRICS_HANDLER_SLOTS>
+      requests{};
+
+  // One per location timed so far, in the order they were first seen
+  std::vector<LocationLatencies> locations;
+  // handlers[HandlerType]
+  std::vector<StageLatencies> handlers;
+
+  uint64_t operator[](Counter counter) const {
+    return counters[static_cast<size_t>(counter)];
+  }
+};
+
+void add(Counter counter, uint64_t amount = 1);
+// handler is nullopt for a request no handler answered. Status codes out
+// of range are not counted.
+void count_request(std::optional<RequestHandler::HandlerType> handler,
+                   int status_code);
+Snapshot collect();
+
+// Where one request was in time at the end of each stage, handed along
+// with its response and recorded once that has been written
+struct RequestTimer {
+  using Clock = std::chrono::steady_clock;
+
+  // location_index() of its location, or -1 if it was not timed
+  int location = -1;
+  // Its HandlerType, or -1 if no handler answered
+  int handler = -1;
+  Clock::time_point parse_started;
+  Clock::time_point parsed;
+  // Unset if the request never reached its handler
+  Clock::time_point dispatched;
+  Clock::time_point answered;
+
+  // Record every stage the request went through, the last ending at
+  // written; does nothing if neither location nor handler is set
+  void record(Clock::time_point written) const;
+};
+
+// The index location's latencies are kept under, or -1 once
+// MAX_TIMED_LOCATIONS names have been seen
+int location_index(std::string_view location);
+
+// Count, sum and p50 / p90 / p99 / p999 of every stage of every location
+// and handler type with any requests, one line each
+void write_latency_report(std::ostream& out, const Snapshot& snapshot);
+
+}  // namespace metrics
+
+#endif  // METRICS_H
@@ -0,0 +1,31 @@
+#ifndef METRICS_REQUEST_HANDLER_H
+#define METRICS_REQUEST_HANDLER_H
+
+#include <memory>
+#include <string>
+
+#include "config_parser.h"
+#include "http_header.h"
+#include "metrics.h"
+#include "request_handler.h"
+
+class MetricsRequestHandlerArgs : public RequestHandlerArgs {
+ public:
+  MetricsRequestHandlerArgs();
+  static std::shared_ptr<MetricsRequestHandlerArgs> create_from_config(
+      std::shared_ptr<NginxConfigStatement> statement);
+};
+
+// Answers with every counter in metrics.h in Prometheus' text format
+class MetricsRequestHandler : public RequestHandler {
+ public:
+  MetricsRequestHandler(std::string base_uri,
+                        std::shared_ptr<MetricsRequestHandlerArgs> args);
+  std::unique_ptr<Response> handle_request(const Request& req) override;
+  RequestHandler::HandlerType get_type() const override;
+
+  // The exposition of snapshot, one sample per line
+  static std::string format(const metrics::Snapshot& snapshot);
+};
+
+#endif  // METRICS_REQUEST_HANDLER_H
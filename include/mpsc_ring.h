@@ -0,0 +1,92 @@
+// mpsc_ring.h
+// A bounded queue any number of threads can push to without locking and a
+// single thread pops from. Each slot carries a sequence number telling
+// producers and the consumer whose turn it is (Vyukov's bounded queue).
+#ifndef MPSC_RING_H
+#define MPSC_RING_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+template <typename T>
+class MpscRing {
+ public:
+  // capacity is rounded up to a power of two
+  explicit MpscRing(size_t capacity) {
+    size_t size = 2;
+    while (size < capacity) {
+      size *= 2;
+    }
+    cells_.reset(new Cell[size]);
+    for (size_t i = 0; i < size; ++i) {
+      cells_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    mask_ = size - 1;
+  }
+  MpscRing(const MpscRing &) = delete;
+  MpscRing &operator=(const MpscRing &) = delete;
+
+  // Thread safe. Leaves value alone and returns false when full.
+  bool try_push(T &&value) {
+    size_t pos = tail_.load(std::memory_order_relaxed);
+    Cell *cell;
+    while (true) {
+      cell = &cells_[pos & mask_];
+      size_t sequence = cell->sequence.load(std::memory_order_acquire);
+      intptr_t diff =
+          static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+      if (diff == 0) {
+        if (tail_.compare_exchange_weak(pos, pos + 1,
+                                        std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = tail_.load(std::memory_order_relaxed);
+      }
+    }
+    cell->value = std::move(value);
+    cell->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer thread only. Returns false when empty.
+  bool try_pop(T &value) {
+    Cell &cell = cells_[head_ & mask_];
+    size_t sequence = cell.sequence.load(std::memory_order_acquire);
+    if (sequence != head_ + 1) {
+      return false;
+    }
+    value = std::move(cell.value);
+    // Whatever the slot still holds is released now, not when it is reused
+    cell.value = T();
+    cell.sequence.store(head_ + mask_ + 1, std::memory_order_release);
+    ++head_;
+    return true;
+  }
+
+  // Consumer thread only
+  bool empty() const {
+    return cells_[head_ & mask_].sequence.load(std::memory_order_acquire) !=
+           head_ + 1;
+  }
+  size_t capacity() const { return mask_ + 1; }
+
+ private:
+  struct Cell {
+    std::atomic<size_t> sequence;
+    T value;
+  };
+
+  std::unique_ptr<Cell[]> cells_;
+  size_t mask_ = 0;
+  // Producers and the consumer write different cache lines
+  alignas(64) std::atomic<size_t> tail_{0};
+  alignas(64) size_t head_ = 0;
+};
+
+#endif  // MPSC_RING_H
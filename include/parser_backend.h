@@ -0,0 +1,13 @@
+// parser_backend.h
+// Which implementation RequestParser::parse uses. Kept apart from
+// request_parser.h so the config can name it without pulling in the parser.
+#ifndef PARSER_BACKEND_H
+#define PARSER_BACKEND_H
+
+// Chosen with the top-level "parser beast|simd;" directive.
+//   BEAST: boost::beast's generic HTTP parser.
+//   SIMD:  a strict HTTP/1.x parser that finds delimiters with
+//          HeaderScanner. Hands chunked requests to beast.
+enum class ParserBackend { BEAST, SIMD };
+
+#endif  // PARSER_BACKEND_H
@@ -20,11 +20,29 @@ using CreateFromConfigFactory =
     std::function<std::shared_ptr<RequestHandlerArgs>(
         std::shared_ptr<NginxConfigStatement>)>;
 
+// How long the dispatcher keeps a handler instance, declared by the handler
+// when it registers.
+//   PER_REQUEST: a fresh instance for every request (the default).
+//   PER_THREAD:  one instance per location on each thread that runs its
+//                requests, for handlers that are costly to build but must
+//                not be called from two threads at once.
+//   SHARED:      one instance per location, built with the dispatcher and
+//                called from every thread at once; the handler must be
+//                thread safe.
+enum class HandlerLifecycle { PER_REQUEST, PER_THREAD, SHARED };
+
 // Macro to simplify registration of handlers with two-string constructor
 // signature ex) Register the StaticRequestHandler under its config name
 // REGISTER_HANDLER(StaticRequestHandler::kName, StaticRequestHandler,
 // StaticRequestHandlerArgs)
-#define REGISTER_HANDLER(NAME, HANDLER_NAME, ARGS_NAME)                        \
+#define REGISTER_HANDLER(NAME, HANDLER_NAME, ARGS_NAME) \
+  REGISTER_HANDLER_WITH_LIFECYCLE(NAME, HANDLER_NAME, ARGS_NAME, PER_REQUEST)
+
+// Same, for a handler that supports being reused, ex)
+// REGISTER_HANDLER_WITH_LIFECYCLE("HealthHandler", HealthRequestHandler,
+// HealthRequestHandlerArgs, SHARED)
+#define REGISTER_HANDLER_WITH_LIFECYCLE(NAME, HANDLER_NAME, ARGS_NAME,         \
+                                        LIFECYCLE)                             \
   static const bool _##HANDLER_NAME##_registered = Registry::register_handler( \
       NAME,                                                                    \
       [](const std::string& base_uri,                                          \
@@ -36,15 +54,17 @@ using CreateFromConfigFactory =
       [](std::shared_ptr<NginxConfigStatement> s)                              \
           -> std::shared_ptr<RequestHandlerArgs> {                             \
         return ARGS_NAME::create_from_config(s);                               \
-      })
+      },                                                                       \
+      HandlerLifecycle::LIFECYCLE)
 
 // Registry for RequestHandler factories
 class Registry {
  public:
   // Register a handler factory under a given name
-  static bool register_handler(const std::string& name,
-                               RequestHandlerFactory factory,
-                               CreateFromConfigFactory create_from_config);
+  static bool register_handler(
+      const std::string& name, RequestHandlerFactory factory,
+      CreateFromConfigFactory create_from_config,
+      HandlerLifecycle lifecycle = HandlerLifecycle::PER_REQUEST);
 
   static std::shared_ptr<RequestHandlerFactory> get_handler_factory(
       const std::string& name);
@@ -52,6 +72,9 @@ class Registry {
   static std::shared_ptr<CreateFromConfigFactory> get_create_from_config(
       const std::string& name);
 
+  // PER_REQUEST for names that were never registered
+  static HandlerLifecycle get_lifecycle(const std::string& name);
+
   // Using Meyers' singleton pattern to ensure that the map is created only once
   // This prevents multiple instances of the map from being created in gtest
   static std::unordered_map<std::string, RequestHandlerFactory>&
@@ -59,6 +82,9 @@ class Registry {
 
   static std::unordered_map<std::string, CreateFromConfigFactory>&
   get_create_from_config_map();
+
+  static std::unordered_map<std::string, HandlerLifecycle>&
+  get_lifecycle_map();
 };
 
 #endif  // REGISTRY_H
\ No newline at end of file
@@ -0,0 +1,93 @@
+// request_arena.h
+// Per-connection memory for objects that only live while one request is
+// being answered. Allocation bumps a pointer through a buffer the session
+// owns; nothing is freed individually, the whole arena is rewound once the
+// responses are written.
+#ifndef REQUEST_ARENA_H
+#define REQUEST_ARENA_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <new>
+#include <utility>
+
+// Bytes each session sets aside for its requests; an arena that runs out
+// borrows further blocks from the heap until its next reset
+#define REQUEST_ARENA_BYTES 4096
+
+// Totals over every RequestArena in the process, updated when an arena is
+// reset or destroyed
+struct ArenaCounters {
+  uint64_t allocations = 0;  // served by an arena
+  uint64_t bytes = 0;
+  uint64_t heap_allocations = 0;  // blocks arenas had to take from the heap
+  uint64_t resets = 0;
+  uint64_t deferred_resets = 0;  // skipped while an allocation was alive
+};
+
+// Allocation is not thread safe and belongs to the owning session's strand.
+// Deallocation may come from any thread, since a handler pool or backend
+// may drop the last reference to a request.
+class RequestArena : public std::pmr::memory_resource {
+ public:
+  explicit RequestArena(size_t size = REQUEST_ARENA_BYTES);
+  ~RequestArena() override;
+  RequestArena(const RequestArena &) = delete;
+  RequestArena &operator=(const RequestArena &) = delete;
+
+  // Construct a T in the arena; pair with destroy()
+  template <typename T, typename... Args>
+  T *create(Args &&...args) {
+    return new (allocate(sizeof(T), alignof(T)))
+        T(std::forward<Args>(args)...);
+  }
+  template <typename T>
+  void destroy(T *object) {
+    object->~T();
+    deallocate(object, sizeof(T), alignof(T));
+  }
+
+  // Rewind to the start of the buffer and return the borrowed blocks. A
+  // reset while something allocated here is still alive would hand its
+  // memory out again, so it is skipped and false returned.
+  bool reset();
+  // Allocations not deallocated yet
+  size_t live() const { return live_.load(std::memory_order_acquire); }
+
+  static ArenaCounters counters();
+
+ private:
+  // Heap behind the buffer, counting the blocks it hands out
+  class HeapResource : public std::pmr::memory_resource {
+   public:
+    explicit HeapResource(ArenaCounters &counters) : counters_(counters) {}
+
+   private:
+    void *do_allocate(size_t bytes, size_t alignment) override;
+    void do_deallocate(void *p, size_t bytes, size_t alignment) override;
+    bool do_is_equal(
+        const std::pmr::memory_resource &other) const noexcept override;
+
+    ArenaCounters &counters_;
+  };
+
+  void *do_allocate(size_t bytes, size_t alignment) override;
+  void do_deallocate(void *p, size_t bytes, size_t alignment) override;
+  bool do_is_equal(
+      const std::pmr::memory_resource &other) const noexcept override;
+  // Add what this arena counted since the last flush to the totals
+  void flush_counters();
+
+  std::unique_ptr<std::byte[]> buffer_;
+  // Counted on the strand and flushed in bulk, so the hot path does not
+  // touch shared cache lines
+  ArenaCounters unflushed_;
+  HeapResource heap_;
+  std::pmr::monotonic_buffer_resource pool_;
+  std::atomic<size_t> live_{0};
+};
+
+#endif  // REQUEST_ARENA_H
@@ -0,0 +1,79 @@
+// request_framer.h
+// Splits the byte stream of a connection into complete HTTP requests.
+#ifndef REQUEST_FRAMER_H
+#define REQUEST_FRAMER_H
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#define DEFAULT_MAX_HEADER_SIZE 8192
+#define DEFAULT_MAX_BODY_SIZE (1024 * 1024)
+// Size of each read; also the buffer size a connection shrinks back to
+#define DEFAULT_READ_SIZE 4096
+
+// Per-connection receive buffer that accumulates reads until it holds a
+// whole request (headers plus a Content-Length or chunked body).
+// Scanning resumes where the previous read stopped, so a request split
+// over many reads is only looked at once. The buffer grows for large
+// requests and is reused for the next one.
+class RequestFramer {
+ public:
+  enum class Status {
+    INCOMPLETE,         // need more bytes
+    COMPLETE,           // a whole request is buffered, call take()
+    HEADERS_TOO_LARGE,  // headers or chunked trailers exceed max_header_size
+    BODY_TOO_LARGE,     // declared body exceeds max_body_size
+    INVALID,            // unusable Content-Length or chunk framing
+  };
+
+  explicit RequestFramer(size_t max_header_size = DEFAULT_MAX_HEADER_SIZE,
+                         size_t max_body_size = DEFAULT_MAX_BODY_SIZE);
+
+  // Writable space of at least n bytes for the next read
+  char* prepare(size_t n);
+  // Mark n bytes written into the space returned by prepare()
+  void commit(size_t n);
+
+  // Look for the end of the request at the front of the buffer
+  Status next();
+  // Remove and return the request found by next() == COMPLETE
+  std::string take();
+  // Same without the copy; the view stays valid until the next prepare()
+  // or reset()
+  std::string_view take_view();
+
+  // Bytes received but not yet taken
+  size_t buffered() const;
+  // Whether next() has seen the whole header block of the current request
+  bool headers_complete() const;
+  // Drop everything buffered, e.g. after a framing error
+  void reset();
+
+ private:
+  // COMPLETE once the header block is buffered and its framing headers
+  // are read, INCOMPLETE or an error status otherwise
+  Status find_headers();
+  Status scan_chunks();
+  void clear_frame();
+
+  size_t max_header_size_;
+  size_t max_body_size_;
+
+  std::vector<char> buf_;
+  size_t begin_ = 0;  // start of the current request
+  size_t end_ = 0;    // end of received bytes
+
+  // Framing state of the current request, offsets relative to begin_
+  size_t scan_pos_ = 0;     // where to resume looking for the header end
+  size_t header_size_ = 0;  // 0 until the blank line has been seen
+  size_t body_size_ = 0;    // Content-Length, or chunk data walked so far
+  bool chunked_ = false;
+  size_t chunk_pos_ = 0;  // start of the next chunk-size or trailer line
+  bool in_trailers_ = false;
+  size_t trailers_pos_ = 0;  // start of the trailer section
+  size_t frame_size_ = 0;  // set once the request is complete
+};
+
+#endif  // REQUEST_FRAMER_H
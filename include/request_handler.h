@@ -1,6 +1,7 @@
 #ifndef REQUEST_HANDLER_H
 #define REQUEST_HANDLER_H
 
+#include <functional>
 #include <memory>
 #include <string>
 
@@ -17,8 +18,21 @@ class RequestHandler {
       requests. It contains a pure virtual function handle_request() that must
       be implemented by any derived class. The function is responsible for
       processing the request and generating a response.
+
+      Handlers that talk to slow backends can also override
+      handle_request_async() to hand the response to a callback later
+      (possibly from another thread) instead of blocking the calling thread.
+      The default implementation adapts the synchronous handle_request().
+
+      Sessions call handle_request_view(), whose request points into the
+      connection's read buffer. Handlers on a hot path override it to skip
+      copying the request; by default it is copied into a Request for
+      handle_request_async().
   */
  public:
+  // Invoked exactly once with the finished response
+  using ResponseCallback = std::function<void(std::unique_ptr<Response>)>;
+
   enum class HandlerType {
     ECHO_REQUEST_HANDLER,
     STATIC_REQUEST_HANDLER,
@@ -26,10 +40,11 @@ class RequestHandler {
     CRUD_REQUEST_HANDLER,
     HEALTH_REQUEST_HANDLER,
     BLOCKING_REQUEST_HANDLER,
-    SHORTEN_REQUEST_HANDLER
+    SHORTEN_REQUEST_HANDLER,
+    METRICS_REQUEST_HANDLER
   };  // Enum to represent the type of handler
 
-  static std::string handler_type_to_string(HandlerType type) {
+  static const char *handler_type_to_string(HandlerType type) {
     switch (type) {
       case HandlerType::ECHO_REQUEST_HANDLER:
         return "EchoHandler";
@@ -45,6 +60,8 @@ class RequestHandler {
         return "BlockingHandler";
       case HandlerType::SHORTEN_REQUEST_HANDLER:
         return "ShortenHandler";
+      case HandlerType::METRICS_REQUEST_HANDLER:
+        return "MetricsHandler";
       default:
         return "UnknownHandler";
     }
@@ -52,6 +69,21 @@ class RequestHandler {
 
   virtual ~RequestHandler() = default;
   virtual std::unique_ptr<Response> handle_request(const Request &req) = 0;
+  // The caller keeps req and the handler alive until callback is invoked
+  virtual void handle_request_async(const Request &req,
+                                    ResponseCallback callback) {
+    callback(handle_request(req));
+  }
+  // The caller keeps req's buffer and the handler alive until callback is
+  // invoked
+  virtual void handle_request_view(const RequestView &req,
+                                   ResponseCallback callback) {
+    auto owned = std::make_shared<const Request>(req.to_request());
+    handle_request_async(*owned, [owned, callback = std::move(callback)](
+                                     std::unique_ptr<Response> res) {
+      callback(std::move(res));
+    });
+  }
   virtual HandlerType get_type() const = 0;
 };
 
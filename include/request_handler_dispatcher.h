@@ -1,39 +1,185 @@
 #ifndef REQUEST_HANDLER_DISPATCHER_H
 #define REQUEST_HANDLER_DISPATCHER_H
 
+#include <atomic>
+#include <cstdint>
 #include <memory>
+#include <mutex>
 #include <string>
-#include <tuple>
+#include <string_view>
 #include <unordered_map>
+#include <vector>
 
+#include "admission_control.h"
+#include "builtin_handlers.h"
 #include "config_parser.h"
 #include "echo_request_handler.h"
+#include "handler_pool.h"
 #include "http_header.h"
 #include "registry.h"
 #include "request_handler.h"
+#include "route_trie.h"
 
 using RequestHandlerFactoryPtr = std::shared_ptr<RequestHandlerFactory>;
 
-// Tuple contains: (factory_ptr, uri, root_path)
-using RequestHandlerFactoryAndWorkersPtr =
-    std::shared_ptr<std::tuple<RequestHandlerFactoryPtr, std::string,
-                               std::shared_ptr<RequestHandlerArgs>>>;
+// One location as configured, built on every (re)load and never changed
+// after. Holding a RoutePtr pins everything in it across reloads.
+struct Route {
+  RequestHandlerFactoryPtr factory;
+  // The location's path
+  std::string location;
+  std::shared_ptr<RequestHandlerArgs> args;
+  HandlerLifecycle lifecycle = HandlerLifecycle::PER_REQUEST;
+  // Runs the location's handlers, or null to run them on the io thread
+  std::shared_ptr<HandlerPool> pool;
+  // Null for locations without max_inflight or shedding
+  std::shared_ptr<InflightLimiter> limiter;
+  // The one handler of a SHARED location, and it resolved against
+  // BuiltinHandlers
+  std::shared_ptr<RequestHandler> shared_handler;
+  BuiltinHandler shared_builtin;
+  // Of the RouteSnapshot it was published in
+  uint64_t generation = 0;
+};
+using RoutePtr = std::shared_ptr<const Route>;
+
+// The handler answering one request. Owns it when the location builds one
+// per request, otherwise borrows the location's long-lived instance: a
+// SHARED one is kept alive by the route it holds on to, even if a reload
+// has replaced that route since, a PER_THREAD one by the thread.
+// Builtin handlers are called through their concrete type.
+class HandlerRef {
+ public:
+  HandlerRef() = default;
+  explicit HandlerRef(std::unique_ptr<RequestHandler> owned)
+      : owned_(std::move(owned)),
+        handler_(owned_.get()),
+        builtin_(BuiltinHandlers::resolve(handler_)) {}
+  // builtin is borrowed resolved against BuiltinHandlers, if it was
+  explicit HandlerRef(RequestHandler* borrowed,
+                      std::shared_ptr<const void> keep_alive = nullptr,
+                      BuiltinHandler builtin = BuiltinHandler())
+      : keep_alive_(std::move(keep_alive)),
+        handler_(borrowed),
+        builtin_(builtin) {}
+
+  RequestHandler* get() const { return handler_; }
+  RequestHandler* operator->() const { return handler_; }
+  RequestHandler& operator*() const { return *handler_; }
+  explicit operator bool() const { return handler_ != nullptr; }
+  // Whether this request got an instance of its own
+  bool owned() const { return owned_ != nullptr; }
+  // Whether calls below skip the virtual interface
+  bool is_builtin() const { return builtin_.index() != 0; }
+
+  void handle_request_view(const RequestView& req,
+                           RequestHandler::ResponseCallback callback) const {
+    std::visit(
+        [&](auto handler) {
+          if constexpr (std::is_same_v<decltype(handler), std::monostate>) {
+            handler_->handle_request_view(req, std::move(callback));
+          } else {
+            handle_builtin(handler, req, std::move(callback));
+          }
+        },
+        builtin_);
+  }
+  RequestHandler::HandlerType get_type() const {
+    return std::visit(
+        [&](auto handler) {
+          if constexpr (std::is_same_v<decltype(handler), std::monostate>) {
+            return handler_->get_type();
+          } else {
+            return builtin_type(handler);
+          }
+        },
+        builtin_);
+  }
+
+ private:
+  std::unique_ptr<RequestHandler> owned_;
+  std::shared_ptr<const void> keep_alive_;
+  RequestHandler* handler_ = nullptr;
+  BuiltinHandler builtin_;
+};
+
+// The routes in effect at one point in time. Never changed once published;
+// a reload publishes a new one instead.
+struct RouteSnapshot {
+  RouteTrie<RoutePtr> routes;
+  // Unique across every dispatcher in the process
+  uint64_t generation = 0;
+};
 
+// Routes are read from an immutable RouteSnapshot that reload() swaps out
+// as a whole. Lookups take no lock: each thread counts its reads of the
+// current snapshot in a slot of its own in this dispatcher, so they never
+// contend or write memory shared with other threads. reload() frees the
+// snapshot it replaced once every read under way at the swap has ended,
+// so idle threads never keep one alive.
 class RequestHandlerDispatcher {
  public:
   RequestHandlerDispatcher(const NginxConfig& config);
   ~RequestHandlerDispatcher();
 
+  // Replace the locations with config's. Requests already routed finish on
+  // the routes they started with; their pools and handlers go away with
+  // the last of them. On failure the current routes stay and false is
+  // returned.
+  bool reload(const NginxConfig& config);
+
+  // The route req goes to, or nullptr if no location matches. Holding it
+  // pins the location's handler, pool and limiter across reloads.
+  RoutePtr get_route(const RequestView& req);
+  HandlerRef get_handler(const RoutePtr& route);
+
   std::unique_ptr<Response> handle_request(const Request& req);
-  std::unique_ptr<RequestHandler> get_handler(const Request& req);
+  // Called on the thread that will run the handler, which matters to
+  // PER_THREAD locations
+  HandlerRef get_handler(const Request& req);
+  HandlerRef get_handler(const RequestView& req);
+  // Pool that should run handlers for req, or nullptr to run inline
+  std::shared_ptr<HandlerPool> get_handler_pool(const Request& req);
+  std::shared_ptr<HandlerPool> get_handler_pool(const RequestView& req);
+  // Admission limits of req's location, or nullptr if it has none
+  std::shared_ptr<InflightLimiter> get_inflight_limiter(const Request& req);
+  std::shared_ptr<InflightLimiter> get_inflight_limiter(
+      const RequestView& req);
 
  private:
-  bool add_routes(const NginxConfig& config);
-  bool add_route(const NginxLocation& location);
+  using RouteMap = std::unordered_map<std::string, RoutePtr>;
+
+  bool add_routes(const NginxConfig& config, uint64_t generation,
+                  RouteMap& routes);
+  bool add_route(const NginxLocation& location, uint64_t generation,
+                 RouteMap& routes);
+  void publish(const RouteMap& routes, uint64_t generation);
+
+  struct alignas(64) ReaderSlot {
+    // Bumped by the owning thread as it starts and ends reading a
+    // snapshot: odd while it reads
+    std::atomic<uint64_t> reads{0};
+  };
+  // This thread's slot, added on its first lookup
+  ReaderSlot& reader_slot();
 
-  std::string longest_prefix_match(const std::string& url);
+  HandlerRef get_handler_for(std::string_view url);
+  std::shared_ptr<HandlerPool> get_handler_pool_for(std::string_view url);
+  std::shared_ptr<InflightLimiter> get_inflight_limiter_for(
+      std::string_view url);
+  // The route of the longest location url starts with, or nullptr
+  RoutePtr find_route(std::string_view url);
 
-  std::unordered_map<std::string, RequestHandlerFactoryAndWorkersPtr> routes_;
+  // Unique across every dispatcher in the process, so a thread's slots
+  // are never mistaken for a destroyed dispatcher's
+  const uint64_t id_;
+  // What lookups read. Owned by snapshot_, which together with
+  // reader_slots_ is written under snapshot_mutex_; lookups only take that
+  // to add a thread's slot.
+  std::atomic<const RouteSnapshot*> current_{nullptr};
+  std::unique_ptr<const RouteSnapshot> snapshot_;
+  std::vector<std::unique_ptr<ReaderSlot>> reader_slots_;
+  std::mutex snapshot_mutex_;
 
   friend class RequestHandlerDispatcherTest;
 };
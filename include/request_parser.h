@@ -11,13 +11,26 @@
 #define REQUEST_PARSER_H
 
 #include <string>
+#include <string_view>
 
+#include "header_scanner.h"
 #include "http_header.h"
+#include "parser_backend.h"
 
 class RequestParser {
  public:
+  // isa only matters to the SIMD backend
+  explicit RequestParser(ParserBackend backend = ParserBackend::BEAST,
+                         ScannerIsa isa = HeaderScanner::best_isa());
+
   // Parse raw HTTP Request to version, method, uri, headers
   void parse(Request &req, const std::string &raw_request);
+  // Same, without copying: req views raw_request, which must outlive it
+  void parse(RequestView &req, std::string_view raw_request);
+
+ private:
+  ParserBackend backend_;
+  HeaderScanner scanner_;
 };
 
 #endif  // REQUEST_PARSER_H
@@ -0,0 +1,154 @@
+// route_trie.h
+// Longest prefix lookup over a fixed set of locations. The locations are
+// compiled once into a compressed trie laid out in flat arrays, so finding
+// the route for a URL is a single walk down the trie that never allocates
+// and looks at each byte of the URL at most once.
+#ifndef ROUTE_TRIE_H
+#define ROUTE_TRIE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+template <typename T>
+class RouteTrie {
+ public:
+  // What a lookup found: the matched location and the value stored for it
+  struct Match {
+    std::string_view location;
+    const T* value = nullptr;
+    explicit operator bool() const { return value != nullptr; }
+  };
+
+  RouteTrie() { nodes_.push_back(Node()); }
+  // Later duplicates of a location are ignored, like add_route does
+  explicit RouteTrie(std::vector<std::pair<std::string, T>> routes) {
+    BuildNode root;
+    for (auto& [location, value] : routes) {
+      BuildNode* node = &root;
+      for (char c : location) {
+        std::unique_ptr<BuildNode>& child = node->children[c];
+        if (!child) {
+          child = std::make_unique<BuildNode>();
+        }
+        node = child.get();
+      }
+      if (node->value < 0) {
+        node->value = static_cast<int32_t>(values_.size());
+        locations_.push_back(std::move(location));
+        values_.push_back(std::move(value));
+      }
+    }
+    nodes_.push_back(Node());
+    compile(root, 0);
+  }
+
+  // The longest location that url starts with, or an empty Match
+  Match longest_prefix_match(std::string_view url) const {
+    int32_t best = -1;
+    const Node* node = &nodes_[0];
+    size_t pos = 0;
+    while (true) {
+      if (node->value >= 0) {
+        best = node->value;
+      }
+      if (pos == url.size() || node->num_children == 0) {
+        break;
+      }
+      const Node* child = find_child(*node, url[pos]);
+      if (child == nullptr) {
+        break;
+      }
+      std::string_view label(labels_.data() + child->label_offset,
+                             child->label_length);
+      if (url.compare(pos, label.size(), label) != 0) {
+        break;
+      }
+      pos += label.size();
+      node = child;
+    }
+    if (best < 0) {
+      return Match();
+    }
+    return Match{locations_[best], &values_[best]};
+  }
+
+  size_t size() const { return values_.size(); }
+  // Trie nodes, root included; a chain of single children is one node
+  size_t node_count() const { return nodes_.size(); }
+
+ private:
+  // The trie as it is built, one byte per edge
+  struct BuildNode {
+    std::map<char, std::unique_ptr<BuildNode>> children;
+    int32_t value = -1;
+  };
+
+  // The compiled trie. Siblings are contiguous and ordered by the first
+  // byte of their label.
+  struct Node {
+    uint32_t label_offset = 0;  // into labels_
+    uint32_t label_length = 0;
+    uint32_t first_child = 0;  // into nodes_
+    uint32_t num_children = 0;
+    char first_byte = 0;
+    int32_t value = -1;  // into values_ and locations_
+  };
+
+  // Lays out the children of build under nodes_[index], merging chains of
+  // nodes that have one child and no value into a single labelled edge
+  void compile(const BuildNode& build, size_t index) {
+    nodes_[index].value = build.value;
+    nodes_[index].first_child = static_cast<uint32_t>(nodes_.size());
+    nodes_[index].num_children = static_cast<uint32_t>(build.children.size());
+    std::vector<const BuildNode*> ends;
+    for (const auto& [c, child] : build.children) {
+      Node node;
+      node.first_byte = c;
+      node.label_offset = static_cast<uint32_t>(labels_.size());
+      labels_.push_back(c);
+      const BuildNode* end = child.get();
+      while (end->value < 0 && end->children.size() == 1) {
+        labels_.push_back(end->children.begin()->first);
+        end = end->children.begin()->second.get();
+      }
+      node.label_length =
+          static_cast<uint32_t>(labels_.size() - node.label_offset);
+      nodes_.push_back(node);
+      ends.push_back(end);
+    }
+    for (size_t i = 0; i < ends.size(); ++i) {
+      compile(*ends[i], nodes_[index].first_child + i);
+    }
+  }
+
+  const Node* find_child(const Node& node, char c) const {
+    const Node* first = nodes_.data() + node.first_child;
+    const Node* last = first + node.num_children;
+    // Most nodes have a handful of children, where scanning beats halving
+    if (node.num_children <= 8) {
+      for (const Node* child = first; child != last; ++child) {
+        if (child->first_byte == c) {
+          return child;
+        }
+      }
+      return nullptr;
+    }
+    const Node* child = std::lower_bound(
+        first, last, c,
+        [](const Node& n, char byte) { return n.first_byte < byte; });
+    return child != last && child->first_byte == c ? child : nullptr;
+  }
+
+  std::vector<Node> nodes_;
+  std::string labels_;
+  std::vector<std::string> locations_;
+  std::vector<T> values_;
+};
+
+#endif  // ROUTE_TRIE_H
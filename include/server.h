@@ -2,13 +2,16 @@
 #ifndef SERVER_H
 #define SERVER_H
 
+#include <utility>  // before asio; see coro_session.h
 #include <boost/asio.hpp>
 #include <functional>
 #include <memory>
 
+#include "admission_control.h"
 #include "config_parser.h"  // for NginxConfig
 #include "isession.h"
 #include "request_handler_dispatcher.h"  // for RequestHandler
+#include "timer_wheel.h"
 
 using boost::asio::ip::tcp;
 using SessionPtr = std::shared_ptr<ISession>;
@@ -18,17 +21,36 @@ class Server {
  public:
   Server(boost::asio::io_service& io, short port, const NginxConfig& config,
          SessionFactory fac = nullptr);
+  // Share an already-built dispatcher between several servers. With
+  // reuse_port set the acceptor binds with SO_REUSEPORT so one Server per
+  // io_service can listen on the same port and the kernel spreads
+  // connections between them.
+  // Connection timeouts of the default sessions are driven by one timer
+  // wheel per Server, i.e. per io_service. Servers sharing a limiter share
+  // its max_connections; without one the Server makes its own from
+  // settings.
+  Server(boost::asio::io_service& io, short port,
+         std::shared_ptr<RequestHandlerDispatcher> dispatcher, bool reuse_port,
+         SessionFactory fac = nullptr,
+         ConnectionSettings settings = ConnectionSettings(),
+         std::shared_ptr<ConnectionLimiter> limiter = nullptr);
+  ~Server();
 
   friend class ServerTest;
 
  private:
   void start_accept();
   void handle_accept(SessionPtr sess, const boost::system::error_code& ec);
+  // Answer 503 and close a connection accepted over max_connections
+  void reject(SessionPtr sess);
 
   boost::asio::io_service& io_;
   tcp::acceptor acceptor_;
-  SessionFactory make_session_;
   std::shared_ptr<RequestHandlerDispatcher> dispatcher_;
+  SessionFactory make_session_;
+  ConnectionSettings settings_;
+  std::shared_ptr<TimerWheel> wheel_;
+  std::shared_ptr<ConnectionLimiter> connection_limiter_;
 };
 
 #endif  // SERVER_H
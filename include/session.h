@@ -4,11 +4,29 @@
 #ifndef SESSION_H
 #define SESSION_H
 
+#include <utility>  // before asio; see coro_session.h
+#include <atomic>
 #include <boost/asio.hpp>
+#include <chrono>
+#include <functional>
 #include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
 
+#include "access_log.h"
+#include "http_header.h"
 #include "isession.h"
+#include "config_parser.h"  // for ConnectionSettings
+#include "metrics.h"
+#include "request_framer.h"
+#include "request_arena.h"
 #include "request_handler_dispatcher.h"  // for dispatcher
+#include "request_parser.h"
+#include "timer_wheel.h"
+
+// Most pipelined requests answered by one gathered write
+#define MAX_PIPELINED_REQUESTS 16
 
 class SessionTest;  // forward declaration for test fixture
 
@@ -17,27 +35,174 @@ class Session
       public std::enable_shared_from_this<Session> {  // Inherit from ISession
                                                       // Interface
  public:
+  // Without a wheel the connection never times out; the settings'
+  // keep-alive request limit applies either way
   explicit Session(boost::asio::io_service &io_service,
-                   std::shared_ptr<RequestHandlerDispatcher> dispatcher);
+                   std::shared_ptr<RequestHandlerDispatcher> dispatcher,
+                   std::shared_ptr<TimerWheel> wheel = nullptr,
+                   ConnectionSettings settings = ConnectionSettings());
+  ~Session() override;
 
   // ISession interface -----------------------------------------------
   boost::asio::ip::tcp::socket &socket() override;
+  void hold_connection_slot(std::shared_ptr<void> slot) override;
   void start() override;
   // -------------------------------------------------------------------
   friend class SessionTest;  // allow test fixture to access private members
+ protected:
+  // Shared with CoroSession, which only replaces the read/write loop
+
+  // A response as handed back to the session. A handler's Response is
+  // written as a head serialized into heads_ followed by its body, which
+  // is never copied. Encoded responses (stock errors, overload) travel as
+  // bytes instead, which point at storage shared by every session.
+  struct Outgoing {
+    Outgoing() = default;
+    explicit Outgoing(std::unique_ptr<Response> res) : res(std::move(res)) {}
+    explicit Outgoing(const std::string *bytes) : bytes(bytes) {}
+
+    std::unique_ptr<Response> res;
+    const std::string *bytes = nullptr;
+    // Recorded once the response has been written
+    metrics::RequestTimer timer;
+  };
+  using ResponseReady = std::function<void(Outgoing)>;
+
+  // Parse one framed request into req, which views raw_request; returns
+  // req.valid
+  bool parse_request(std::string_view raw_request, RequestView &req);
+  // Encoded 400 response for a request that failed to parse
+  const std::string &invalid_request_response(const RequestView &req);
+  // Encoded 400 / 413 / 431 response for a stream that could not be
+  // split into requests
+  const std::string &framing_error_response(RequestFramer::Status status);
+  // Run req's handler through its async API (on the location's handler
+  // pool if it has one) and pass the serialized response to on_ready,
+  // possibly from another thread
+  void run_handler(RequestView req, bool keep_alive, ResponseReady on_ready);
+  // Count req against the keep-alive request limit and decide whether the
+  // connection stays open after answering it
+  bool keep_alive_after(const RequestView &req);
+
+  // Arm the timeout for the read about to be issued: keepalive_timeout
+  // while idle, header_timeout from the first byte of a request until its
+  // headers are in, body_timeout between reads of its body
+  void arm_read_timer();
+  // The buffered request is complete; handlers are not timed
+  void cancel_read_timer();
+  // Close the socket; pending reads complete with operation_aborted
+  void close();
+  // Point write_buffers_ at every response of the batch, serializing
+  // heads into heads_, for one gathered write
+  void gather_write_buffers();
+  // Record the latencies of every response of the batch just written
+  void record_latencies();
+  // Rewind arena_ once the batch is written, or as soon as the last
+  // request still alive in it is destroyed
+  void reset_arena();
+  // An access record for req, received when it was parsed
+  AccessRecord access_record(const RequestView &req);
+  // Complete record with the response's status, emit it and count the
+  // request in metrics.h
+  void log_access(AccessRecord &record, int status_code,
+                  RequestHandler::HandlerType handler);
+  // Same for a request no handler answered, for the reason given
+  void log_access(AccessRecord &record, int status_code, const char *outcome);
+  // Stage boundaries of the request being answered, as record and the
+  // handler that answered it, if any, left them
+  metrics::RequestTimer request_timer(const AccessRecord &record,
+                                      const HandlerRef &handler) const;
+  // The peer's address, formatted once per connection
+  std::string_view peer();
+  // Count the connection as open in metrics.h until destroyed
+  void count_open();
+
+  boost::asio::ip::tcp::socket socket_;
+  // Accumulates reads until a whole request has arrived
+  RequestFramer framer_;
+
+  std::shared_ptr<RequestHandlerDispatcher>
+      dispatcher_;  // a constant reference to the dispatcher
+
+  // All socket completions run here; responses from handler pool threads
+  // or async backends and timeouts are posted back onto it
+  boost::asio::strand<boost::asio::io_service::executor_type> strand_;
+
+  std::shared_ptr<TimerWheel> wheel_;
+  ConnectionSettings settings_;
+  RequestParser parser_;  // settings_.parser backend
+  // Holds each request's InFlight; rewound after every write. Only
+  // touched on strand_, allocations and destructions alike.
+  RequestArena arena_;
+  // The last rewind was skipped because a request was still alive
+  bool arena_reset_pending_ = false;
+  // Set once the current batch of responses is the last one
+  bool close_after_write_ = false;
+
+  // Responses of the current pipelined batch; must outlive the write
+  std::vector<Outgoing> responses_;
+  // Reused across batches, so serializing a head stops allocating once
+  // the buffers have grown to fit
+  std::vector<std::string> heads_;
+  std::vector<boost::asio::const_buffer> write_buffers_;
+  // When the request being answered started and finished parsing
+  AccessRecord::Clock::time_point request_parse_started_;
+  AccessRecord::Clock::time_point request_received_;
+  std::string peer_;
+  bool counted_open_ = false;
+
  private:
   void handle_read(const boost::system::error_code &error,
                    size_t bytes_transferred);
   void handle_write(const boost::system::error_code &error);
-  std::string handle_response(size_t bytes_transferred);
 
-  boost::asio::ip::tcp::socket socket_;
-  // max length of data buffer 1KB
-  const static int MAX_LENGTH = 1024;
-  char data_[MAX_LENGTH];
+  void do_read();
+  // Answer buffered requests one after another, then write all of their
+  // responses at once; read more if nothing is buffered
+  void process_buffer();
+  // Run the request's handler and continue the batch from strand_
+  void dispatch_request(RequestView req, bool keep_alive);
+  // Gathered write of responses_
+  void do_write();
 
-  std::shared_ptr<RequestHandlerDispatcher>
-      dispatcher_;  // a constant reference to the dispatcher
+  // A request from dispatch until its handler has answered and returned,
+  // allocated in arena_. The handler callbacks only carry a pointer to it,
+  // which std::function stores without allocating.
+  struct InFlight {
+    InFlight(std::shared_ptr<Session> self, RequestView req, bool keep_alive,
+             ResponseReady on_ready);
+
+    std::shared_ptr<Session> self;
+    RequestView req;
+    bool keep_alive;
+    ResponseReady on_ready;
+    // The location's route as of the request's arrival, so a reload in
+    // the meantime does not take its pool or limiter away
+    RoutePtr route;
+    HandlerRef handler;
+    InflightLimiter *limiter = nullptr;
+    AccessRecord access;
+    // One for the unanswered request, one per call into the handler that
+    // has not returned yet
+    std::atomic<int> refs{1};
+  };
+  // Callback for flight's handler; captures nothing but the pointer
+  RequestHandler::ResponseCallback response_callback(InFlight *flight);
+  // Hand the response to on_ready and drop the unanswered reference
+  void answer(InFlight *flight, Outgoing response);
+  // Destroys flight with its last reference, on strand_ even if that is
+  // dropped on a handler pool thread
+  void release(InFlight *flight);
+  void destroy(InFlight *flight);
+
+  enum class ReadPhase { NONE, IDLE, HEADER, BODY };
+  void on_read_timeout();
+
+  std::unique_ptr<TimerWheel::Timer> read_timer_;  // created on first arm
+  ReadPhase read_phase_ = ReadPhase::NONE;
+  std::chrono::steady_clock::time_point read_deadline_;
+  int requests_served_ = 0;
+  std::shared_ptr<void> connection_slot_;
 };
 
-#endif  // SESSION_H
\ No newline at end of file
+#endif  // SESSION_H
@@ -21,9 +21,19 @@ class ShortenRequestHandler : public RequestHandler {
                         std::shared_ptr<ShortenRequestHandlerArgs> args);
   ~ShortenRequestHandler();
   std::unique_ptr<Response> handle_request(const Request& request) override;
+  // Redirect lookups go through the clients' async API so no thread waits
+  // on Redis or the database; everything else completes inline
+  void handle_request_async(const Request& request,
+                            ResponseCallback callback) override;
+  // Redirects, the hot path, are served straight from the view; anything
+  // else is copied into a Request first
+  void handle_request_view(const RequestView& request,
+                           ResponseCallback callback) override;
   RequestHandler::HandlerType get_type() const override;
   std::unique_ptr<Response> handle_post_request(const Request& request);
   std::unique_ptr<Response> handle_get_request(const Request& request);
+  void handle_get_request_async(const Request& request,
+                                ResponseCallback callback);
 
  private:
   static constexpr int SHORT_URL_LENGTH = 6;
@@ -33,6 +43,14 @@ class ShortenRequestHandler : public RequestHandler {
   std::shared_ptr<IRedisClient> redis_;
   std::shared_ptr<IDatabaseClient> db_;
   std::string base62_encode(const std::string& url);
+  // Short code from /base_uri/6UQVxS, or "" if the URI is not a short URL
+  std::string extract_short_url(std::string_view uri) const;
+  // Look short_url up in Redis, then the database, and answer with a
+  // redirect or 404
+  void redirect_async(const std::string& short_url, const std::string& version,
+                      ResponseCallback callback);
+  static std::unique_ptr<Response> make_redirect(const std::string& version,
+                                                 const std::string& long_url);
 };
 
 #endif  // SHORTEN_REQUEST_HANDLER_H
\ No newline at end of file
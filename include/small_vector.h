@@ -0,0 +1,140 @@
+// small_vector.h
+// A vector that keeps its first N elements inside the object and only
+// allocates once it grows past them.
+#ifndef SMALL_VECTOR_H
+#define SMALL_VECTOR_H
+
+#include <algorithm>
+#include <cstddef>
+#include <initializer_list>
+#include <memory>
+#include <new>
+#include <utility>
+
+template <typename T, size_t N>
+class SmallVector {
+ public:
+  using value_type = T;
+  using iterator = T *;
+  using const_iterator = const T *;
+
+  SmallVector() = default;
+  SmallVector(std::initializer_list<T> init) { assign(init.begin(), init.end()); }
+  SmallVector(const SmallVector &other) { assign(other.begin(), other.end()); }
+  SmallVector(SmallVector &&other) noexcept { take(std::move(other)); }
+  ~SmallVector() { release(); }
+
+  SmallVector &operator=(const SmallVector &other) {
+    if (this != &other) {
+      assign(other.begin(), other.end());
+    }
+    return *this;
+  }
+  SmallVector &operator=(SmallVector &&other) noexcept {
+    if (this != &other) {
+      release();
+      take(std::move(other));
+    }
+    return *this;
+  }
+  SmallVector &operator=(std::initializer_list<T> init) {
+    assign(init.begin(), init.end());
+    return *this;
+  }
+
+  template <typename It>
+  void assign(It first, It last) {
+    clear();
+    reserve(static_cast<size_t>(std::distance(first, last)));
+    for (; first != last; ++first) {
+      push_back(*first);
+    }
+  }
+
+  void push_back(const T &value) { emplace_back(value); }
+  void push_back(T &&value) { emplace_back(std::move(value)); }
+
+  template <typename... Args>
+  T &emplace_back(Args &&...args) {
+    if (size_ == capacity_) {
+      grow(capacity_ * 2);
+    }
+    T *slot = new (data_ + size_) T(std::forward<Args>(args)...);
+    ++size_;
+    return *slot;
+  }
+
+  void reserve(size_t capacity) {
+    if (capacity > capacity_) {
+      grow(capacity);
+    }
+  }
+
+  void clear() {
+    std::destroy(data_, data_ + size_);
+    size_ = 0;
+  }
+
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  // Whether the elements still live inside the object
+  bool is_inline() const { return data_ == inline_data(); }
+
+  T &operator[](size_t i) { return data_[i]; }
+  const T &operator[](size_t i) const { return data_[i]; }
+  T &back() { return data_[size_ - 1]; }
+  const T &back() const { return data_[size_ - 1]; }
+
+  iterator begin() { return data_; }
+  iterator end() { return data_ + size_; }
+  const_iterator begin() const { return data_; }
+  const_iterator end() const { return data_ + size_; }
+
+ private:
+  T *inline_data() { return reinterpret_cast<T *>(inline_); }
+  const T *inline_data() const { return reinterpret_cast<const T *>(inline_); }
+
+  // Moves the elements to a heap buffer of the given capacity
+  void grow(size_t capacity) {
+    T *data = static_cast<T *>(::operator new(capacity * sizeof(T)));
+    std::uninitialized_move(data_, data_ + size_, data);
+    std::destroy(data_, data_ + size_);
+    if (!is_inline()) {
+      ::operator delete(data_);
+    }
+    data_ = data;
+    capacity_ = capacity;
+  }
+
+  void release() {
+    clear();
+    if (!is_inline()) {
+      ::operator delete(data_);
+    }
+    data_ = inline_data();
+    capacity_ = N;
+  }
+
+  // Expects this to be empty and inline
+  void take(SmallVector &&other) {
+    if (other.is_inline()) {
+      std::uninitialized_move(other.begin(), other.end(), data_);
+      size_ = other.size_;
+      other.clear();
+    } else {
+      data_ = other.data_;
+      size_ = other.size_;
+      capacity_ = other.capacity_;
+      other.data_ = other.inline_data();
+      other.size_ = 0;
+      other.capacity_ = N;
+    }
+  }
+
+  alignas(T) unsigned char inline_[N * sizeof(T)];
+  T *data_ = inline_data();
+  size_t size_ = 0;
+  size_t capacity_ = N;
+};
+
+#endif  // SMALL_VECTOR_H
@@ -0,0 +1,77 @@
+// timer_wheel.h
+// A hashed timing wheel for connection timeouts.
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <utility>  // before asio; see coro_session.h
+#include <boost/asio.hpp>
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#define DEFAULT_TIMER_WHEEL_SLOTS 512
+
+// One steady_timer ticking at a fixed resolution drives every timeout on
+// an io_service. Timers are intrusive list nodes owned by the caller, so
+// arming, re-arming and cancelling are O(1) and never allocate; expiry
+// costs one slot walk per tick no matter how many connections are idle.
+//
+// Expiry callbacks run on a thread of the io_service after the timer has
+// been disarmed, outside the wheel's lock.
+class TimerWheel : public std::enable_shared_from_this<TimerWheel> {
+ public:
+  class Timer {
+   public:
+    explicit Timer(std::function<void()> on_expire);
+    // Cancels the timer if it is still armed
+    ~Timer();
+
+    Timer(const Timer&) = delete;
+    Timer& operator=(const Timer&) = delete;
+
+   private:
+    friend class TimerWheel;
+
+    std::function<void()> on_expire_;
+    TimerWheel* wheel_ = nullptr;  // set on first schedule()
+    bool armed_ = false;           // guarded by the wheel's mutex
+    Timer* prev_ = nullptr;
+    Timer* next_ = nullptr;
+    size_t slot_ = 0;
+    size_t rounds_ = 0;  // full turns left before it expires
+  };
+
+  TimerWheel(boost::asio::io_service& io,
+             std::chrono::milliseconds tick = std::chrono::seconds(1),
+             size_t num_slots = DEFAULT_TIMER_WHEEL_SLOTS);
+
+  TimerWheel(const TimerWheel&) = delete;
+  TimerWheel& operator=(const TimerWheel&) = delete;
+
+  // Start ticking; the pending tick keeps the wheel alive until stop()
+  // or until the io_service is stopped
+  void start();
+  void stop();
+
+  // (Re)arm timer to expire no earlier than delay and within one tick of it
+  void schedule(Timer& timer, std::chrono::milliseconds delay);
+  void cancel(Timer& timer);
+
+  std::chrono::milliseconds tick() const;
+
+ private:
+  void on_tick(const boost::system::error_code& ec);
+  void unlink(Timer& timer);
+
+  boost::asio::steady_timer tick_timer_;
+  std::chrono::milliseconds tick_;
+  std::vector<Timer*> slots_;  // head of each slot's list
+  size_t cursor_ = 0;
+  bool running_ = false;
+  std::mutex mutex_;
+};
+
+#endif  // TIMER_WHEEL_H
@@ -0,0 +1,50 @@
+#include "access_log.h"
+
+#include <chrono>
+#include <ostream>
+
+#include "binary_access_log.h"
+#include "logging.h"
+
+namespace {
+
+long long micros(AccessRecord::Clock::duration duration) {
+  return std::chrono::duration_cast<std::chrono::microseconds>(duration)
+      .count();
+}
+
+}  // namespace
+
+void AccessRecord::emit() {
+  if (answered == Clock::time_point()) {
+    answered = Clock::now();
+  }
+  if (BinaryAccessLog* log = binary_access_log()) {
+    log->append(*this);
+    return;
+  }
+  LOG(info) << *this;
+}
+
+std::ostream &operator<<(std::ostream &os, const AccessRecord &record) {
+  // The first four fields keep the layout log scrapers already parse
+  os << "[ResponseMetrics] status_code=" << record.status_code << " path=\""
+     << record.path << "\" ip=\"" << record.peer << "\" handler=\""
+     << record.handler << "\"";
+  if (!record.method.empty()) {
+    os << " method=" << record.method;
+  }
+  if (!record.location.empty()) {
+    os << " location=\"" << record.location << "\"";
+  }
+  if (record.cache_tier) {
+    os << " cache=" << record.cache_tier;
+  }
+  if (record.dispatched != AccessRecord::Clock::time_point()) {
+    os << " handler_us=" << micros(record.answered - record.dispatched);
+  }
+  if (record.received != AccessRecord::Clock::time_point()) {
+    os << " total_us=" << micros(record.answered - record.received);
+  }
+  return os;
+}
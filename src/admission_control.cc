@@ -0,0 +1,69 @@
+#include "admission_control.h"
+
+#include <algorithm>
+
+#include "logging.h"
+
+ConnectionLimiter::ConnectionLimiter(size_t max_connections)
+    : max_connections_(max_connections), state_(std::make_shared<State>()) {}
+
+ConnectionLimiter::Slot ConnectionLimiter::try_acquire() {
+  size_t active = state_->active.fetch_add(1) + 1;
+  if (max_connections_ > 0 && active > max_connections_) {
+    state_->active.fetch_sub(1);
+    LOG(warning) << "Connection limit of " << max_connections_ << " reached";
+    return nullptr;
+  }
+  // The slot only needs to run its deleter; the state it points to keeps
+  // the counter alive even if the limiter goes first
+  std::shared_ptr<State> state = state_;
+  return Slot(state.get(), [state](void*) { state->active.fetch_sub(1); });
+}
+
+size_t ConnectionLimiter::active() const { return state_->active.load(); }
+
+InflightLimiter::InflightLimiter(size_t max_inflight,
+                                 std::chrono::milliseconds target,
+                                 std::chrono::milliseconds interval)
+    : max_inflight_(max_inflight),
+      target_(target),
+      interval_(interval),
+      interval_end_(Clock::now() + interval) {}
+
+bool InflightLimiter::try_acquire() {
+  size_t inflight = inflight_.fetch_add(1) + 1;
+  if (max_inflight_ > 0 && inflight > max_inflight_) {
+    inflight_.fetch_sub(1);
+    return false;
+  }
+  return true;
+}
+
+void InflightLimiter::release() { inflight_.fetch_sub(1); }
+
+size_t InflightLimiter::inflight() const { return inflight_.load(); }
+
+bool InflightLimiter::should_shed(Clock::duration queued) {
+  if (target_ == Clock::duration::zero()) {
+    return false;
+  }
+  Clock::time_point now = Clock::now();
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (now >= interval_end_) {
+    bool was_overloaded = overloaded_;
+    overloaded_ = min_delay_ > target_;
+    if (overloaded_ != was_overloaded) {
+      LOG(warning) << (overloaded_ ? "Entering" : "Leaving")
+                   << " overload; shortest queueing delay was "
+                   << std::chrono::duration_cast<std::chrono::milliseconds>(
+                          min_delay_)
+                          .count()
+                   << "ms";
+    }
+    min_delay_ = queued;
+    interval_end_ = now + interval_;
+  } else {
+    min_delay_ = std::min(min_delay_, queued);
+  }
+  return queued > (overloaded_ ? target_ : interval_);
+}
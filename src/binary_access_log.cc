@@ -0,0 +1,289 @@
+#include "binary_access_log.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <string>
+
+#include "logging.h"
+
+namespace {
+
+// Longest a record waits in the batch
+const auto kMaxBatchDelay = std::chrono::seconds(1);
+// Longest the writer sleeps, which bounds how long a record waits in the
+// queue before it is taken into the batch
+const auto kWriterIdle = std::chrono::milliseconds(10);
+
+void put_le(std::string& out, uint64_t value, int bytes) {
+  for (int i = 0; i < bytes; ++i) {
+    out.push_back(static_cast<char>(value & 0xff));
+    value >>= 8;
+  }
+}
+
+void put_string(std::string& out, std::string_view value) {
+  // Anything longer than a u16 length can say is cut short
+  size_t length = std::min<size_t>(value.size(), UINT16_MAX);
+  put_le(out, length, 2);
+  out.append(value.data(), length);
+}
+
+uint32_t clamp_micros(AccessRecord::Clock::duration duration) {
+  auto micros =
+      std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+  if (micros < 0) {
+    return 0;
+  }
+  return static_cast<uint32_t>(
+      std::min<long long>(micros, ACCESS_LOG_NO_HANDLER - 1));
+}
+
+std::string local_time_stamp() {
+  std::time_t now = std::time(nullptr);
+  std::tm tm;
+  localtime_r(&now, &tm);
+  char stamp[32];
+  std::strftime(stamp, sizeof(stamp), "%Y%m%d_%H%M%S", &tm);
+  return stamp;
+}
+
+// Owned by set_binary_access_log(); read by every emit()
+std::shared_ptr<BinaryAccessLog> installed_log;
+std::atomic<BinaryAccessLog*> active_log{nullptr};
+
+}  // namespace
+
+BinaryAccessLog::BinaryAccessLog(std::string prefix, size_t rotation_size,
+                                 size_t batch_size, size_t queue_size)
+    : prefix_(std::move(prefix)),
+      rotation_size_(rotation_size),
+      batch_size_(batch_size),
+      ring_(queue_size),
+      start_time_(local_time_stamp()) {
+  open_next();
+  writer_ = std::thread(&BinaryAccessLog::run, this);
+}
+
+BinaryAccessLog::~BinaryAccessLog() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  wake_.notify_one();
+  writer_.join();
+  if (fd_ >= 0) {
+    ::close(fd_);
+  }
+}
+
+void BinaryAccessLog::encode(const AccessRecord& record, uint64_t unix_us,
+                             std::string& out) {
+  size_t start = out.size();
+  put_le(out, 0, 4);  // size, filled in below
+  put_le(out, unix_us, 8);
+  put_le(out, clamp_micros(record.answered - record.received), 4);
+  put_le(out,
+         record.dispatched == AccessRecord::Clock::time_point()
+             ? ACCESS_LOG_NO_HANDLER
+             : clamp_micros(record.answered - record.dispatched),
+         4);
+  put_le(out, static_cast<uint16_t>(record.status_code), 2);
+  put_string(out, record.method);
+  put_string(out, record.location);
+  put_string(out, record.path);
+  put_string(out, record.peer);
+  put_string(out, record.handler);
+  put_string(out, record.cache_tier ? record.cache_tier : "");
+  uint64_t size = out.size() - start;
+  for (int i = 0; i < 4; ++i) {
+    out[start + i] = static_cast<char>((size >> (8 * i)) & 0xff);
+  }
+}
+
+void BinaryAccessLog::append(const AccessRecord& record) {
+  std::string encoded;
+  uint64_t unix_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                         std::chrono::system_clock::now().time_since_epoch())
+                         .count();
+  encode(record, unix_us, encoded);
+  // The writer picks it up within kWriterIdle, so it is not woken
+  if (!ring_.try_push(std::move(encoded))) {
+    dropped_.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+void BinaryAccessLog::flush() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  uint64_t ticket = ++flush_requested_;
+  wake_.notify_one();
+  flushed_.wait(lock, [&] { return flush_completed_ >= ticket; });
+}
+
+std::string BinaryAccessLog::current_file() {
+  std::lock_guard<std::mutex> lock(file_mutex_);
+  return current_file_;
+}
+
+uint64_t BinaryAccessLog::dropped() const {
+  return dropped_.load(std::memory_order_relaxed);
+}
+
+void BinaryAccessLog::run() {
+  std::string record;
+  while (true) {
+    uint64_t requested;
+    bool stopping;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      requested = flush_requested_;
+      stopping = stopping_;
+    }
+    // Everything appended before the request or the stop is queued by now
+    while (ring_.try_pop(record)) {
+      take(record);
+    }
+    if (requested != flush_completed_ || stopping ||
+        Clock::now() >= pending_deadline_) {
+      write_pending();
+    }
+    uint64_t dropped = dropped_.load(std::memory_order_relaxed);
+    if (dropped != reported_dropped_) {
+      LOG(warning) << "Dropped " << dropped - reported_dropped_
+                   << " access records, the access log fell behind";
+      reported_dropped_ = dropped;
+    }
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (requested != flush_completed_) {
+      flush_completed_ = requested;
+      flushed_.notify_all();
+    }
+    if (stopping) {
+      return;
+    }
+    wake_.wait_for(lock, kWriterIdle, [&] {
+      return stopping_ || flush_requested_ != flush_completed_;
+    });
+  }
+}
+
+void BinaryAccessLog::take(std::string& record) {
+  // A batch only ever goes to one file, so close it where the file would
+  // grow past rotation_size_
+  if (!pending_.empty() &&
+      file_size_ + pending_.size() + record.size() > rotation_size_) {
+    write_pending();
+  }
+  // The record waited up to kWriterIdle to be taken, and the writer may
+  // oversleep the deadline by as much again
+  if (pending_.empty()) {
+    pending_deadline_ = Clock::now() + kMaxBatchDelay - 2 * kWriterIdle;
+  }
+  pending_ += record;
+  if (pending_.size() >= batch_size_) {
+    write_pending();
+  }
+}
+
+void BinaryAccessLog::write_pending() {
+  if (pending_.empty()) {
+    return;
+  }
+  if (fd_ >= 0 && file_size_ > ACCESS_LOG_MAGIC_SIZE &&
+      file_size_ + pending_.size() > rotation_size_) {
+    open_next();
+  }
+  if (fd_ < 0 && !open_next()) {
+    pending_.clear();
+    return;
+  }
+  // The batch only holds whole records, so a file never ends mid-record
+  // unless a write fails
+  size_t written = 0;
+  while (written < pending_.size()) {
+    ssize_t n =
+        ::write(fd_, pending_.data() + written, pending_.size() - written);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      LOG(error) << "Failed to write access log " << current_file() << ": "
+                 << std::strerror(errno);
+      break;
+    }
+    written += static_cast<size_t>(n);
+  }
+  file_size_ += written;
+  pending_.clear();
+}
+
+bool BinaryAccessLog::open_next() {
+  if (fd_ >= 0) {
+    ::close(fd_);
+    fd_ = -1;
+  }
+  std::string path = prefix_ + "_" + start_time_ + "_" +
+                     std::to_string(file_index_++) + ".bin";
+  int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC,
+                  0644);
+  struct stat st;
+  if (fd < 0 || ::fstat(fd, &st) != 0) {
+    LOG(error) << "Failed to open access log " << path << ": "
+               << std::strerror(errno);
+    if (fd >= 0) {
+      ::close(fd);
+    }
+    std::lock_guard<std::mutex> lock(file_mutex_);
+    current_file_.clear();
+    return false;
+  }
+  fd_ = fd;
+  file_size_ = static_cast<size_t>(st.st_size);
+  if (file_size_ == 0 &&
+      ::write(fd_, ACCESS_LOG_MAGIC, ACCESS_LOG_MAGIC_SIZE) ==
+          ACCESS_LOG_MAGIC_SIZE) {
+    file_size_ = ACCESS_LOG_MAGIC_SIZE;
+  }
+  {
+    std::lock_guard<std::mutex> lock(file_mutex_);
+    current_file_ = path;
+  }
+  LOG(info) << "Writing access log to " << path;
+  return true;
+}
+
+std::shared_ptr<BinaryAccessLog> binary_access_log_from_env() {
+  const char* prefix = std::getenv("CREEPER_ACCESS_LOG");
+  if (prefix == nullptr || *prefix == '\0') {
+    return nullptr;
+  }
+  size_t rotation_size = DEFAULT_ACCESS_LOG_ROTATION;
+  if (const char* env = std::getenv("CREEPER_ACCESS_LOG_ROTATION")) {
+    long size = std::atol(env);
+    if (size > 0) {
+      rotation_size = static_cast<size_t>(size);
+    }
+  }
+  return std::make_shared<BinaryAccessLog>(prefix, rotation_size);
+}
+
+void set_binary_access_log(std::shared_ptr<BinaryAccessLog> log) {
+  active_log.store(log.get(), std::memory_order_release);
+  if (installed_log) {
+    installed_log->flush();
+  }
+  installed_log = std::move(log);
+}
+
+BinaryAccessLog* binary_access_log() {
+  return active_log.load(std::memory_order_acquire);
+}
@@ -7,8 +7,9 @@
 #include "logging.h"
 #include "registry.h"
 
-REGISTER_HANDLER("BlockingHandler", BlockingRequestHandler,
-                 BlockingRequestHandlerArgs);
+// Stateless, so one instance serves every request
+REGISTER_HANDLER_WITH_LIFECYCLE("BlockingHandler", BlockingRequestHandler,
+                                BlockingRequestHandlerArgs, SHARED);
 
 BlockingRequestHandlerArgs::BlockingRequestHandlerArgs() {}
 
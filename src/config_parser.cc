@@ -15,7 +15,10 @@
 #include <iostream>
 #include <memory>
 #include <stack>
+#include <stdexcept>
 #include <string>
+#include <thread>
+#include <utility>
 #include <vector>
 
 // #include "echo_request_handler.h"
@@ -60,6 +63,176 @@ int NginxConfig::get_port() const {
   return -1;  // Default value if no port is found
 }
 
+int NginxConfig::get_threads() const {
+  for (const auto& statement : statements_) {
+    // Only the top-level "threads" directive is honoured
+    if (statement->tokens_.size() != 2 || statement->tokens_[0] != "threads") {
+      continue;
+    }
+    const std::string& value = statement->tokens_[1];
+    if (value == "auto") {
+      unsigned int cores = std::thread::hardware_concurrency();
+      // hardware_concurrency() may return 0 if it cannot be determined
+      int threads = cores > 0 ? static_cast<int>(cores) : DEFAULT_NUM_THREADS;
+      LOG(info) << "Found threads directive auto, threads=" << threads;
+      return threads;
+    }
+    try {
+      size_t idx;
+      int threads = std::stoi(value, &idx);
+      if (idx != value.size() || threads <= 0) {
+        LOG(error) << "Invalid threads value '" << value << "'";
+        return -1;
+      }
+      LOG(info) << "Found threads directive, threads=" << threads;
+      return threads;
+    } catch (std::exception& e) {
+      LOG(error) << "Failed to parse threads '" << value << "': " << e.what();
+      return -1;
+    }
+  }
+  LOG(debug) << "No threads directive found; defaulting to "
+             << DEFAULT_NUM_THREADS;
+  return DEFAULT_NUM_THREADS;
+}
+
+CpuAffinity NginxConfig::get_cpu_affinity() const {
+  for (const auto& statement : statements_) {
+    if (statement->tokens_.size() == 2 &&
+        statement->tokens_[0] == "cpu_affinity") {
+      const std::string& value = statement->tokens_[1];
+      if (value == "on") {
+        return CpuAffinity::ON;
+      } else if (value == "off") {
+        return CpuAffinity::OFF;
+      }
+      LOG(error) << "Invalid cpu_affinity '" << value << "'";
+      return CpuAffinity::INVALID;
+    }
+  }
+  return CpuAffinity::OFF;
+}
+
+IoMode NginxConfig::get_io_mode() const {
+  for (const auto& statement : statements_) {
+    if (statement->tokens_.size() == 2 && statement->tokens_[0] == "io_mode") {
+      const std::string& value = statement->tokens_[1];
+      if (value == "shared") {
+        return IoMode::SHARED;
+      } else if (value == "sharded") {
+        return IoMode::SHARDED;
+      }
+      LOG(error) << "Invalid io_mode '" << value << "'";
+      return IoMode::INVALID;
+    }
+  }
+  return IoMode::SHARED;
+}
+
+ConnectionSettings NginxConfig::get_connection_settings() const {
+  ConnectionSettings settings;
+  const std::pair<const char*, int*> directives[] = {
+      {"keepalive_timeout", &settings.keepalive_timeout},
+      {"header_timeout", &settings.header_timeout},
+      {"body_timeout", &settings.body_timeout},
+      {"keepalive_requests", &settings.keepalive_requests},
+      {"max_connections", &settings.max_connections},
+  };
+  for (const auto& statement : statements_) {
+    if (statement->tokens_.size() != 2) {
+      continue;
+    }
+    if (statement->tokens_[0] == "parser") {
+      const std::string& value = statement->tokens_[1];
+      if (value == "beast") {
+        settings.parser = ParserBackend::BEAST;
+      } else if (value == "simd") {
+        settings.parser = ParserBackend::SIMD;
+      } else {
+        LOG(error) << "Invalid parser '" << value << "'";
+        settings.valid = false;
+      }
+      continue;
+    }
+    for (const auto& [name, field] : directives) {
+      if (statement->tokens_[0] != name) {
+        continue;
+      }
+      const std::string& value = statement->tokens_[1];
+      try {
+        size_t idx;
+        int n = std::stoi(value, &idx);
+        if (idx != value.size() || n < 0) {
+          throw std::invalid_argument("negative or trailing characters");
+        }
+        *field = n;
+        LOG(info) << "Found " << name << " directive, value=" << n;
+      } catch (std::exception& e) {
+        LOG(error) << "Invalid " << name << " value '" << value << "'";
+        settings.valid = false;
+      }
+    }
+  }
+  return settings;
+}
+
+// Parse a positive integer directive value; returns -1 if invalid.
+static int parse_positive_int(const std::string& value) {
+  try {
+    size_t idx;
+    int n = std::stoi(value, &idx);
+    return (idx == value.size() && n > 0) ? n : -1;
+  } catch (std::exception& e) {
+    return -1;
+  }
+}
+
+bool NginxConfig::extract_location_options(
+    const std::shared_ptr<NginxConfigStatement>& statement,
+    NginxLocation* location,
+    std::shared_ptr<NginxConfigStatement>* handler_statement) {
+  // Shallow copy of the location statement; the child statements themselves
+  // are shared, only the list is filtered
+  auto filtered = std::make_shared<NginxConfigStatement>();
+  filtered->tokens_ = statement->tokens_;
+  if (statement->child_block_) {
+    filtered->child_block_ = std::make_unique<NginxConfig>();
+  }
+  *handler_statement = filtered;
+  if (!statement->child_block_) {
+    return true;
+  }
+
+  for (const auto& child : statement->child_block_->statements_) {
+    const auto& tokens = child->tokens_;
+    const std::pair<const char*, int*> options[] = {
+        {"handler_threads", &location->handler_threads},
+        {"handler_queue", &location->handler_queue},
+        {"max_inflight", &location->max_inflight},
+        {"shed_target_ms", &location->shed_target_ms},
+        {"shed_interval_ms", &location->shed_interval_ms},
+    };
+    int* field = nullptr;
+    for (const auto& [name, option_field] : options) {
+      if (!tokens.empty() && tokens[0] == name) {
+        field = option_field;
+      }
+    }
+    if (field) {
+      int value = tokens.size() == 2 ? parse_positive_int(tokens[1]) : -1;
+      if (value == -1) {
+        LOG(error) << "Invalid " << tokens[0] << " for location "
+                   << location->path;
+        return false;
+      }
+      *field = value;
+      continue;
+    }
+    filtered->child_block_->statements_.push_back(child);
+  }
+  return true;
+}
+
 NginxLocationResult NginxConfig::get_locations() const {
   NginxLocationResult result;
   std::vector<NginxLocation> locations;
@@ -113,7 +286,16 @@ NginxLocationResult NginxConfig::get_locations() const {
         return result;
       }
 
-      auto args = (*create_from_config_func)(statement);
+      // Pull out the directives every location understands so the
+      // handler-specific create_from_config only sees its own statements
+      std::shared_ptr<NginxConfigStatement> handler_statement;
+      if (!extract_location_options(statement, &location,
+                                    &handler_statement)) {
+        result.valid = false;
+        return result;
+      }
+
+      auto args = (*create_from_config_func)(handler_statement);
       if (!args) {
         result.valid = false;
         return result;
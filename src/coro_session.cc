@@ -0,0 +1,123 @@
+// A Session that runs its read / handle / write loop as a coroutine.
+//
+// Each connection is one awaitable frame, so a request costs the frame's
+// awaits rather than a freshly bound completion handler per I/O hop.
+
+#include "coro_session.h"
+
+#include <boost/asio.hpp>
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/detached.hpp>
+#include <boost/asio/use_awaitable.hpp>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "http_header.h"
+#include "logging.h"
+#include "metrics.h"
+#include "request_handler_dispatcher.h"
+#include "request_parser.h"
+
+using boost::asio::awaitable;
+using boost::asio::use_awaitable;
+
+CoroSession::CoroSession(boost::asio::io_service &io_service,
+                         std::shared_ptr<RequestHandlerDispatcher> dispatcher,
+                         std::shared_ptr<TimerWheel> wheel,
+                         ConnectionSettings settings)
+    : Session(io_service, std::move(dispatcher), std::move(wheel), settings) {}
+
+void CoroSession::start() {
+  count_open();
+  auto self = std::static_pointer_cast<CoroSession>(shared_from_this());
+  boost::asio::co_spawn(strand_, run(self), boost::asio::detached);
+}
+
+// self is only held so the coroutine frame keeps the session alive
+awaitable<void> CoroSession::run(
+    [[maybe_unused]] std::shared_ptr<CoroSession> self) {
+  try {
+    for (;;) {
+      RequestFramer::Status status = framer_.next();
+      if (status == RequestFramer::Status::INCOMPLETE ||
+          responses_.size() == MAX_PIPELINED_REQUESTS || close_after_write_) {
+        // Everything pipelined so far goes out in one gathered write
+        if (!responses_.empty()) {
+          gather_write_buffers();
+          co_await boost::asio::async_write(socket_, write_buffers_,
+                                            use_awaitable);
+          record_latencies();
+          responses_.clear();
+          reset_arena();
+        }
+        if (close_after_write_) {
+          close();
+          co_return;
+        }
+        if (status != RequestFramer::Status::INCOMPLETE) {
+          continue;
+        }
+        arm_read_timer();
+        size_t bytes_transferred = co_await socket_.async_read_some(
+            boost::asio::buffer(framer_.prepare(DEFAULT_READ_SIZE),
+                                DEFAULT_READ_SIZE),
+            use_awaitable);
+        metrics::add(metrics::Counter::BYTES_RECEIVED, bytes_transferred);
+        framer_.commit(bytes_transferred);
+        continue;
+      }
+
+      cancel_read_timer();
+      RequestView req;
+      if (status != RequestFramer::Status::COMPLETE) {
+        framer_.reset();
+        close_after_write_ = true;
+        responses_.push_back(Outgoing(&framing_error_response(status)));
+      } else if (parse_request(framer_.take_view(), req)) {
+        bool keep_alive = keep_alive_after(req);
+        close_after_write_ = !keep_alive;
+        responses_.push_back(
+            co_await async_handle(std::move(req), keep_alive));
+      } else {
+        responses_.push_back(Outgoing(&invalid_request_response(req)));
+      }
+    }
+  } catch (const boost::system::system_error &e) {
+    if (e.code() == boost::asio::error::eof ||
+        e.code() == boost::asio::error::connection_reset) {
+      // client closed connection normally
+      LOG(info) << "Client disconnected: " << e.code().message();
+    } else if (e.code() == boost::asio::error::operation_aborted) {
+      // closed by a timeout
+      LOG(info) << "Connection closed: " << e.code().message();
+    } else {
+      LOG(error) << "Session error: " << e.code().message();
+    }
+  }
+}
+
+awaitable<Session::Outgoing> CoroSession::async_handle(RequestView req,
+                                                       bool keep_alive) {
+  return boost::asio::async_initiate<decltype(use_awaitable),
+                                     void(Outgoing)>(
+      [this, keep_alive](auto handler, RequestView req) {
+        // run_handler copies its callback, so park the move-only coroutine
+        // handler in the arena and pass a pointer to it around instead;
+        // it is resumed, and freed, on its own executor
+        using Handler = decltype(handler);
+        Handler *parked = arena_.create<Handler>(std::move(handler));
+        run_handler(std::move(req), keep_alive,
+                    [this, parked](Outgoing response) {
+                      auto ex = boost::asio::get_associated_executor(*parked);
+                      boost::asio::dispatch(
+                          ex,
+                          [this, parked, r = std::move(response)]() mutable {
+                            Handler resume = std::move(*parked);
+                            arena_.destroy(parked);
+                            resume(std::move(r));
+                          });
+                    });
+      },
+      use_awaitable, std::move(req));
+}
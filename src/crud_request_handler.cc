@@ -16,7 +16,11 @@
 #include "real_entity_storage.h"
 #include "registry.h"
 
-REGISTER_HANDLER("CrudHandler", CrudRequestHandler, CrudRequestHandlerArgs);
+// Building one creates the data directory and its storage, so each thread
+// keeps its own rather than paying for that per request; the storage is not
+// synchronized, so the instance is not shared across threads
+REGISTER_HANDLER_WITH_LIFECYCLE("CrudHandler", CrudRequestHandler,
+                                CrudRequestHandlerArgs, PER_THREAD);
 
 CrudRequestHandlerArgs::CrudRequestHandlerArgs(std::string data_path)
     : data_path_(std::move(data_path)) {}
@@ -156,21 +160,10 @@ std::string CrudRequestHandler::list_ids(const std::string &entity_dir) const {
   return oss.str();
 }
 
-std::string to_lower(const std::string &input) {
-  std::string result = input;
-  std::transform(result.begin(), result.end(), result.begin(),
-                 [](unsigned char c) { return std::tolower(c); });
-  return result;
-}
-
 bool is_json_content_type(const Request &req) {
-  for (const auto &header : req.headers) {
-    // HTTP Headers are case-insensitive
-    if (to_lower(header.name) == to_lower("Content-Type")) {
-      return header.value == "application/json";
-    }
-  }
-  return false;  // Missing header = invalid
+  const Header *content_type = req.find_header(KnownHeader::CONTENT_TYPE);
+  // Missing header = invalid
+  return content_type && content_type->value == "application/json";
 }
 
 std::unique_ptr<Response> CrudRequestHandler::handle_post(const Request &req) {
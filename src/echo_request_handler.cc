@@ -6,7 +6,9 @@
 #include "logging.h"
 #include "registry.h"
 
-REGISTER_HANDLER("EchoHandler", EchoRequestHandler, EchoRequestHandlerArgs);
+// Stateless, so one instance serves every request
+REGISTER_HANDLER_WITH_LIFECYCLE("EchoHandler", EchoRequestHandler,
+                                EchoRequestHandlerArgs, SHARED);
 
 EchoRequestHandlerArgs::EchoRequestHandlerArgs() {}
 
@@ -36,7 +38,7 @@ std::unique_ptr<Response> EchoRequestHandler::handle_request(
     res->body = req.to_string();  // Convert the request to a string
   } else {  // If the request is invalid, return a 400 Bad Request response
     LOG(warning) << "Invalid echo request → returning 400 Bad Request";
-    *res = STOCK_RESPONSE.at(400);  // Return a 400 Bad Request response
+    *res = Response::stock(400);  // Return a 400 Bad Request response
   }
   LOG(trace) << "handle_request completed with status=" << res->status_code;
   return res;  // Return the response
@@ -0,0 +1,72 @@
+#include "handler_pool.h"
+
+#include "logging.h"
+
+HandlerPool::HandlerPool(size_t num_threads, size_t max_queue_size)
+    : max_queue_size_(max_queue_size), state_(std::make_shared<State>()) {
+  LOG(info) << "Creating handler pool with " << num_threads
+            << " threads, queue size " << max_queue_size_;
+  workers_.reserve(num_threads);
+  for (size_t i = 0; i < num_threads; ++i) {
+    workers_.emplace_back(&HandlerPool::worker_loop, state_);
+  }
+}
+
+HandlerPool::~HandlerPool() {
+  {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    state_->stopping = true;
+  }
+  state_->cv.notify_all();
+  for (auto& worker : workers_) {
+    // A task may hold the last reference to the pool (through its session
+    // and dispatcher), in which case we are running on one of our own
+    // workers and must not join ourselves
+    if (worker.get_id() == std::this_thread::get_id()) {
+      worker.detach();
+    } else if (worker.joinable()) {
+      worker.join();
+    }
+  }
+}
+
+bool HandlerPool::submit(Task task) {
+  {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    if (state_->stopping || state_->tasks.size() >= max_queue_size_) {
+      LOG(warning) << "Handler pool rejecting task; queued="
+                   << state_->tasks.size()
+                   << " stopping=" << state_->stopping;
+      return false;
+    }
+    state_->tasks.push_back(std::move(task));
+  }
+  state_->cv.notify_one();
+  return true;
+}
+
+size_t HandlerPool::num_threads() const { return workers_.size(); }
+
+size_t HandlerPool::max_queue_size() const { return max_queue_size_; }
+
+void HandlerPool::worker_loop(std::shared_ptr<State> state) {
+  while (true) {
+    Task task;
+    {
+      std::unique_lock<std::mutex> lock(state->mutex);
+      state->cv.wait(lock,
+                     [&] { return state->stopping || !state->tasks.empty(); });
+      // Drain remaining tasks before exiting so queued sessions get answers
+      if (state->tasks.empty()) {
+        return;
+      }
+      task = std::move(state->tasks.front());
+      state->tasks.pop_front();
+    }
+    try {
+      task();
+    } catch (const std::exception& e) {
+      LOG(error) << "Handler pool task threw: " << e.what();
+    }
+  }
+}
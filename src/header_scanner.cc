@@ -0,0 +1,151 @@
+#include "header_scanner.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define HEADER_SCANNER_X86 1
+#include <immintrin.h>
+#endif
+
+namespace {
+
+// HTTP allows tab in field values but no other control character, so one
+// class of bytes ends a line whether or not it is a well formed CRLF
+inline bool is_line_end(unsigned char c) {
+  return (c < 0x20 && c != '\t') || c == 0x7f;
+}
+
+template <bool Colon>
+const char *find_scalar(const char *p, const char *end) {
+  for (; p < end; ++p) {
+    unsigned char c = static_cast<unsigned char>(*p);
+    if (is_line_end(c) || (Colon && c == ':')) {
+      return p;
+    }
+  }
+  return end;
+}
+
+#ifdef HEADER_SCANNER_X86
+
+// Byte ranges for pcmpestri: control characters around tab, DEL and ':'
+alignas(16) const char kLineEndRanges[16] = {0x00, 0x08, 0x0a, 0x1f,
+                                             0x7f, 0x7f};
+alignas(16) const char kColonRanges[16] = {0x00, 0x08, 0x0a, 0x1f,
+                                           0x7f, 0x7f, ':',  ':'};
+
+template <bool Colon>
+__attribute__((target("sse4.2"))) const char *find_sse42(const char *p,
+                                                         const char *end) {
+  const __m128i ranges = _mm_load_si128(reinterpret_cast<const __m128i *>(
+      Colon ? kColonRanges : kLineEndRanges));
+  const int ranges_len = Colon ? 8 : 6;
+  for (; end - p >= 16; p += 16) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    int i = _mm_cmpestri(ranges, ranges_len, v, 16,
+                         _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES |
+                             _SIDD_LEAST_SIGNIFICANT);
+    if (i != 16) {
+      return p + i;
+    }
+  }
+  return find_scalar<Colon>(p, end);
+}
+
+template <bool Colon>
+__attribute__((target("avx2"))) const char *find_avx2(const char *p,
+                                                      const char *end) {
+  const __m256i max_control = _mm256_set1_epi8(0x1f);
+  const __m256i tab = _mm256_set1_epi8('\t');
+  const __m256i del = _mm256_set1_epi8(0x7f);
+  const __m256i colon = _mm256_set1_epi8(':');
+  for (; end - p >= 32; p += 32) {
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+    // Unsigned v <= 0x1f, without tab
+    __m256i hit = _mm256_cmpeq_epi8(_mm256_min_epu8(v, max_control), v);
+    hit = _mm256_andnot_si256(_mm256_cmpeq_epi8(v, tab), hit);
+    hit = _mm256_or_si256(hit, _mm256_cmpeq_epi8(v, del));
+    if (Colon) {
+      hit = _mm256_or_si256(hit, _mm256_cmpeq_epi8(v, colon));
+    }
+    unsigned int mask = static_cast<unsigned int>(_mm256_movemask_epi8(hit));
+    if (mask != 0) {
+      return p + __builtin_ctz(mask);
+    }
+  }
+  // The same on half a vector narrows the tail down to 15 bytes. Calling
+  // out to find_sse42 instead would run legacy SSE code with the upper
+  // halves of the ymm registers dirty, which is slow.
+  if (end - p >= 16) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    __m128i hit = _mm_cmpeq_epi8(
+        _mm_min_epu8(v, _mm256_castsi256_si128(max_control)), v);
+    hit = _mm_andnot_si128(
+        _mm_cmpeq_epi8(v, _mm256_castsi256_si128(tab)), hit);
+    hit = _mm_or_si128(hit, _mm_cmpeq_epi8(v, _mm256_castsi256_si128(del)));
+    if (Colon) {
+      hit = _mm_or_si128(hit,
+                         _mm_cmpeq_epi8(v, _mm256_castsi256_si128(colon)));
+    }
+    unsigned int mask = static_cast<unsigned int>(_mm_movemask_epi8(hit));
+    if (mask != 0) {
+      return p + __builtin_ctz(mask);
+    }
+    p += 16;
+  }
+  return find_scalar<Colon>(p, end);
+}
+
+#endif  // HEADER_SCANNER_X86
+
+}  // namespace
+
+HeaderScanner::HeaderScanner() : HeaderScanner(best_isa()) {}
+
+HeaderScanner::HeaderScanner(ScannerIsa isa) {
+  ScannerIsa best = best_isa();
+  isa_ = static_cast<int>(isa) < static_cast<int>(best) ? isa : best;
+  switch (isa_) {
+#ifdef HEADER_SCANNER_X86
+    case ScannerIsa::AVX2:
+      find_line_end_ = find_avx2<false>;
+      find_colon_ = find_avx2<true>;
+      break;
+    case ScannerIsa::SSE42:
+      find_line_end_ = find_sse42<false>;
+      find_colon_ = find_sse42<true>;
+      break;
+#endif
+    default:
+      find_line_end_ = find_scalar<false>;
+      find_colon_ = find_scalar<true>;
+      break;
+  }
+}
+
+ScannerIsa HeaderScanner::best_isa() {
+#ifdef HEADER_SCANNER_X86
+  static const ScannerIsa best = [] {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+      return ScannerIsa::AVX2;
+    }
+    if (__builtin_cpu_supports("sse4.2")) {
+      return ScannerIsa::SSE42;
+    }
+    return ScannerIsa::SCALAR;
+  }();
+  return best;
+#else
+  return ScannerIsa::SCALAR;
+#endif
+}
+
+const char *HeaderScanner::isa_name(ScannerIsa isa) {
+  switch (isa) {
+    case ScannerIsa::AVX2:
+      return "avx2";
+    case ScannerIsa::SSE42:
+      return "sse4.2";
+    default:
+      return "scalar";
+  }
+}
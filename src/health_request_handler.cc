@@ -4,8 +4,9 @@
 #include "logging.h"
 #include "registry.h"
 
-REGISTER_HANDLER("HealthHandler", HealthRequestHandler,
-                 HealthRequestHandlerArgs);
+// Stateless, so one instance serves every request
+REGISTER_HANDLER_WITH_LIFECYCLE("HealthHandler", HealthRequestHandler,
+                                HealthRequestHandlerArgs, SHARED);
 
 HealthRequestHandlerArgs::HealthRequestHandlerArgs() {}
 
@@ -24,14 +25,22 @@ HealthRequestHandler::HealthRequestHandler(
 
 std::unique_ptr<Response> HealthRequestHandler::handle_request(
     const Request& req) {
-  auto res = std::make_unique<Response>();
-
-  // Always return 200 OK with "OK" as the response body
-  res->status_code = 200;
-  res->status_message = "OK";
-  res->version = req.valid ? req.version : HTTP_VERSION;
-  res->headers = {{"Content-Type", "text/plain"}};
-  res->body = "OK";
+  return make_response(req.valid ? req.version : HTTP_VERSION);
+}
+
+void HealthRequestHandler::handle_request_view(const RequestView& req,
+                                               ResponseCallback callback) {
+  callback(make_response(req.valid ? std::string(req.version) : HTTP_VERSION));
+}
+
+std::unique_ptr<Response> HealthRequestHandler::make_response(
+    std::string version) {
+  // Always return 200 OK with "OK" as the response body. It never
+  // changes, so it is encoded once and shared by every session.
+  static const EncodedResponse ok(
+      Response(HTTP_VERSION, 200, "OK", {{"Content-Type", "text/plain"}}, "OK"));
+  auto res = std::make_unique<Response>(ok.response());
+  res->version = std::move(version);
 
   LOG(info) << "Health check request handled successfully";
   return res;
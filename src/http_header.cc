@@ -1,6 +1,10 @@
 #include "http_header.h"
 
+#include <algorithm>
+#include <cctype>
+#include <charconv>
 #include <string>
+#include <string_view>
 
 #include "logging.h"
 
@@ -15,6 +19,105 @@ std::string Request::to_string() const {
   return request_str;
 }
 
+bool iequals(std::string_view a, std::string_view b) {
+  return a.size() == b.size() &&
+         std::equal(a.begin(), a.end(), b.begin(), [](char x, char y) {
+           return std::tolower(static_cast<unsigned char>(x)) ==
+                  std::tolower(static_cast<unsigned char>(y));
+         });
+}
+
+KnownHeader known_header(std::string_view name) {
+  // The length alone narrows the candidates to at most two
+  switch (name.size()) {
+    case 4:
+      if (iequals(name, "Host")) return KnownHeader::HOST;
+      break;
+    case 6:
+      if (iequals(name, "Accept")) return KnownHeader::ACCEPT;
+      if (iequals(name, "Cookie")) return KnownHeader::COOKIE;
+      break;
+    case 10:
+      if (iequals(name, "Connection")) return KnownHeader::CONNECTION;
+      if (iequals(name, "User-Agent")) return KnownHeader::USER_AGENT;
+      break;
+    case 12:
+      if (iequals(name, "Content-Type")) return KnownHeader::CONTENT_TYPE;
+      break;
+    case 14:
+      if (iequals(name, "Content-Length")) return KnownHeader::CONTENT_LENGTH;
+      break;
+    case 15:
+      if (iequals(name, "Accept-Encoding")) {
+        return KnownHeader::ACCEPT_ENCODING;
+      }
+      break;
+    case 17:
+      if (iequals(name, "Transfer-Encoding")) {
+        return KnownHeader::TRANSFER_ENCODING;
+      }
+      break;
+  }
+  return KnownHeader::OTHER;
+}
+
+// Shared by Request and RequestView, whose headers differ only in whether
+// they own their strings
+template <typename Headers>
+static bool keep_alive(std::string_view version, const Headers& headers) {
+  bool keep_alive = version != "HTTP/1.0";
+  // Usually there is no Connection header, or only one
+  const auto* first = headers.find(KnownHeader::CONNECTION);
+  if (!first) {
+    return keep_alive;
+  }
+  for (const auto* header = first; header != headers.end(); ++header) {
+    if (!iequals(header->name, "Connection")) {
+      continue;
+    }
+    // Connection is a comma separated list of options
+    std::string_view options = header->value;
+    while (!options.empty()) {
+      size_t comma = options.find(',');
+      std::string_view option = options.substr(0, comma);
+      options = comma == std::string_view::npos ? std::string_view()
+                                                : options.substr(comma + 1);
+      size_t begin = option.find_first_not_of(" \t");
+      if (begin == std::string_view::npos) {
+        continue;
+      }
+      size_t end = option.find_last_not_of(" \t") + 1;
+      option = option.substr(begin, end - begin);
+      if (iequals(option, "close")) {
+        return false;
+      }
+      if (iequals(option, "keep-alive")) {
+        keep_alive = true;
+      }
+    }
+  }
+  return keep_alive;
+}
+
+bool Request::keep_alive() const { return ::keep_alive(version, headers); }
+
+bool RequestView::keep_alive() const { return ::keep_alive(version, headers); }
+
+Request RequestView::to_request() const {
+  Request req;
+  req.method = method;
+  req.uri = uri;
+  req.version = version;
+  req.headers.reserve(headers.size());
+  for (const auto& header : headers) {
+    req.headers.push_back(
+        {std::string(header.name), std::string(header.value)});
+  }
+  req.body = body;
+  req.valid = valid;
+  return req;
+}
+
 Response::Response() {}
 
 Response::Response(std::string version, int status_code,
@@ -26,15 +129,145 @@ Response::Response(std::string version, int status_code,
       headers(std::move(headers)),
       body(std::move(body)) {}
 
-std::string Response::to_string() const {
-  LOG(debug) << "Serializing response to string; length=" << body.size();
-  std::string response_str =
-      "HTTP/1.1 " + std::to_string(status_code) + " " + status_message + CRLF;
+// Reason phrases of the status codes the server sends
+static const std::pair<int, const char*> STATUS_REASONS[] = {
+    {200, "OK"},
+    {201, "Created"},
+    {204, "No Content"},
+    {302, "Found"},
+    {400, "Bad Request"},
+    {404, "Not Found"},
+    {405, "Method Not Allowed"},
+    {413, "Payload Too Large"},
+    {415, "Unsupported Media Type"},
+    {431, "Request Header Fields Too Large"},
+    {500, "Internal Server Error"},
+    {503, "Service Unavailable"},
+};
+
+struct StatusLine {
+  std::string_view reason;
+  std::string line;
+};
+
+// Status lines for STATUS_REASONS, formatted once
+static const std::unordered_map<int, StatusLine>& status_lines() {
+  static const std::unordered_map<int, StatusLine> lines = [] {
+    std::unordered_map<int, StatusLine> lines;
+    for (const auto& [code, reason] : STATUS_REASONS) {
+      lines[code] = {reason, "HTTP/1.1 " + std::to_string(code) + " " +
+                                 reason + CRLF};
+    }
+    return lines;
+  }();
+  return lines;
+}
+
+void Response::serialize_head(std::string& head) const {
+  head.clear();
+  auto it = status_lines().find(status_code);
+  if (it != status_lines().end() && it->second.reason == status_message) {
+    head += it->second.line;
+  } else {
+    head += "HTTP/1.1 ";
+    head += std::to_string(status_code);
+    head += ' ';
+    head += status_message;
+    head += CRLF;
+  }
   for (const auto& header : headers) {
-    response_str += header.name + ": " + header.value + CRLF;
+    head += header.name;
+    head += ": ";
+    head += header.value;
+    head += CRLF;
   }
-  response_str += "Content-Length: " + std::to_string(body.size()) + CRLF;
-  response_str += CRLF;
+  char length[20];
+  char* end = std::to_chars(length, length + sizeof length, body.size()).ptr;
+  head += "Content-Length: ";
+  head.append(length, end);
+  head += CRLF;
+  head += CRLF;
+}
+
+std::string Response::to_string() const {
+  LOG(debug) << "Serializing response to string; length=" << body.size();
+  std::string response_str;
+  serialize_head(response_str);
   response_str += body;
   return response_str;
-}
\ No newline at end of file
+}
+
+const EncodedResponse* Response::encoded() const {
+  if (encoded_ == nullptr) {
+    return nullptr;
+  }
+  const Response& original = encoded_->response();
+  bool same_headers = std::equal(
+      headers.begin(), headers.end(), original.headers.begin(),
+      original.headers.end(), [](const Header& a, const Header& b) {
+        return a.name == b.name && a.value == b.value;
+      });
+  if (status_code != original.status_code ||
+      status_message != original.status_message || !same_headers ||
+      body != original.body) {
+    return nullptr;
+  }
+  return encoded_;
+}
+
+Response Response::stock(int status_code) {
+  return encoded_stock_response(status_code).response();
+}
+
+void set_connection_header(Response& res, std::string_view version,
+                           bool keep_alive) {
+  if (!keep_alive) {
+    res.headers.push_back({"Connection", "close"});
+  } else if (version == "HTTP/1.0") {
+    res.headers.push_back({"Connection", "keep-alive"});
+  }
+}
+
+EncodedResponse::EncodedResponse(Response res) : res_(std::move(res)) {
+  res_.encoded_ = nullptr;
+  auto serialize = [this](std::string_view version, bool keep_alive) {
+    Response variant = res_;
+    set_connection_header(variant, version, keep_alive);
+    return variant.to_string();
+  };
+  keep_alive_11_ = serialize("HTTP/1.1", true);
+  keep_alive_10_ = serialize("HTTP/1.0", true);
+  close_ = serialize("HTTP/1.1", false);
+  res_.encoded_ = this;
+}
+
+const std::string& EncodedResponse::bytes(std::string_view version,
+                                          bool keep_alive) const {
+  if (!keep_alive) {
+    return close_;
+  }
+  return version == "HTTP/1.0" ? keep_alive_10_ : keep_alive_11_;
+}
+
+const EncodedResponse& encoded_stock_response(int status_code) {
+  // Map nodes never move, which the responses' self pointers rely on
+  static const std::unordered_map<int, EncodedResponse> encoded = [] {
+    std::unordered_map<int, EncodedResponse> encoded;
+    for (const auto& [code, res] : STOCK_RESPONSE) {
+      encoded.emplace(std::piecewise_construct, std::forward_as_tuple(code),
+                      std::forward_as_tuple(res));
+    }
+    return encoded;
+  }();
+  return encoded.at(status_code);
+}
+
+const std::string& overloaded_response(std::string_view version,
+                                       bool keep_alive) {
+  static const EncodedResponse overloaded([] {
+    Response res = STOCK_RESPONSE.at(503);
+    res.headers.push_back({"Retry-After", std::to_string(RETRY_AFTER_SECONDS)});
+    return res;
+  }());
+  return overloaded.bytes(version, keep_alive);
+}
@@ -3,15 +3,27 @@
 #include <boost/log/attributes/current_thread_id.hpp>
 #include <boost/log/core.hpp>
 #include <boost/log/expressions.hpp>
+#include <boost/log/sinks/basic_sink_backend.hpp>
 #include <boost/log/sinks/sync_frontend.hpp>
 #include <boost/log/sinks/text_file_backend.hpp>
 #include <boost/log/sinks/text_ostream_backend.hpp>
+#include <boost/log/sinks/unlocked_frontend.hpp>
 #include <boost/log/support/date_time.hpp>
 #include <boost/log/trivial.hpp>
 #include <boost/log/utility/setup/common_attributes.hpp>
 #include <boost/make_shared.hpp>
 #include <boost/shared_ptr.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <cstdlib>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "mpsc_ring.h"
 
 namespace logging {
 namespace expr = boost::log::expressions;
@@ -19,8 +31,179 @@ namespace sinks = boost::log::sinks;
 namespace keywords = boost::log::keywords;
 using severity_level = boost::log::trivial::severity_level;
 
+namespace {
+
+std::atomic<uint64_t> dropped{0};
+
+// Records a writer writes before flushing its outputs
+const size_t kWriteBatch = 256;
+// Longest a writer sleeps without being woken, which bounds how late it
+// notices a record whose wakeup it missed
+const auto kWriterIdle = std::chrono::milliseconds(10);
+
+// Where the writer sends records of at least min_severity
+struct AsyncOutput {
+  severity_level min_severity;
+  std::function<void(const boost::log::record_view&, const std::string&)>
+      consume;
+  std::function<void()> flush;
+};
+
+// A record as formatted by the thread that logged it. Severity and thread
+// id are read lazily from the logging thread, so they cannot wait for the
+// writer.
+struct QueuedRecord {
+  boost::log::record_view rec;
+  std::string line;
+  severity_level severity = severity_level::trace;
+};
+
+// Backend of the asynchronous sink. Logging threads format the record and
+// push it onto the ring; file I/O happens on the writer thread.
+class AsyncRingBackend
+    : public sinks::basic_formatted_sink_backend<
+          char, sinks::combine_requirements<sinks::concurrent_feeding,
+                                            sinks::flushing>::type> {
+ public:
+  AsyncRingBackend(const AsyncLogOptions& options,
+                   std::vector<AsyncOutput> outputs)
+      : ring_(options.queue_size),
+        overflow_(options.overflow),
+        outputs_(std::move(outputs)),
+        writer_(&AsyncRingBackend::run, this) {}
+
+  // Writes out everything still queued
+  ~AsyncRingBackend() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopping_ = true;
+    }
+    wake_.notify_one();
+    writer_.join();
+  }
+
+  void consume(const boost::log::record_view& rec, const std::string& line) {
+    QueuedRecord queued{rec, line, severity_level::trace};
+    if (auto severity =
+            rec.attribute_values()["Severity"].extract<severity_level>()) {
+      queued.severity = *severity;
+    }
+    while (!ring_.try_push(std::move(queued))) {
+      if (overflow_ == LogOverflow::DROP) {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+      }
+      wake_.notify_one();
+      std::this_thread::yield();
+    }
+    // Only a sleeping writer needs the (rarely contended) notify
+    if (sleeping_.load()) {
+      wake_.notify_one();
+    }
+  }
+
+  // Returns once everything queued before the call is written and flushed
+  void flush() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    uint64_t ticket = ++flush_requested_;
+    wake_.notify_one();
+    flushed_.wait(lock, [&] { return flush_completed_ >= ticket; });
+  }
+
+ private:
+  void run() {
+    while (true) {
+      uint64_t requested;
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        requested = flush_requested_;
+      }
+      bool wrote = false;
+      while (write_batch()) {
+        wrote = true;
+      }
+      std::unique_lock<std::mutex> lock(mutex_);
+      if (requested != flush_completed_) {
+        flush_completed_ = requested;
+        flushed_.notify_all();
+      }
+      if (stopping_ && ring_.empty()) {
+        return;
+      }
+      if (wrote) {
+        continue;
+      }
+      sleeping_.store(true);
+      wake_.wait_for(lock, kWriterIdle, [&] {
+        return stopping_ || flush_requested_ != flush_completed_ ||
+               !ring_.empty();
+      });
+      sleeping_.store(false);
+    }
+  }
+
+  // Writes and flushes up to kWriteBatch records; false if none were queued
+  bool write_batch() {
+    QueuedRecord queued;
+    size_t written = 0;
+    while (written < kWriteBatch && ring_.try_pop(queued)) {
+      for (AsyncOutput& output : outputs_) {
+        if (queued.severity >= output.min_severity) {
+          output.consume(queued.rec, queued.line);
+        }
+      }
+      ++written;
+    }
+    if (written == 0) {
+      return false;
+    }
+    for (AsyncOutput& output : outputs_) {
+      output.flush();
+    }
+    return true;
+  }
+
+  MpscRing<QueuedRecord> ring_;
+  LogOverflow overflow_;
+  std::vector<AsyncOutput> outputs_;
+
+  std::atomic<bool> sleeping_{false};
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::condition_variable flushed_;
+  bool stopping_ = false;
+  uint64_t flush_requested_ = 0;
+  uint64_t flush_completed_ = 0;
+  // Last, so it starts once everything above is constructed
+  std::thread writer_;
+};
+
+}  // namespace
+
+AsyncLogOptions async_options_from_env() {
+  AsyncLogOptions options;
+  if (const char* env = std::getenv("CREEPER_LOG_ASYNC")) {
+    std::string mode(env);
+    options.enabled = true;
+    options.overflow =
+        mode == "block" ? LogOverflow::BLOCK : LogOverflow::DROP;
+  }
+  if (const char* env = std::getenv("CREEPER_LOG_QUEUE")) {
+    long size = std::atol(env);
+    if (size > 0) {
+      options.queue_size = static_cast<size_t>(size);
+    }
+  }
+  return options;
+}
+
+uint64_t dropped_records() {
+  return dropped.load(std::memory_order_relaxed);
+}
+
 void init_logging(std::ostream* console_stream,
-                  const std::string& file_pattern) {
+                  const std::string& file_pattern,
+                  const AsyncLogOptions& async) {
   // Remove any existing sinks (useful for tests that re-init)
   auto core = boost::log::core::get();
   core->remove_all_sinks();
@@ -47,34 +230,76 @@ void init_logging(std::ostream* console_stream,
              expr::attr<boost::log::trivial::severity_level>("Severity") %
              expr::smessage;
 
+  // Asynchronous logging feeds the same backends from its writer thread
+  std::vector<AsyncOutput> outputs;
+  // Lowest severity any sink below accepts
+  severity_level sink_min = severity_level::fatal;
+
   // Console sink (Info and above)
   if (console_stream) {
-    typedef sinks::synchronous_sink<sinks::text_ostream_backend> ostream_sink;
-    auto sink = boost::make_shared<ostream_sink>();
-    sink->locked_backend()->add_stream(
+    sink_min = std::min(sink_min, severity_level::info);
+    auto backend = boost::make_shared<sinks::text_ostream_backend>();
+    backend->add_stream(
         boost::shared_ptr<std::ostream>(console_stream, [](void*) {}));
-    sink->set_formatter(fmt);
-    // filter: only info and above to console
-    sink->set_filter(expr::attr<severity_level>("Severity") >=
-                     severity_level::info);
-    core->add_sink(sink);
+    if (async.enabled) {
+      outputs.push_back(
+          {severity_level::info,
+           [backend](const boost::log::record_view& rec,
+                     const std::string& line) { backend->consume(rec, line); },
+           [backend] { backend->flush(); }});
+    } else {
+      typedef sinks::synchronous_sink<sinks::text_ostream_backend>
+          ostream_sink;
+      auto sink = boost::make_shared<ostream_sink>(backend);
+      sink->set_formatter(fmt);
+      // filter: only info and above to console
+      sink->set_filter(expr::attr<severity_level>("Severity") >=
+                       severity_level::info);
+      core->add_sink(sink);
+    }
   }
 
   // File sink (Info+, or Debug/Trace+ if CREEPER_LOG_DEBUG set)
   if (!file_pattern.empty()) {
-    typedef sinks::synchronous_sink<sinks::text_file_backend> file_sink;
-    auto sink = boost::make_shared<file_sink>(
+    sink_min = std::min(sink_min, file_min);
+    // The writer flushes once per batch instead
+    auto backend = boost::make_shared<sinks::text_file_backend>(
         keywords::file_name = file_pattern,
         keywords::rotation_size = 10 * 1024 * 1024,
         keywords::time_based_rotation =
             sinks::file::rotation_at_time_point(0, 0, 0),
-        keywords::auto_flush = true);
+        keywords::auto_flush = !async.enabled);
+    if (async.enabled) {
+      outputs.push_back(
+          {file_min,
+           [backend](const boost::log::record_view& rec,
+                     const std::string& line) { backend->consume(rec, line); },
+           [backend] { backend->flush(); }});
+    } else {
+      typedef sinks::synchronous_sink<sinks::text_file_backend> file_sink;
+      auto sink = boost::make_shared<file_sink>(backend);
+      sink->set_formatter(fmt);
+      // filter: info+ by default, or debug/trace+ if enabled
+      sink->set_filter(expr::attr<severity_level>("Severity") >= file_min);
+      core->add_sink(sink);
+    }
+  }
+
+  if (!outputs.empty()) {
+    // Unlocked: the backend is safe to call from every thread at once
+    typedef sinks::unlocked_sink<AsyncRingBackend> async_sink;
+    auto sink = boost::make_shared<async_sink>(
+        boost::make_shared<AsyncRingBackend>(async, std::move(outputs)));
     sink->set_formatter(fmt);
-    // filter: info+ by default, or debug/trace+ if enabled
-    sink->set_filter(expr::attr<severity_level>("Severity") >= file_min);
+    sink->set_filter(expr::attr<severity_level>("Severity") >= sink_min);
     core->add_sink(sink);
   }
 
+  // LOG skips what no sink would take; without sinks Boost.Log decides
+  bool any_sink = console_stream || !file_pattern.empty();
+  min_sink_severity.store(any_sink ? sink_min : severity_level::trace,
+                          std::memory_order_relaxed);
+
   // Common attributes (TimeStamp, ThreadID, etc.)
   boost::log::add_common_attributes();
 }
@@ -0,0 +1,161 @@
+// creeper_logstat: summarizes binary access logs (see binary_access_log.h).
+//
+// Memory-maps each file and decodes the files on a pool of threads, each
+// keeping its own counts that are merged once all files are read. Prints
+// the status code distribution and, per location, the request count and
+// latency percentiles (parsed to answered).
+//
+// Usage:
+//     creeper_logstat [-j threads] <file>...
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "binary_access_log.h"
+#include "latency_histogram.h"
+
+namespace {
+
+struct Stats {
+  uint64_t records = 0;
+  uint64_t bad_files = 0;
+  std::map<uint16_t, uint64_t> statuses;
+  std::map<std::string, LatencyHistogram, std::less<>> locations;
+
+  void merge(const Stats& other) {
+    records += other.records;
+    bad_files += other.bad_files;
+    for (const auto& [status, count] : other.statuses) {
+      statuses[status] += count;
+    }
+    for (const auto& [location, latencies] : other.locations) {
+      locations[location].merge(latencies);
+    }
+  }
+};
+
+// Adds path's records to stats; false if it could not be read whole
+bool read_file(const std::string& path, Stats& stats) {
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    std::fprintf(stderr, "%s: %s\n", path.c_str(), std::strerror(errno));
+    return false;
+  }
+  struct stat st;
+  if (::fstat(fd, &st) != 0 || st.st_size == 0) {
+    ::close(fd);
+    std::fprintf(stderr, "%s: empty or unreadable\n", path.c_str());
+    return false;
+  }
+  size_t size = static_cast<size_t>(st.st_size);
+  void* data = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (data == MAP_FAILED) {
+    std::fprintf(stderr, "%s: %s\n", path.c_str(), std::strerror(errno));
+    return false;
+  }
+  ::madvise(data, size, MADV_SEQUENTIAL);
+
+  // Looked up by location only when it changes between records
+  std::string_view last_location;
+  LatencyHistogram* latencies = nullptr;
+  bool whole = for_each_access_entry(
+      std::string_view(static_cast<const char*>(data), size),
+      [&](const BinaryAccessEntry& entry) {
+        ++stats.records;
+        ++stats.statuses[entry.status_code];
+        if (latencies == nullptr || entry.location != last_location) {
+          auto it = stats.locations.find(entry.location);
+          if (it == stats.locations.end()) {
+            it = stats.locations
+                     .emplace(std::string(entry.location), LatencyHistogram())
+                     .first;
+          }
+          latencies = &it->second;
+          last_location = entry.location;
+        }
+        latencies->record(entry.total_us);
+      });
+  ::munmap(data, size);
+  if (!whole) {
+    std::fprintf(stderr, "%s: not an access log or cut short\n",
+                 path.c_str());
+  }
+  return whole;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  unsigned int threads = std::max(1u, std::thread::hardware_concurrency());
+  std::vector<std::string> files;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "-j" && i + 1 < argc) {
+      threads = static_cast<unsigned int>(std::max(1, std::atoi(argv[++i])));
+    } else {
+      files.push_back(arg);
+    }
+  }
+  if (files.empty()) {
+    std::fprintf(stderr, "Usage: creeper_logstat [-j threads] <file>...\n");
+    return 1;
+  }
+  threads = std::min<unsigned int>(threads, files.size());
+
+  // Each worker takes the next unread file until none are left
+  std::vector<Stats> partial(threads);
+  std::atomic<size_t> next{0};
+  std::vector<std::thread> workers;
+  for (unsigned int t = 0; t < threads; ++t) {
+    workers.emplace_back([&, t] {
+      for (size_t i = next++; i < files.size(); i = next++) {
+        if (!read_file(files[i], partial[t])) {
+          ++partial[t].bad_files;
+        }
+      }
+    });
+  }
+  for (std::thread& worker : workers) {
+    worker.join();
+  }
+  Stats stats;
+  for (const Stats& part : partial) {
+    stats.merge(part);
+  }
+
+  std::printf("files=%zu records=%llu unreadable=%llu\n\n", files.size(),
+              static_cast<unsigned long long>(stats.records),
+              static_cast<unsigned long long>(stats.bad_files));
+  std::printf("%-8s%14s%10s\n", "status", "count", "share");
+  for (const auto& [status, count] : stats.statuses) {
+    std::printf("%-8u%14llu%9.2f%%\n", status,
+                static_cast<unsigned long long>(count),
+                100.0 * count / stats.records);
+  }
+  std::printf("\n%-24s%14s%10s%10s%10s\n", "location", "count", "p50 us",
+              "p99 us", "p999 us");
+  for (const auto& [location, latencies] : stats.locations) {
+    std::printf("%-24s%14llu%10llu%10llu%10llu\n",
+                location.empty() ? "(none)" : location.c_str(),
+                static_cast<unsigned long long>(latencies.count()),
+                static_cast<unsigned long long>(latencies.percentile(0.50)),
+                static_cast<unsigned long long>(latencies.percentile(0.99)),
+                static_cast<unsigned long long>(latencies.percentile(0.999)));
+  }
+  return stats.bad_files == 0 ? 0 : 2;
+}
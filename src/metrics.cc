@@ -0,0 +1,340 @@
+#include "metrics.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace metrics {
+
+namespace {
+
+constexpr size_t STAGES = static_cast<size_t>(Stage::COUNT);
+constexpr size_t HANDLER_TYPES = METRICS_HANDLER_SLOTS - 1;
+
+struct AtomicHistogram {
+  std::array<std::atomic<uint64_t>, LatencyHistogram::BUCKETS> buckets{};
+  std::atomic<uint64_t> sum{0};
+};
+using AtomicStageLatencies = std::array<AtomicHistogram, STAGES>;
+
+// One thread's counts. Only the owning thread writes them.
+struct alignas(64) ThreadCounters {
+  std::array<std::atomic<uint64_t>, static_cast<size_t>(Counter::COUNT)>
+      counters{};
+  std::array<std::array<std::atomic<uint64_t>,
+                        MAX_STATUS_CODE - MIN_STATUS_CODE + 1>,
+             METRICS_HANDLER_SLOTS>
+      requests{};
+  // Allocated by the owner when it first times a request there and
+  // published with a release store, so a scrape can read them unlocked
+  std::array<std::atomic<AtomicStageLatencies*>, MAX_TIMED_LOCATIONS>
+      locations{};
+  std::array<std::atomic<AtomicStageLatencies*>, HANDLER_TYPES> handlers{};
+
+  ~ThreadCounters() {
+    for (auto& stages : locations) {
+      delete stages.load(std::memory_order_relaxed);
+    }
+    for (auto& stages : handlers) {
+      delete stages.load(std::memory_order_relaxed);
+    }
+  }
+};
+
+// The owner is the only writer, so a load and a store do what fetch_add
+// would without locking the cache line
+inline void bump(std::atomic<uint64_t>& value, uint64_t amount) {
+  value.store(value.load(std::memory_order_relaxed) + amount,
+              std::memory_order_relaxed);
+}
+
+// The owner's histograms for a location or handler type
+AtomicStageLatencies& stages_of(std::atomic<AtomicStageLatencies*>& slot) {
+  AtomicStageLatencies* stages = slot.load(std::memory_order_relaxed);
+  if (!stages) {
+    stages = new AtomicStageLatencies();
+    slot.store(stages, std::memory_order_release);
+  }
+  return *stages;
+}
+
+void add_latencies(const AtomicStageLatencies& from, StageLatencies& to) {
+  for (size_t stage = 0; stage < STAGES; ++stage) {
+    const AtomicHistogram& histogram = from[stage];
+    for (size_t i = 0; i < LatencyHistogram::BUCKETS; ++i) {
+      uint64_t count = histogram.buckets[i].load(std::memory_order_relaxed);
+      if (count != 0) {
+        to[stage].add(i, count, 0);
+      }
+    }
+    to[stage].add(0, 0, histogram.sum.load(std::memory_order_relaxed));
+  }
+}
+
+void add_latencies(const StageLatencies& from, StageLatencies& to) {
+  for (size_t stage = 0; stage < STAGES; ++stage) {
+    to[stage].merge(from[stage]);
+  }
+}
+
+// Every location name timed so far; an index, once given, is never reused
+class LocationNames {
+ public:
+  int index(std::string_view location) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (size_t i = 0; i < names_.size(); ++i) {
+      if (names_[i] == location) {
+        return static_cast<int>(i);
+      }
+    }
+    if (names_.size() == MAX_TIMED_LOCATIONS) {
+      return -1;
+    }
+    names_.emplace_back(location);
+    return static_cast<int>(names_.size() - 1);
+  }
+  std::vector<std::string> names() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return names_;
+  }
+
+ private:
+  std::mutex mutex_;
+  std::vector<std::string> names_;
+};
+
+LocationNames& location_names() {
+  static LocationNames* names = new LocationNames();
+  return *names;
+}
+
+// Sizes snapshot's latencies to hold every location named so far
+void shape(Snapshot& snapshot, const std::vector<std::string>& names) {
+  snapshot.handlers.resize(HANDLER_TYPES);
+  for (size_t i = snapshot.locations.size(); i < names.size(); ++i) {
+    snapshot.locations.push_back({names[i], StageLatencies()});
+  }
+}
+
+class CounterRegistry {
+ public:
+  void attach(ThreadCounters* counters) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    live_.push_back(counters);
+  }
+
+  // Keeps what an exiting thread counted
+  void detach(ThreadCounters* counters) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    shape(retired_, location_names().names());
+    add_to(*counters, retired_);
+    for (size_t i = 0; i < live_.size(); ++i) {
+      if (live_[i] == counters) {
+        live_[i] = live_.back();
+        live_.pop_back();
+        break;
+      }
+    }
+  }
+
+  Snapshot collect() {
+    Snapshot snapshot;
+    std::lock_guard<std::mutex> lock(mutex_);
+    // Under the lock, so snapshot has room for whatever retired_ holds
+    shape(snapshot, location_names().names());
+    add_to(retired_, snapshot);
+    for (ThreadCounters* counters : live_) {
+      add_to(*counters, snapshot);
+    }
+    return snapshot;
+  }
+
+ private:
+  static void add_to(const ThreadCounters& from, Snapshot& to) {
+    for (size_t i = 0; i < from.counters.size(); ++i) {
+      to.counters[i] += from.counters[i].load(std::memory_order_relaxed);
+    }
+    for (size_t h = 0; h < from.requests.size(); ++h) {
+      for (size_t s = 0; s < from.requests[h].size(); ++s) {
+        to.requests[h][s] +=
+            from.requests[h][s].load(std::memory_order_relaxed);
+      }
+    }
+    // Locations named after to was shaped have nothing to add yet
+    for (size_t i = 0; i < to.locations.size(); ++i) {
+      if (auto* stages = from.locations[i].load(std::memory_order_acquire)) {
+        add_latencies(*stages, to.locations[i].stages);
+      }
+    }
+    for (size_t i = 0; i < HANDLER_TYPES; ++i) {
+      if (auto* stages = from.handlers[i].load(std::memory_order_acquire)) {
+        add_latencies(*stages, to.handlers[i]);
+      }
+    }
+  }
+  static void add_to(const Snapshot& from, Snapshot& to) {
+    for (size_t i = 0; i < from.counters.size(); ++i) {
+      to.counters[i] += from.counters[i];
+    }
+    for (size_t h = 0; h < from.requests.size(); ++h) {
+      for (size_t s = 0; s < from.requests[h].size(); ++s) {
+        to.requests[h][s] += from.requests[h][s];
+      }
+    }
+    for (size_t i = 0; i < from.locations.size(); ++i) {
+      add_latencies(from.locations[i].stages, to.locations[i].stages);
+    }
+    for (size_t i = 0; i < from.handlers.size(); ++i) {
+      add_latencies(from.handlers[i], to.handlers[i]);
+    }
+  }
+
+  std::mutex mutex_;
+  std::vector<ThreadCounters*> live_;
+  Snapshot retired_;
+};
+
+CounterRegistry& registry() {
+  // Never destroyed, so threads exiting during shutdown can still detach
+  static CounterRegistry* registry = new CounterRegistry();
+  return *registry;
+}
+
+// Registers the calling thread's counters on first use
+class ThreadCountersHolder {
+ public:
+  ThreadCountersHolder() : counters_(std::make_unique<ThreadCounters>()) {
+    registry().attach(counters_.get());
+  }
+  ~ThreadCountersHolder() { registry().detach(counters_.get()); }
+  ThreadCounters& get() { return *counters_; }
+
+ private:
+  std::unique_ptr<ThreadCounters> counters_;
+};
+
+ThreadCounters& this_thread_counters() {
+  thread_local ThreadCountersHolder holder;
+  return holder.get();
+}
+
+}  // namespace
+
+void add(Counter counter, uint64_t amount) {
+  bump(this_thread_counters().counters[static_cast<size_t>(counter)], amount);
+}
+
+void count_request(std::optional<RequestHandler::HandlerType> handler,
+                   int status_code) {
+  if (status_code < MIN_STATUS_CODE || status_code > MAX_STATUS_CODE) {
+    return;
+  }
+  size_t slot = handler ? static_cast<size_t>(*handler)
+                        : METRICS_HANDLER_SLOTS - 1;
+  bump(this_thread_counters().requests[slot][status_code - MIN_STATUS_CODE],
+       1);
+}
+
+Snapshot collect() { return registry().collect(); }
+
+const char* stage_to_string(Stage stage) {
+  switch (stage) {
+    case Stage::PARSE:
+      return "parse";
+    case Stage::DISPATCH:
+      return "dispatch";
+    case Stage::HANDLER:
+      return "handler";
+    case Stage::WRITE:
+      return "write";
+    case Stage::TOTAL:
+      return "total";
+    default:
+      return "unknown";
+  }
+}
+
+void RequestTimer::record(Clock::time_point written) const {
+  ThreadCounters& counters = this_thread_counters();
+  AtomicStageLatencies* by_location =
+      location >= 0 ? &stages_of(counters.locations[location]) : nullptr;
+  AtomicStageLatencies* by_handler =
+      handler >= 0 && handler < static_cast<int>(HANDLER_TYPES)
+          ? &stages_of(counters.handlers[handler])
+          : nullptr;
+  if (!by_location && !by_handler) {
+    return;
+  }
+  auto time = [&](Stage stage, Clock::time_point from, Clock::time_point to) {
+    uint32_t micros = static_cast<uint32_t>(std::clamp<int64_t>(
+        std::chrono::duration_cast<std::chrono::microseconds>(to - from)
+            .count(),
+        0, std::numeric_limits<uint32_t>::max()));
+    size_t bucket = LatencyHistogram::bucket_of(micros);
+    for (AtomicStageLatencies* stages : {by_location, by_handler}) {
+      if (stages) {
+        AtomicHistogram& histogram = (*stages)[static_cast<size_t>(stage)];
+        bump(histogram.buckets[bucket], 1);
+        bump(histogram.sum, micros);
+      }
+    }
+  };
+  time(Stage::PARSE, parse_started, parsed);
+  if (dispatched != Clock::time_point()) {
+    time(Stage::DISPATCH, parsed, dispatched);
+    time(Stage::HANDLER, dispatched, answered);
+  }
+  time(Stage::WRITE, answered, written);
+  time(Stage::TOTAL, parse_started, written);
+}
+
+int location_index(std::string_view location) {
+  // Locations are few, so each thread remembers the ones it has looked up
+  // and only takes the lock for a name new to it
+  thread_local std::vector<std::pair<std::string, int>> known;
+  for (const auto& [name, index] : known) {
+    if (name == location) {
+      return index;
+    }
+  }
+  int index = location_names().index(location);
+  known.emplace_back(location, index);
+  return index;
+}
+
+void write_latency_report(std::ostream& out, const Snapshot& snapshot) {
+  out << std::left << std::setw(32) << "location / handler" << std::setw(10)
+      << "stage" << std::right << std::setw(12) << "count" << std::setw(10)
+      << "mean us" << std::setw(10) << "p50 us" << std::setw(10) << "p90 us"
+      << std::setw(10) << "p99 us" << std::setw(10) << "p999 us" << "\n";
+  auto write = [&](const std::string& name, const StageLatencies& stages) {
+    for (size_t stage = 0; stage < STAGES; ++stage) {
+      const LatencyHistogram& histogram = stages[stage];
+      if (histogram.count() == 0) {
+        continue;
+      }
+      out << std::left << std::setw(32) << name << std::setw(10)
+          << stage_to_string(static_cast<Stage>(stage)) << std::right
+          << std::setw(12) << histogram.count() << std::setw(10)
+          << histogram.sum() / histogram.count() << std::setw(10)
+          << histogram.percentile(0.50) << std::setw(10)
+          << histogram.percentile(0.90) << std::setw(10)
+          << histogram.percentile(0.99) << std::setw(10)
+          << histogram.percentile(0.999) << "\n";
+    }
+  };
+  for (const LocationLatencies& location : snapshot.locations) {
+    write(location.location, location.stages);
+  }
+  for (size_t i = 0; i < snapshot.handlers.size(); ++i) {
+    write(RequestHandler::handler_type_to_string(
+              static_cast<RequestHandler::HandlerType>(i)),
+          snapshot.handlers[i]);
+  }
+}
+
+}  // namespace metrics
@@ -0,0 +1,157 @@
+#include "metrics_request_handler.h"
+
+#include <sstream>
+#include <string_view>
+#include <utility>
+
+#include "config_parser.h"
+#include "logging.h"
+#include "registry.h"
+
+// Stateless, so one instance serves every request
+REGISTER_HANDLER_WITH_LIFECYCLE("MetricsHandler", MetricsRequestHandler,
+                                MetricsRequestHandlerArgs, SHARED);
+
+namespace {
+
+void describe(std::ostringstream& out, const char* name, const char* type,
+              const char* help) {
+  out << "# HELP " << name << " " << help << "\n"
+      << "# TYPE " << name << " " << type << "\n";
+}
+
+// Label values come from the config, which may quote anything
+std::string escape(std::string_view value) {
+  std::string escaped;
+  for (char c : value) {
+    if (c == '\\' || c == '"') {
+      escaped += '\\';
+    }
+    escaped += c;
+  }
+  return escaped;
+}
+
+// A summary per stage: p50, p90, p99 and p999, sum and count
+void write_latencies(std::ostringstream& out, const char* name,
+                     const std::string& labels,
+                     const metrics::StageLatencies& stages) {
+  static const std::pair<const char*, double> QUANTILES[] = {
+      {"0.5", 0.5}, {"0.9", 0.9}, {"0.99", 0.99}, {"0.999", 0.999}};
+  for (size_t stage = 0; stage < stages.size(); ++stage) {
+    const LatencyHistogram& histogram = stages[stage];
+    if (histogram.count() == 0) {
+      continue;
+    }
+    std::string stage_labels =
+        labels + ",stage=\"" +
+        metrics::stage_to_string(static_cast<metrics::Stage>(stage)) + "\"";
+    for (const auto& [label, quantile] : QUANTILES) {
+      out << name << "{" << stage_labels << ",quantile=\"" << label << "\"} "
+          << histogram.percentile(quantile) << "\n";
+    }
+    out << name << "_sum{" << stage_labels << "} " << histogram.sum() << "\n"
+        << name << "_count{" << stage_labels << "} " << histogram.count()
+        << "\n";
+  }
+}
+
+}  // namespace
+
+MetricsRequestHandlerArgs::MetricsRequestHandlerArgs() {}
+
+std::shared_ptr<MetricsRequestHandlerArgs>
+MetricsRequestHandlerArgs::create_from_config(
+    std::shared_ptr<NginxConfigStatement> statement) {
+  if (statement->child_block_->statements_.size() != 0) {
+    LOG(error) << "MetricsHandler must have no arguments";
+    return nullptr;
+  }
+  return std::make_shared<MetricsRequestHandlerArgs>();
+}
+
+// Metrics are process-wide, so neither the location nor its args matter
+MetricsRequestHandler::MetricsRequestHandler(
+    std::string /*base_uri*/,
+    std::shared_ptr<MetricsRequestHandlerArgs> /*args*/) {}
+
+std::unique_ptr<Response> MetricsRequestHandler::handle_request(
+    const Request& req) {
+  auto res = std::make_unique<Response>();
+  res->version = req.valid ? req.version : HTTP_VERSION;
+  res->status_code = 200;
+  res->status_message = "OK";
+  res->headers.push_back({"Content-Type", "text/plain; version=0.0.4"});
+  res->body = format(metrics::collect());
+  return res;
+}
+
+RequestHandler::HandlerType MetricsRequestHandler::get_type() const {
+  return RequestHandler::HandlerType::METRICS_REQUEST_HANDLER;
+}
+
+std::string MetricsRequestHandler::format(const metrics::Snapshot& snapshot) {
+  using metrics::Counter;
+  std::ostringstream out;
+
+  describe(out, "creeper_requests_total", "counter",
+           "Requests answered, by handler and status code.");
+  for (int slot = 0; slot < METRICS_HANDLER_SLOTS; ++slot) {
+    // The last slot holds requests no handler answered
+    const char* handler =
+        slot == METRICS_HANDLER_SLOTS - 1
+            ? "none"
+            : handler_type_to_string(static_cast<HandlerType>(slot));
+    for (int code = MIN_STATUS_CODE; code <= MAX_STATUS_CODE; ++code) {
+      uint64_t count = snapshot.requests[slot][code - MIN_STATUS_CODE];
+      if (count != 0) {
+        out << "creeper_requests_total{handler=\"" << handler << "\",code=\""
+            << code << "\"} " << count << "\n";
+      }
+    }
+  }
+
+  describe(out, "creeper_received_bytes_total", "counter",
+           "Bytes read from clients.");
+  out << "creeper_received_bytes_total " << snapshot[Counter::BYTES_RECEIVED]
+      << "\n";
+  describe(out, "creeper_sent_bytes_total", "counter",
+           "Bytes written to clients.");
+  out << "creeper_sent_bytes_total " << snapshot[Counter::BYTES_SENT] << "\n";
+  describe(out, "creeper_open_sessions", "gauge", "Connections being served.");
+  out << "creeper_open_sessions "
+      << snapshot[Counter::SESSIONS_OPENED] - snapshot[Counter::SESSIONS_CLOSED]
+      << "\n";
+  describe(out, "creeper_parse_failures_total", "counter",
+           "Requests that could not be framed or parsed.");
+  out << "creeper_parse_failures_total " << snapshot[Counter::PARSE_FAILURES]
+      << "\n";
+  describe(out, "creeper_backend_calls_total", "counter",
+           "Calls to the short URL backends.");
+  out << "creeper_backend_calls_total{backend=\"redis\"} "
+      << snapshot[Counter::REDIS_CALLS] << "\n"
+      << "creeper_backend_calls_total{backend=\"database\"} "
+      << snapshot[Counter::DATABASE_CALLS] << "\n";
+  describe(out, "creeper_location_latency_microseconds", "summary",
+           "Request latency by location and stage.");
+  for (const metrics::LocationLatencies& location : snapshot.locations) {
+    write_latencies(out, "creeper_location_latency_microseconds",
+                    "location=\"" + escape(location.location) + "\"",
+                    location.stages);
+  }
+  describe(out, "creeper_handler_latency_microseconds", "summary",
+           "Request latency by handler and stage.");
+  for (size_t i = 0; i < snapshot.handlers.size(); ++i) {
+    write_latencies(out, "creeper_handler_latency_microseconds",
+                    std::string("handler=\"") +
+                        handler_type_to_string(static_cast<HandlerType>(i)) +
+                        "\"",
+                    snapshot.handlers[i]);
+  }
+
+  describe(out, "creeper_log_records_dropped_total", "counter",
+           "Log records asynchronous logging dropped on a full queue.");
+  out << "creeper_log_records_dropped_total " << logging::dropped_records()
+      << "\n";
+  return out.str();
+}
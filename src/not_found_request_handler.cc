@@ -3,8 +3,9 @@
 #include "logging.h"
 #include "registry.h"
 
-REGISTER_HANDLER("NotFoundHandler", NotFoundRequestHandler,
-                 NotFoundRequestHandlerArgs);
+// Stateless, so one instance serves every request
+REGISTER_HANDLER_WITH_LIFECYCLE("NotFoundHandler", NotFoundRequestHandler,
+                                NotFoundRequestHandlerArgs, SHARED);
 
 NotFoundRequestHandlerArgs::NotFoundRequestHandlerArgs() {}
 
@@ -23,16 +24,11 @@ NotFoundRequestHandler::NotFoundRequestHandler(
 
 std::unique_ptr<Response> NotFoundRequestHandler::handle_request(
     const Request& req) {
-  auto res = std::make_unique<Response>();
-
   LOG(info) << "Handling 404 Not Found request for URI: " << req.uri;
 
-  // Set response properties
+  // The stock 404, which the session writes from its pre-encoded bytes
+  auto res = std::make_unique<Response>(Response::stock(404));
   res->version = req.valid ? req.version : HTTP_VERSION;
-  res->status_code = 404;
-  res->status_message = "Not Found";
-  res->headers = {{"Content-Type", "text/plain"}};
-  res->body = "404 Not Found";
 
   return res;
 }
@@ -4,9 +4,11 @@
 
 bool Registry::register_handler(const std::string& name,
                                 RequestHandlerFactory factory,
-                                CreateFromConfigFactory create_from_config) {
+                                CreateFromConfigFactory create_from_config,
+                                HandlerLifecycle lifecycle) {
   get_factory_map()[name] = std::move(factory);
   get_create_from_config_map()[name] = std::move(create_from_config);
+  get_lifecycle_map()[name] = lifecycle;
   LOG(debug) << "Registry::register_handler: name=" << name;
   return true;
 }
@@ -31,6 +33,14 @@ std::shared_ptr<CreateFromConfigFactory> Registry::get_create_from_config(
   return std::make_shared<CreateFromConfigFactory>(it->second);
 }
 
+HandlerLifecycle Registry::get_lifecycle(const std::string& name) {
+  auto it = get_lifecycle_map().find(name);
+  if (it == get_lifecycle_map().end()) {
+    return HandlerLifecycle::PER_REQUEST;
+  }
+  return it->second;
+}
+
 // Using Meyers' singleton pattern to ensure that the map is created only once
 // This prevents multiple instances of the map from being created in gtest
 std::unordered_map<std::string, RequestHandlerFactory>&
@@ -46,4 +56,10 @@ Registry::get_create_from_config_map() {
   static std::unordered_map<std::string, CreateFromConfigFactory>
       create_from_config_map_;
   return create_from_config_map_;
-}
\ No newline at end of file
+}
+
+std::unordered_map<std::string, HandlerLifecycle>&
+Registry::get_lifecycle_map() {
+  static std::unordered_map<std::string, HandlerLifecycle> lifecycle_map_;
+  return lifecycle_map_;
+}
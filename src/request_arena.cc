@@ -0,0 +1,98 @@
+#include "request_arena.h"
+
+namespace {
+
+struct SharedCounters {
+  std::atomic<uint64_t> allocations{0};
+  std::atomic<uint64_t> bytes{0};
+  std::atomic<uint64_t> heap_allocations{0};
+  std::atomic<uint64_t> resets{0};
+  std::atomic<uint64_t> deferred_resets{0};
+};
+
+SharedCounters& shared_counters() {
+  static SharedCounters counters;
+  return counters;
+}
+
+}  // namespace
+
+void* RequestArena::HeapResource::do_allocate(size_t bytes,
+                                              size_t alignment) {
+  ++counters_.heap_allocations;
+  return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+}
+
+void RequestArena::HeapResource::do_deallocate(void* p, size_t bytes,
+                                               size_t alignment) {
+  std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+}
+
+bool RequestArena::HeapResource::do_is_equal(
+    const std::pmr::memory_resource& other) const noexcept {
+  return this == &other;
+}
+
+RequestArena::RequestArena(size_t size)
+    : buffer_(new std::byte[size]),
+      heap_(unflushed_),
+      pool_(buffer_.get(), size, &heap_) {}
+
+RequestArena::~RequestArena() { flush_counters(); }
+
+bool RequestArena::reset() {
+  if (live() != 0) {
+    ++unflushed_.deferred_resets;
+    flush_counters();
+    return false;
+  }
+  pool_.release();
+  ++unflushed_.resets;
+  flush_counters();
+  return true;
+}
+
+void* RequestArena::do_allocate(size_t bytes, size_t alignment) {
+  void* p = pool_.allocate(bytes, alignment);
+  live_.fetch_add(1, std::memory_order_relaxed);
+  ++unflushed_.allocations;
+  unflushed_.bytes += bytes;
+  return p;
+}
+
+void RequestArena::do_deallocate(void*, size_t, size_t) {
+  // The memory comes back on reset(); this only has to publish that the
+  // object is gone, possibly from another thread
+  live_.fetch_sub(1, std::memory_order_release);
+}
+
+bool RequestArena::do_is_equal(
+    const std::pmr::memory_resource& other) const noexcept {
+  return this == &other;
+}
+
+void RequestArena::flush_counters() {
+  SharedCounters& shared = shared_counters();
+  shared.allocations.fetch_add(unflushed_.allocations,
+                               std::memory_order_relaxed);
+  shared.bytes.fetch_add(unflushed_.bytes, std::memory_order_relaxed);
+  shared.heap_allocations.fetch_add(unflushed_.heap_allocations,
+                                    std::memory_order_relaxed);
+  shared.resets.fetch_add(unflushed_.resets, std::memory_order_relaxed);
+  shared.deferred_resets.fetch_add(unflushed_.deferred_resets,
+                                   std::memory_order_relaxed);
+  unflushed_ = ArenaCounters();
+}
+
+ArenaCounters RequestArena::counters() {
+  SharedCounters& shared = shared_counters();
+  ArenaCounters counters;
+  counters.allocations = shared.allocations.load(std::memory_order_relaxed);
+  counters.bytes = shared.bytes.load(std::memory_order_relaxed);
+  counters.heap_allocations =
+      shared.heap_allocations.load(std::memory_order_relaxed);
+  counters.resets = shared.resets.load(std::memory_order_relaxed);
+  counters.deferred_resets =
+      shared.deferred_resets.load(std::memory_order_relaxed);
+  return counters;
+}
@@ -0,0 +1,243 @@
+#include "request_framer.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+#include "http_header.h"  // for iequals
+#include "logging.h"
+
+// Buffers that grew past this for one large request are released once
+// that request has been taken, so idle connections stay small
+#define MAX_RETAINED_BUFFER_SIZE (16 * DEFAULT_READ_SIZE)
+// Longest chunk-size or trailer line we wait for
+#define MAX_CHUNK_LINE_SIZE 1024
+
+static const std::string_view CRLF_CRLF = "\r\n\r\n";
+
+static std::string_view trim(std::string_view s) {
+  while (!s.empty() && (s.front() == ' ' || s.front() == '\t')) {
+    s.remove_prefix(1);
+  }
+  while (!s.empty() && (s.back() == ' ' || s.back() == '\t')) {
+    s.remove_suffix(1);
+  }
+  return s;
+}
+
+// Parse an unsigned number in the given base; false on anything else or
+// if the value does not fit in a size_t
+static bool parse_size(std::string_view s, int base, size_t* out) {
+  if (s.empty()) return false;
+  size_t value = 0;
+  for (char c : s) {
+    int digit;
+    if (c >= '0' && c <= '9') {
+      digit = c - '0';
+    } else if (base == 16 && std::isxdigit(static_cast<unsigned char>(c))) {
+      digit = std::tolower(static_cast<unsigned char>(c)) - 'a' + 10;
+    } else {
+      return false;
+    }
+    if (value > (SIZE_MAX - digit) / base) return false;
+    value = value * base + digit;
+  }
+  *out = value;
+  return true;
+}
+
+RequestFramer::RequestFramer(size_t max_header_size, size_t max_body_size)
+    : max_header_size_(max_header_size),
+      max_body_size_(max_body_size),
+      buf_(DEFAULT_READ_SIZE) {}
+
+char* RequestFramer::prepare(size_t n) {
+  if (begin_ == end_) {
+    begin_ = end_ = 0;
+    if (buf_.size() > MAX_RETAINED_BUFFER_SIZE) {
+      std::vector<char>(DEFAULT_READ_SIZE).swap(buf_);
+    }
+  }
+  if (buf_.size() - end_ < n && begin_ > 0) {
+    // Slide the partial request to the front before growing
+    std::memmove(buf_.data(), buf_.data() + begin_, end_ - begin_);
+    end_ -= begin_;
+    begin_ = 0;
+  }
+  if (buf_.size() - end_ < n) {
+    buf_.resize(std::max(buf_.size() * 2, end_ + n));
+  }
+  return buf_.data() + end_;
+}
+
+void RequestFramer::commit(size_t n) { end_ += n; }
+
+size_t RequestFramer::buffered() const { return end_ - begin_; }
+
+bool RequestFramer::headers_complete() const { return header_size_ > 0; }
+
+void RequestFramer::reset() {
+  begin_ = end_ = 0;
+  clear_frame();
+}
+
+void RequestFramer::clear_frame() {
+  scan_pos_ = 0;
+  header_size_ = 0;
+  body_size_ = 0;
+  chunked_ = false;
+  chunk_pos_ = 0;
+  in_trailers_ = false;
+  trailers_pos_ = 0;
+  frame_size_ = 0;
+}
+
+RequestFramer::Status RequestFramer::next() {
+  if (frame_size_ > 0) {
+    return Status::COMPLETE;
+  }
+  if (header_size_ == 0) {
+    Status status = find_headers();
+    if (status != Status::COMPLETE) {
+      return status;
+    }
+  }
+  if (chunked_) {
+    return scan_chunks();
+  }
+  if (buffered() < header_size_ + body_size_) {
+    return Status::INCOMPLETE;
+  }
+  frame_size_ = header_size_ + body_size_;
+  return Status::COMPLETE;
+}
+
+std::string RequestFramer::take() { return std::string(take_view()); }
+
+std::string_view RequestFramer::take_view() {
+  std::string_view frame(buf_.data() + begin_, frame_size_);
+  begin_ += frame_size_;
+  clear_frame();
+  return frame;
+}
+
+RequestFramer::Status RequestFramer::find_headers() {
+  std::string_view data(buf_.data() + begin_, buffered());
+  size_t pos = data.find(CRLF_CRLF, scan_pos_);
+  if (pos == std::string_view::npos) {
+    if (data.size() > max_header_size_) {
+      LOG(warning) << "Request headers exceed " << max_header_size_
+                   << " bytes";
+      return Status::HEADERS_TOO_LARGE;
+    }
+    // The terminator may straddle this read and the next one
+    scan_pos_ = data.size() < 3 ? 0 : data.size() - 3;
+    return Status::INCOMPLETE;
+  }
+  if (pos + CRLF_CRLF.size() > max_header_size_) {
+    LOG(warning) << "Request headers exceed " << max_header_size_ << " bytes";
+    return Status::HEADERS_TOO_LARGE;
+  }
+
+  // Only the headers that decide where the body ends are looked at here;
+  // everything else is left to RequestParser
+  std::string_view headers = data.substr(0, pos + 2);
+  bool has_length = false;
+  size_t line_start = headers.find("\r\n") + 2;  // skip the request line
+  while (line_start < headers.size()) {
+    size_t line_end = headers.find("\r\n", line_start);
+    std::string_view line = headers.substr(line_start, line_end - line_start);
+    line_start = line_end + 2;
+
+    size_t colon = line.find(':');
+    if (colon == std::string_view::npos) continue;
+    std::string_view name = line.substr(0, colon);
+    std::string_view value = trim(line.substr(colon + 1));
+    if (iequals(name, "Content-Length")) {
+      size_t length;
+      if (!parse_size(value, 10, &length) ||
+          (has_length && length != body_size_)) {
+        LOG(warning) << "Invalid Content-Length: " << value;
+        return Status::INVALID;
+      }
+      has_length = true;
+      body_size_ = length;
+    } else if (iequals(name, "Transfer-Encoding")) {
+      std::string lower(value);
+      std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+      chunked_ = lower.find("chunked") != std::string::npos;
+    }
+  }
+
+  if (chunked_ && has_length) {
+    // Ambiguous framing is how requests get smuggled past proxies
+    LOG(warning) << "Request has both Content-Length and chunked encoding";
+    return Status::INVALID;
+  }
+  if (body_size_ > max_body_size_) {
+    LOG(warning) << "Request body of " << body_size_ << " bytes exceeds "
+                 << max_body_size_;
+    return Status::BODY_TOO_LARGE;
+  }
+  header_size_ = pos + CRLF_CRLF.size();
+  chunk_pos_ = header_size_;
+  return Status::COMPLETE;
+}
+
+RequestFramer::Status RequestFramer::scan_chunks() {
+  std::string_view data(buf_.data() + begin_, buffered());
+  for (;;) {
+    size_t line_end = data.find("\r\n", chunk_pos_);
+    if (line_end == std::string_view::npos) {
+      return data.size() - chunk_pos_ > MAX_CHUNK_LINE_SIZE
+                 ? Status::INVALID
+                 : Status::INCOMPLETE;
+    }
+    std::string_view line = data.substr(chunk_pos_, line_end - chunk_pos_);
+
+    if (in_trailers_) {
+      // Trailers are headers too, and are held to the same limit
+      if (line_end + 2 - trailers_pos_ > max_header_size_) {
+        LOG(warning) << "Request trailers exceed " << max_header_size_
+                     << " bytes";
+        return Status::HEADERS_TOO_LARGE;
+      }
+      if (line.empty()) {
+        frame_size_ = line_end + 2;
+        return Status::COMPLETE;
+      }
+      chunk_pos_ = line_end + 2;
+      continue;
+    }
+
+    // chunk-size [; chunk-ext]
+    size_t chunk_size;
+    if (!parse_size(trim(line.substr(0, line.find(';'))), 16, &chunk_size)) {
+      LOG(warning) << "Invalid chunk size line: " << line;
+      return Status::INVALID;
+    }
+    if (chunk_size == 0) {
+      in_trailers_ = true;
+      chunk_pos_ = line_end + 2;
+      trailers_pos_ = chunk_pos_;
+      continue;
+    }
+    if (chunk_size > max_body_size_ - body_size_) {
+      LOG(warning) << "Chunked request body exceeds " << max_body_size_;
+      return Status::BODY_TOO_LARGE;
+    }
+    size_t data_end = line_end + 2 + chunk_size;
+    if (data.size() < data_end + 2) {
+      return Status::INCOMPLETE;
+    }
+    if (data.substr(data_end, 2) != "\r\n") {
+      LOG(warning) << "Chunk data not followed by CRLF";
+      return Status::INVALID;
+    }
+    body_size_ += chunk_size;
+    chunk_pos_ = data_end + 2;
+  }
+}
@@ -1,6 +1,11 @@
 #include "request_handler_dispatcher.h"
 
+#include <algorithm>
+#include <map>
 #include <string>
+#include <thread>
+#include <utility>
+#include <vector>
 
 #include "config_parser.h"
 #include "echo_request_handler.h"
@@ -9,16 +14,129 @@
 #include "request_handler.h"
 #include "static_request_handler.h"
 
-RequestHandlerDispatcher::RequestHandlerDispatcher(const NginxConfig& config) {
-  if (!add_routes(config)) {
+namespace {
+
+// A PER_THREAD location's handler built by this thread. The route is held
+// weakly so the handler can be dropped once the route is gone.
+struct ThreadHandler {
+  std::weak_ptr<const Route> route;
+  std::unique_ptr<RequestHandler> handler;
+  BuiltinHandler builtin;
+};
+
+// By route address and generation: a route reusing a freed one's address
+// comes from a later snapshot, so it never finds its predecessor's handler
+thread_local std::map<std::pair<const Route*, uint64_t>, ThreadHandler>
+    thread_handlers;
+// Newest generation this thread has looked up a handler for, and whether
+// handlers of older routes still in use were kept at the last prune
+thread_local uint64_t thread_handlers_generation = 0;
+thread_local bool thread_handlers_outdated = false;
+
+// This thread's reader slot in each dispatcher it has routed with, by
+// dispatcher id. Slots belong to their dispatcher; entries of destroyed
+// dispatchers are never matched again.
+thread_local std::vector<std::pair<uint64_t, void*>> reader_slots;
+
+std::atomic<uint64_t> next_generation{1};
+std::atomic<uint64_t> next_dispatcher_id{1};
+
+// Drops this thread's handlers whose route is gone. Returns whether any
+// route older than generation is left.
+bool prune_thread_handlers(uint64_t generation) {
+  bool outdated = false;
+  for (auto it = thread_handlers.begin(); it != thread_handlers.end();) {
+    if (it->second.route.expired()) {
+      it = thread_handlers.erase(it);
+    } else {
+      outdated |= it->first.second < generation;
+      ++it;
+    }
+  }
+  return outdated;
+}
+
+}  // namespace
+
+RequestHandlerDispatcher::RequestHandlerDispatcher(const NginxConfig& config)
+    : id_(next_dispatcher_id.fetch_add(1)) {
+  RouteMap routes;
+  uint64_t generation = next_generation.fetch_add(1);
+  if (!add_routes(config, generation, routes)) {
     LOG(error) << "Failed to add handlers to dispatcher";
     throw std::runtime_error("Failed to add handlers to dispatcher");
   }
+  publish(routes, generation);
+}
+
+RequestHandlerDispatcher::~RequestHandlerDispatcher() {
+  // Other threads' entries for this dispatcher are left behind unused
+  auto& slots = reader_slots;
+  slots.erase(
+      std::remove_if(slots.begin(), slots.end(),
+                     [&](const auto& slot) { return slot.first == id_; }),
+      slots.end());
+}
+
+bool RequestHandlerDispatcher::reload(const NginxConfig& config) {
+  RouteMap routes;
+  uint64_t generation = next_generation.fetch_add(1);
+  if (!add_routes(config, generation, routes)) {
+    LOG(error) << "Reload failed, keeping the current routes";
+    return false;
+  }
+  publish(routes, generation);
+  LOG(info) << "Reloaded " << routes.size() << " routes";
+  return true;
+}
+
+void RequestHandlerDispatcher::publish(const RouteMap& routes,
+                                       uint64_t generation) {
+  auto snapshot = std::make_unique<RouteSnapshot>();
+  snapshot->routes = RouteTrie<RoutePtr>(
+      {routes.begin(), routes.end()});
+  snapshot->generation = generation;
+  std::unique_ptr<const RouteSnapshot> replaced;
+  std::vector<ReaderSlot*> slots;
+  {
+    std::lock_guard<std::mutex> lock(snapshot_mutex_);
+    replaced = std::exchange(snapshot_, std::move(snapshot));
+    current_.store(snapshot_.get());
+    for (const auto& slot : reader_slots_) {
+      slots.push_back(slot.get());
+    }
+  }
+  // Reads starting from here on see the new snapshot, and slots added
+  // since only have those. Only reads already under way can still be on
+  // the replaced one; any change to their count means they have ended.
+  for (ReaderSlot* slot : slots) {
+    uint64_t reads = slot->reads.load();
+    if (reads % 2 == 1) {
+      while (slot->reads.load() == reads) {
+        std::this_thread::yield();
+      }
+    }
+  }
 }
 
-RequestHandlerDispatcher::~RequestHandlerDispatcher() {}
+RequestHandlerDispatcher::ReaderSlot&
+RequestHandlerDispatcher::reader_slot() {
+  for (const auto& [id, slot] : reader_slots) {
+    if (id == id_) {
+      return *static_cast<ReaderSlot*>(slot);
+    }
+  }
+  auto slot = std::make_unique<ReaderSlot>();
+  ReaderSlot* added = slot.get();
+  std::lock_guard<std::mutex> lock(snapshot_mutex_);
+  reader_slots_.push_back(std::move(slot));
+  reader_slots.emplace_back(id_, added);
+  return *added;
+}
 
-bool RequestHandlerDispatcher::add_routes(const NginxConfig& config) {
+bool RequestHandlerDispatcher::add_routes(const NginxConfig& config,
+                                          uint64_t generation,
+                                          RouteMap& routes) {
   NginxLocationResult result = config.get_locations();
   if (!result.valid) {
     LOG(error) << "Invalid locations in config";
@@ -26,7 +144,7 @@ bool RequestHandlerDispatcher::add_routes(const NginxConfig& config) {
   }
   std::vector<NginxLocation> locations = result.locations;
   for (const auto& location : locations) {
-    if (!add_route(location)) {
+    if (!add_route(location, generation, routes)) {
       LOG(warning) << "Dispatcher failed to add route for URI "
                    << location.path;
     }
@@ -35,13 +153,15 @@ bool RequestHandlerDispatcher::add_routes(const NginxConfig& config) {
   return true;
 }
 
-bool RequestHandlerDispatcher::add_route(const NginxLocation& location) {
+bool RequestHandlerDispatcher::add_route(const NginxLocation& location,
+                                         uint64_t generation,
+                                         RouteMap& routes) {
   std::string uri = location.path;
   std::string handler_type = location.handler;
 
   // Check if the URI already exists in the map
   // Only the first handler for a URI is added
-  if (routes_.find(uri) != routes_.end()) {
+  if (routes.find(uri) != routes.end()) {
     LOG(warning) << "Handler for URI \"" << uri << "\" already exists";
     return false;  // URI already exists
   }
@@ -50,44 +170,162 @@ bool RequestHandlerDispatcher::add_route(const NginxLocation& location) {
   RequestHandlerFactoryPtr factory_ptr =
       Registry::get_handler_factory(handler_type);
 
-  routes_[uri] = std::make_shared<
-      std::tuple<std::shared_ptr<RequestHandlerFactory>, std::string,
-                 std::shared_ptr<RequestHandlerArgs>>>(
-      std::make_tuple(factory_ptr, uri, location.args));
+  // Locations with handler_threads get a dedicated bounded pool
+  std::shared_ptr<HandlerPool> pool;
+  if (location.handler_threads > 0) {
+    size_t queue_size = location.handler_queue > 0
+                            ? location.handler_queue
+                            : DEFAULT_HANDLER_QUEUE_SIZE;
+    pool = std::make_shared<HandlerPool>(location.handler_threads, queue_size);
+    LOG(info) << "Route " << uri << " runs on " << location.handler_threads
+              << " handler threads";
+  }
+
+  std::shared_ptr<InflightLimiter> limiter;
+  if (location.max_inflight > 0 || location.shed_target_ms > 0) {
+    int interval = location.shed_interval_ms > 0 ? location.shed_interval_ms
+                                                 : DEFAULT_SHED_INTERVAL_MS;
+    limiter = std::make_shared<InflightLimiter>(
+        location.max_inflight,
+        std::chrono::milliseconds(location.shed_target_ms),
+        std::chrono::milliseconds(interval));
+    LOG(info) << "Route " << uri << " admits max_inflight="
+              << location.max_inflight
+              << " shed_target_ms=" << location.shed_target_ms;
+  }
+
+  // Reusable handlers are built once here rather than per request
+  HandlerLifecycle lifecycle = Registry::get_lifecycle(handler_type);
+  std::shared_ptr<RequestHandler> shared_handler;
+  if (factory_ptr && lifecycle == HandlerLifecycle::SHARED) {
+    shared_handler = (*factory_ptr)(uri, location.args);
+    LOG(info) << "Route " << uri << " shares one " << handler_type;
+  }
+
+  auto route = std::make_shared<Route>();
+  route->factory = factory_ptr;
+  route->location = uri;
+  route->args = location.args;
+  route->lifecycle = lifecycle;
+  route->pool = std::move(pool);
+  route->limiter = std::move(limiter);
+  route->shared_builtin = BuiltinHandlers::resolve(shared_handler.get());
+  route->shared_handler = std::move(shared_handler);
+  route->generation = generation;
+  routes[uri] = std::move(route);
   return true;
 }
 
-std::unique_ptr<RequestHandler> RequestHandlerDispatcher::get_handler(
+HandlerRef RequestHandlerDispatcher::get_handler(const Request& req) {
+  return get_handler_for(req.uri);
+}
+
+HandlerRef RequestHandlerDispatcher::get_handler(const RequestView& req) {
+  return get_handler_for(req.uri);
+}
+
+RoutePtr RequestHandlerDispatcher::get_route(
+    const RequestView& req) {
+  RoutePtr route = find_route(req.uri);
+  if (route == nullptr) {
+    LOG(debug) << "No location matches " << req.uri;
+  }
+  return route;
+}
+
+std::shared_ptr<HandlerPool> RequestHandlerDispatcher::get_handler_pool(
     const Request& req) {
-  std::string url = req.uri;
-  std::string location = longest_prefix_match(url);
-  LOG(debug) << "Location: " << location;
-  RequestHandlerFactoryAndWorkersPtr factory_and_workers_ptr =
-      routes_[location];
-  RequestHandlerFactoryPtr factory_ptr = std::get<0>(*factory_and_workers_ptr);
-  LOG(debug) << "Factory: " << factory_ptr;
-  std::string uri = std::get<1>(*factory_and_workers_ptr);
-  std::shared_ptr<RequestHandlerArgs> args =
-      std::get<2>(*factory_and_workers_ptr);
-  LOG(debug) << "Args: " << args;
-  return (*factory_ptr)(uri, args);
-}
-
-std::string RequestHandlerDispatcher::longest_prefix_match(
-    const std::string& url) {
-  // First argument is the URL to match, second argument is the URI in config
-  size_t max_length = 0;
-  std::string longest_match = "";
-
-  for (const auto& route : routes_) {
-    const std::string& route_uri = route.first;
-    if (url.substr(0, route_uri.size()) == route_uri) {
-      if (route_uri.size() > max_length) {
-        max_length = route_uri.size();
-        longest_match = route_uri;
-      }
-    }
+  return get_handler_pool_for(req.uri);
+}
+
+std::shared_ptr<HandlerPool> RequestHandlerDispatcher::get_handler_pool(
+    const RequestView& req) {
+  return get_handler_pool_for(req.uri);
+}
+
+std::shared_ptr<InflightLimiter>
+RequestHandlerDispatcher::get_inflight_limiter(const Request& req) {
+  return get_inflight_limiter_for(req.uri);
+}
+
+std::shared_ptr<InflightLimiter>
+RequestHandlerDispatcher::get_inflight_limiter(const RequestView& req) {
+  return get_inflight_limiter_for(req.uri);
+}
+
+HandlerRef RequestHandlerDispatcher::get_handler_for(std::string_view url) {
+  RoutePtr route = find_route(url);
+  if (route == nullptr) {
+    LOG(debug) << "No location matches " << url;
+    return HandlerRef();
   }
+  return get_handler(route);
+}
 
-  return longest_match;
-}
\ No newline at end of file
+HandlerRef RequestHandlerDispatcher::get_handler(const RoutePtr& route) {
+  if (!route) {
+    return HandlerRef();
+  }
+  if (route->lifecycle == HandlerLifecycle::SHARED) {
+    return HandlerRef(route->shared_handler.get(), route,
+                      route->shared_builtin);
+  }
+
+  LOG(debug) << "Factory: " << route->factory;
+  LOG(debug) << "Args: " << route->args;
+  if (route->lifecycle == HandlerLifecycle::PER_REQUEST) {
+    return HandlerRef((*route->factory)(route->location, route->args));
+  }
+
+  // A newer generation means a reload replaced routes this thread may
+  // have handlers for. Those still in use are pruned on later lookups.
+  if (route->generation > thread_handlers_generation ||
+      thread_handlers_outdated) {
+    thread_handlers_generation =
+        std::max(thread_handlers_generation, route->generation);
+    thread_handlers_outdated =
+        prune_thread_handlers(thread_handlers_generation);
+  }
+  ThreadHandler& cached = thread_handlers[{route.get(), route->generation}];
+  if (!cached.handler) {
+    LOG(debug) << "Building this thread's handler for " << route->location;
+    cached.route = route;
+    cached.handler = (*route->factory)(route->location, route->args);
+    cached.builtin = BuiltinHandlers::resolve(cached.handler.get());
+  }
+  return HandlerRef(cached.handler.get(), nullptr, cached.builtin);
+}
+
+std::shared_ptr<HandlerPool> RequestHandlerDispatcher::get_handler_pool_for(
+    std::string_view url) {
+  RoutePtr route = find_route(url);
+  if (route == nullptr) {
+    return nullptr;
+  }
+  return route->pool;
+}
+
+std::shared_ptr<InflightLimiter>
+RequestHandlerDispatcher::get_inflight_limiter_for(std::string_view url) {
+  RoutePtr route = find_route(url);
+  if (route == nullptr) {
+    return nullptr;
+  }
+  return route->limiter;
+}
+
+RoutePtr RequestHandlerDispatcher::find_route(std::string_view url) {
+  ReaderSlot& slot = reader_slot();
+  // Counted before loading the snapshot, so publish() either sees this
+  // read or it loads the snapshot publish() stored; both are sequentially
+  // consistent for that. Only this thread writes the count.
+  uint64_t reads = slot.reads.load(std::memory_order_relaxed);
+  slot.reads.store(reads + 1);
+  const RouteSnapshot* snapshot = current_.load();
+  auto match = snapshot->routes.longest_prefix_match(url);
+  RoutePtr route = match.value ? *match.value : nullptr;
+  // match views the snapshot, so it is not touched past this
+  slot.reads.store(reads + 2, std::memory_order_release);
+  LOG(debug) << "Location: " << (route ? route->location : "");
+  return route;
+}
@@ -1,17 +1,16 @@
 #include "request_parser.h"
 
+#include <algorithm>
+#include <array>
 #include <boost/beast/core.hpp>
 #include <boost/beast/http.hpp>
+#include <cstdint>
+#include <cstring>
 #include <iostream>
 #include <unordered_set>
 
 #include "logging.h"
 
-std::string get_version(unsigned int version) {
-  return "HTTP/" + std::to_string(version / 10) + "." +
-         std::to_string(version % 10);
-}
-
 const std::unordered_set<std::string> allowed_methods = {
     "GET", "POST", "PUT",
     "DELETE"  // only GET, POST, PUT, DELETE  methods is allowed for now
@@ -20,52 +19,344 @@ const std::unordered_set<std::string> allowed_methods = {
               */
 };
 
-void RequestParser::parse(Request &req, const std::string &raw_request) {
-  // Store raw http Request to parser
-  boost::beast::flat_buffer buffer;
-  buffer.commit(boost::asio::buffer_copy(buffer.prepare(raw_request.size()),
-                                         boost::asio::buffer(raw_request)));
+namespace {
+
+namespace http = boost::beast::http;
+
+// beast::string_view is not std::string_view in every Boost configuration
+template <typename StringView>
+std::string_view to_std(StringView s) {
+  return std::string_view(s.data(), s.size());
+}
+
+// Records where each part of the request lies in the parsed buffer. Given
+// one contiguous buffer, beast's basic_parser hands its callbacks views
+// into that buffer, so nothing is copied except a chunked body, which has
+// to be decoded.
+class ViewParser : public http::basic_parser<true> {
+ public:
+  ViewParser(RequestView &req, std::string_view raw)
+      : req_(req), raw_(raw) {}
+
+ private:
+  // A view into beast's own scratch space (an obsolete folded header
+  // line) would dangle once the parser is gone
+  bool in_raw(std::string_view s) const {
+    return s.empty() || (s.data() >= raw_.data() &&
+                         s.data() + s.size() <= raw_.data() + raw_.size());
+  }
+
+  void on_request_impl(http::verb, boost::beast::string_view method,
+                       boost::beast::string_view target, int version,
+                       boost::beast::error_code &ec) override {
+    req_.method = to_std(method);
+    req_.uri = to_std(target);
+    // Views of a literal stay valid for any buffer
+    if (version == 11) {
+      req_.version = "HTTP/1.1";
+    } else if (version == 10) {
+      req_.version = "HTTP/1.0";
+    } else {
+      LOG(error) << "Invalid HTTP version: " << version;
+      ec = http::error::bad_version;
+    }
+  }
+
+  void on_response_impl(int, boost::beast::string_view, int,
+                        boost::beast::error_code &ec) override {
+    ec = http::error::bad_method;
+  }
+
+  void on_field_impl(http::field, boost::beast::string_view name,
+                     boost::beast::string_view value,
+                     boost::beast::error_code &ec) override {
+    if (!in_raw(to_std(value))) {
+      LOG(error) << "Folded header value in " << to_std(name);
+      ec = http::error::bad_value;
+      return;
+    }
+    req_.headers.push_back(HeaderView{to_std(name), to_std(value)});
+  }
+
+  void on_header_impl(boost::beast::error_code &) override {}
+
+  void on_body_init_impl(const boost::optional<std::uint64_t> &,
+                         boost::beast::error_code &) override {}
+
+  std::size_t on_body_impl(boost::beast::string_view body,
+                           boost::beast::error_code &) override {
+    if (decoded_) {
+      decoded_->append(body.data(), body.size());
+    } else if (req_.body.empty()) {
+      req_.body = to_std(body);
+    } else {
+      // Only contiguous if beast split the body; fall back to a copy
+      decoded_ = std::make_shared<std::string>(req_.body);
+      decoded_->append(body.data(), body.size());
+    }
+    return body.size();
+  }
 
-  boost::beast::http::request_parser<boost::beast::http::string_body> parser;
+  void on_chunk_header_impl(std::uint64_t, boost::beast::string_view,
+                            boost::beast::error_code &) override {
+    if (!decoded_) {
+      decoded_ = std::make_shared<std::string>();
+    }
+  }
+
+  std::size_t on_chunk_body_impl(std::uint64_t,
+                                 boost::beast::string_view body,
+                                 boost::beast::error_code &) override {
+    decoded_->append(body.data(), body.size());
+    return body.size();
+  }
+
+  void on_finish_impl(boost::beast::error_code &) override {
+    if (decoded_) {
+      req_.body = *decoded_;
+      req_.decoded_body = std::move(decoded_);
+    }
+  }
+
+  RequestView &req_;
+  std::string_view raw_;
+  std::shared_ptr<std::string> decoded_;
+};
+
+// Parse with beast; false (and logged) if raw_request is not one complete,
+// well formed request
+bool parse_beast(RequestView &req, std::string_view raw_request) {
+  ViewParser parser(req, raw_request);
   boost::beast::error_code ec;
 
   // parses both the headers and the body
   parser.eager(true);
-  parser.put(buffer.data(), ec);
-
-  // If error in Request, Request not valid
+  parser.put(boost::asio::buffer(raw_request.data(), raw_request.size()), ec);
+  if (!ec && !parser.is_done()) {
+    ec = http::error::need_more;
+  }
   if (ec) {
     LOG(error) << "HTTP parse error: " << ec.message();
-    req.valid = false;
-    return;
+    return false;
   }
+  return true;
+}
 
-  // Get parsed Request
-  auto res = parser.get();
-  LOG(trace) << "parsed version=" << res.version()
-             << " method=" << res.method_string();
+enum class SimdStatus {
+  OK,
+  CHUNKED,  // left to beast
+  BAD_REQUEST_LINE,
+  BAD_VERSION,
+  BAD_HEADER,
+  BAD_CONTENT_LENGTH,
+  NEED_MORE,
+};
 
-  // Check Request version HTTP/1.1 and Request method allowed
-  if (res.version() != 11 ||
-      allowed_methods.find(res.method_string()) == allowed_methods.end()) {
-    LOG(error) << "Invalid HTTP version or method: " << res.version() << " "
-               << res.method_string();
-    req.valid = false;
+const char *simd_status_message(SimdStatus status) {
+  switch (status) {
+    case SimdStatus::BAD_REQUEST_LINE:
+      return "bad request line";
+    case SimdStatus::BAD_VERSION:
+      return "bad version";
+    case SimdStatus::BAD_HEADER:
+      return "bad header";
+    case SimdStatus::BAD_CONTENT_LENGTH:
+      return "bad Content-Length";
+    case SimdStatus::NEED_MORE:
+      return "incomplete request";
+    default:
+      return "ok";
+  }
+}
+
+// RFC 9110 token characters, which make up methods and header names
+const std::array<bool, 256> TOKEN_CHARS = [] {
+  std::array<bool, 256> table{};
+  for (int c = '0'; c <= '9'; ++c) table[c] = true;
+  for (int c = 'a'; c <= 'z'; ++c) table[c] = true;
+  for (int c = 'A'; c <= 'Z'; ++c) table[c] = true;
+  for (char c : std::string_view("!#$%&'*+-.^_`|~")) {
+    table[static_cast<unsigned char>(c)] = true;
+  }
+  return table;
+}();
+
+bool is_token(char c) { return TOKEN_CHARS[static_cast<unsigned char>(c)]; }
+
+bool is_ows(char c) { return c == ' ' || c == '\t'; }
+
+// A line from begin ends at the first byte the scanner stops at, which
+// has to start a CRLF. Returns the CR, or nullptr.
+const char *crlf_at(const char *line_end, const char *end) {
+  if (end - line_end < 2 || line_end[0] != '\r' || line_end[1] != '\n') {
+    return nullptr;
+  }
+  return line_end;
+}
+
+// The SIMD backend. Accepts what beast accepts for the requests this
+// server sees, except obsolete folded header lines.
+SimdStatus parse_simd(RequestView &req, std::string_view raw_request,
+                      const HeaderScanner &scanner) {
+  const char *p = raw_request.data();
+  const char *end = p + raw_request.size();
+
+  // method SP request-target SP HTTP-version CRLF
+  const char *line_end = crlf_at(scanner.find_line_end(p, end), end);
+  if (!line_end) {
+    return SimdStatus::BAD_REQUEST_LINE;
+  }
+  const char *method_end = p;
+  while (method_end < line_end && is_token(*method_end)) {
+    ++method_end;
+  }
+  if (method_end == p || method_end == line_end || *method_end != ' ') {
+    return SimdStatus::BAD_REQUEST_LINE;
+  }
+  const char *uri = method_end + 1;
+  const char *uri_end = static_cast<const char *>(
+      std::memchr(uri, ' ', static_cast<size_t>(line_end - uri)));
+  if (!uri_end || uri_end == uri) {
+    return SimdStatus::BAD_REQUEST_LINE;
+  }
+  std::string_view version(uri_end + 1,
+                           static_cast<size_t>(line_end - uri_end - 1));
+  // Views of a literal stay valid for any buffer
+  if (version == "HTTP/1.1") {
+    req.version = "HTTP/1.1";
+  } else if (version == "HTTP/1.0") {
+    req.version = "HTTP/1.0";
+  } else {
+    return SimdStatus::BAD_VERSION;
+  }
+  req.method = std::string_view(p, static_cast<size_t>(method_end - p));
+  req.uri = std::string_view(uri, static_cast<size_t>(uri_end - uri));
+  p = line_end + 2;
+
+  // field-name ":" OWS field-value OWS CRLF, until an empty line
+  bool have_length = false;
+  uint64_t content_length = 0;
+  for (;;) {
+    if (end - p < 2) {
+      return SimdStatus::NEED_MORE;
+    }
+    if (p[0] == '\r') {
+      if (p[1] != '\n') {
+        return SimdStatus::BAD_HEADER;
+      }
+      p += 2;
+      break;
+    }
+    const char *colon = scanner.find_colon(p, end);
+    if (colon == end) {
+      return SimdStatus::NEED_MORE;
+    }
+    // Also rejects a folded line, which starts with whitespace
+    if (*colon != ':' || colon == p || !std::all_of(p, colon, is_token)) {
+      return SimdStatus::BAD_HEADER;
+    }
+    const char *value = colon + 1;
+    line_end = scanner.find_line_end(value, end);
+    if (line_end == end) {
+      return SimdStatus::NEED_MORE;
+    }
+    if (!crlf_at(line_end, end)) {
+      return SimdStatus::BAD_HEADER;
+    }
+    const char *value_end = line_end;
+    while (value < value_end && is_ows(*value)) {
+      ++value;
+    }
+    while (value_end > value && is_ows(value_end[-1])) {
+      --value_end;
+    }
+    HeaderView header{std::string_view(p, static_cast<size_t>(colon - p)),
+                      std::string_view(value,
+                                       static_cast<size_t>(value_end - value))};
+    req.headers.push_back(header);
+
+    KnownHeader known = known_header(header.name);
+    if (known == KnownHeader::TRANSFER_ENCODING) {
+      return SimdStatus::CHUNKED;
+    }
+    if (known == KnownHeader::CONTENT_LENGTH) {
+      // Repeats are rejected even when they agree
+      if (have_length || header.value.empty() || header.value.size() > 18 ||
+          !std::all_of(header.value.begin(), header.value.end(),
+                       [](char c) { return c >= '0' && c <= '9'; })) {
+        return SimdStatus::BAD_CONTENT_LENGTH;
+      }
+      for (char c : header.value) {
+        content_length = content_length * 10 + static_cast<uint64_t>(c - '0');
+      }
+      have_length = true;
+    }
+    p = line_end + 2;
+  }
+
+  if (static_cast<uint64_t>(end - p) < content_length) {
+    return SimdStatus::NEED_MORE;
+  }
+  req.body = std::string_view(p, static_cast<size_t>(content_length));
+  return SimdStatus::OK;
+}
+
+bool allowed_method(std::string_view method) {
+  for (const auto &allowed : allowed_methods) {
+    if (method == allowed) {
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // namespace
+
+RequestParser::RequestParser(ParserBackend backend, ScannerIsa isa)
+    : backend_(backend), scanner_(isa) {}
+
+void RequestParser::parse(RequestView &req, std::string_view raw_request) {
+  req = RequestView();
+  bool parsed;
+  if (backend_ == ParserBackend::SIMD) {
+    SimdStatus status = parse_simd(req, raw_request, scanner_);
+    if (status == SimdStatus::CHUNKED) {
+      req = RequestView();
+      parsed = parse_beast(req, raw_request);
+    } else {
+      parsed = status == SimdStatus::OK;
+      if (!parsed) {
+        LOG(error) << "HTTP parse error: " << simd_status_message(status);
+      }
+    }
+  } else {
+    parsed = parse_beast(req, raw_request);
+  }
+
+  // If error in Request, Request not valid
+  if (!parsed) {
+    req = RequestView();
+    return;
+  }
+
+  if (!allowed_method(req.method)) {
+    LOG(error) << "Invalid HTTP method: " << req.method;
+    req = RequestView();
     return;
   }
-  // Fill Request object
   req.valid = true;
-  req.version = get_version(res.version());
-  req.uri = res.target();
-  req.method = res.method_string();
-  req.body = res.body();
 
-  LOG(info) << "Valid request: " << req.method << " " << req.uri << " ("
+  LOG(debug) << "Valid request: " << req.method << " " << req.uri << " ("
             << req.version << ")";
   LOG(trace) << "Request body: " << req.body;
+}
 
-  for (const auto &field : res) {
-    req.headers.push_back(
-        Header{std::string(field.name_string()), std::string(field.value())});
+void RequestParser::parse(Request &req, const std::string &raw_request) {
+  RequestView view;
+  parse(view, raw_request);
+  if (!view.valid) {
+    req.valid = false;
+    return;
   }
-}
\ No newline at end of file
+  req = view.to_request();
+}
@@ -5,27 +5,66 @@
 #include <boost/bind/bind.hpp>
 
 #include "config_parser.h"
+#include "http_header.h"
 #include "logging.h"
 #include "session.h"  // default factory creates this concrete type
 
+#ifdef CREEPER_COROUTINE_SESSION
+#include "coro_session.h"
+using DefaultSession = CoroSession;
+#else
+using DefaultSession = Session;
+#endif
+
 using boost::asio::ip::tcp;
 using boost::asio::placeholders::error;
 
+// SO_REUSEPORT is not wrapped by asio, so declare the socket option here
+using reuse_port_option =
+    boost::asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>;
+
 // ------------------------------------------------------------------ ctor
 Server::Server(boost::asio::io_service& io, short port,
                const NginxConfig& config, SessionFactory factory)
+    : Server(io, port, std::make_shared<RequestHandlerDispatcher>(config),
+             /*reuse_port=*/false, std::move(factory),
+             config.get_connection_settings()) {}
+
+Server::Server(boost::asio::io_service& io, short port,
+               std::shared_ptr<RequestHandlerDispatcher> dispatcher,
+               bool reuse_port, SessionFactory factory,
+               ConnectionSettings settings,
+               std::shared_ptr<ConnectionLimiter> limiter)
     : io_(io),
-      acceptor_(io, tcp::endpoint(tcp::v4(), port)),
-      dispatcher_(std::make_shared<RequestHandlerDispatcher>(config)),
+      acceptor_(io),
+      dispatcher_(std::move(dispatcher)),
       make_session_(factory
                         ? std::move(factory)  // test / mock
                         : [&] {               // default
-                            return std::make_shared<Session>(io_, dispatcher_);
-                          }) {
-  LOG(info) << "Server listening on port " << port;
+                            return std::make_shared<DefaultSession>(
+                                io_, dispatcher_, wheel_, settings_);
+                          }),
+      settings_(settings),
+      wheel_(std::make_shared<TimerWheel>(io)),
+      connection_limiter_(limiter ? std::move(limiter)
+                                  : std::make_shared<ConnectionLimiter>(
+                                        settings.max_connections)) {
+  tcp::endpoint endpoint(tcp::v4(), port);
+  acceptor_.open(endpoint.protocol());
+  acceptor_.set_option(tcp::acceptor::reuse_address(true));
+  if (reuse_port) {
+    acceptor_.set_option(reuse_port_option(true));
+  }
+  acceptor_.bind(endpoint);
+  acceptor_.listen();
+  LOG(info) << "Server listening on port " << port
+            << (reuse_port ? " (SO_REUSEPORT)" : "");
+  wheel_->start();
   start_accept();
 }
 
+Server::~Server() { wheel_->stop(); }
+
 // --------------------------------------------------------- start_accept()
 void Server::start_accept() {
   LOG(info) << "Waiting for new connection…";
@@ -47,10 +86,29 @@ void Server::handle_accept(SessionPtr sess,
     tcp::endpoint ep = sess->remote_endpoint();
     LOG(info) << "Accepted connection from " << ep.address().to_string() << ':'
               << ep.port();
-    sess->start();
+    ConnectionLimiter::Slot slot = connection_limiter_->try_acquire();
+    if (slot) {
+      sess->hold_connection_slot(std::move(slot));
+      sess->start();
+    } else {
+      reject(std::move(sess));
+    }
   } else {
     LOG(error) << "Accept error: " << ec.message();
   }
 
   start_accept();  // wait for next client
 }
+
+// ---------------------------------------------------------------- reject()
+void Server::reject(SessionPtr sess) {
+  // Pre-serialized, so shedding a connection costs one write
+  const std::string& response = overloaded_response(HTTP_VERSION, false);
+  boost::asio::async_write(
+      sess->socket(), boost::asio::buffer(response),
+      [sess](const boost::system::error_code&, size_t) {
+        boost::system::error_code ignored;
+        sess->socket().shutdown(tcp::socket::shutdown_both, ignored);
+        sess->socket().close(ignored);
+      });
+}
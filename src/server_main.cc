@@ -9,18 +9,49 @@
 // file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
 //
 
+#include <utility>  // before asio; see coro_session.h
 #include <boost/asio.hpp>
 #include <boost/asio/signal_set.hpp>
 #include <boost/thread.hpp>
 #include <cstdlib>
+#include <fstream>
+#include <functional>
 #include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
 
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "binary_access_log.h"
 #include "config_parser.h"
 #include "logging.h"
+#include "metrics.h"
 #include "registry.h"
+#include "request_handler_dispatcher.h"
 #include "server.h"
 
-#define NUM_THREADS 2
+// Pin the calling thread to a single core so its caches stay warm.
+// Failure is logged but not fatal; the thread just keeps floating.
+static void pin_to_cpu(unsigned int cpu) {
+#ifdef __linux__
+  cpu_set_t cpuset;
+  CPU_ZERO(&cpuset);
+  CPU_SET(cpu, &cpuset);
+  int rc = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuset);
+  if (rc != 0) {
+    LOG(warning) << "Failed to pin worker thread to CPU " << cpu
+                 << ", error=" << rc;
+    return;
+  }
+  LOG(info) << "Pinned worker thread to CPU " << cpu;
+#else
+  LOG(warning) << "CPU affinity is not supported on this platform";
+#endif
+}
 
 int main(int argc, char* argv[]) {
   logging::init_logging();
@@ -28,6 +59,10 @@ int main(int argc, char* argv[]) {
             << (std::getenv("CREEPER_LOG_DEBUG")
                     ? std::getenv("CREEPER_LOG_DEBUG")
                     : "unset")
+            << ", CREEPER_LOG_ASYNC="
+            << (std::getenv("CREEPER_LOG_ASYNC")
+                    ? std::getenv("CREEPER_LOG_ASYNC")
+                    : "unset")
             << ")";
   try {
     if (argc != 2) {
@@ -35,8 +70,6 @@ int main(int argc, char* argv[]) {
       throw std::runtime_error("Usage: server <config_file>");
     }
 
-    boost::asio::io_service io_service;
-
     LOG(info) << "Starting server with config file: " << argv[1];
 
     NginxConfig config;
@@ -49,48 +82,168 @@ int main(int argc, char* argv[]) {
 
     LOG(info) << "Config parsed successfully";
 
+    // Access records go to binary files instead if CREEPER_ACCESS_LOG is set
+    set_binary_access_log(binary_access_log_from_env());
+
     int port = config.get_port();
     if (port == -1) {
       LOG(error) << "No valid port found in config file";
       throw std::runtime_error("No valid port found in config file");
     }
 
-    LOG(info) << "Creating server on port " << port;
-    Server s(io_service, port, config);
+    int num_threads = config.get_threads();
+    if (num_threads == -1) {
+      LOG(error) << "Invalid threads directive in config file";
+      throw std::runtime_error("Invalid threads directive in config file");
+    }
+    CpuAffinity affinity = config.get_cpu_affinity();
+    if (affinity == CpuAffinity::INVALID) {
+      LOG(error) << "Invalid cpu_affinity directive in config file";
+      throw std::runtime_error("Invalid cpu_affinity directive in config file");
+    }
+    bool cpu_affinity = affinity == CpuAffinity::ON;
+    unsigned int num_cpus = std::thread::hardware_concurrency();
+
+    IoMode io_mode = config.get_io_mode();
+    if (io_mode == IoMode::INVALID) {
+      LOG(error) << "Invalid io_mode directive in config file";
+      throw std::runtime_error("Invalid io_mode directive in config file");
+    }
+    bool sharded = io_mode == IoMode::SHARDED;
+
+    ConnectionSettings connection_settings = config.get_connection_settings();
+    if (!connection_settings.valid) {
+      LOG(error) << "Invalid connection directive in config file";
+      throw std::runtime_error("Invalid connection directive in config file");
+    }
+
+    // One dispatcher (and therefore one set of backend pools) is shared by
+    // every Server regardless of io mode, and so is max_connections
+    auto dispatcher = std::make_shared<RequestHandlerDispatcher>(config);
+    auto connection_limiter = std::make_shared<ConnectionLimiter>(
+        connection_settings.max_connections);
+
+    // Shared mode: a single io_service and acceptor that all threads run.
+    // Sharded mode: one io_service and SO_REUSEPORT acceptor per thread, so
+    // a connection and all of its Session callbacks stay on one thread.
+    std::vector<std::unique_ptr<boost::asio::io_service>> io_services;
+    std::vector<std::unique_ptr<Server>> servers;
+    int num_shards = sharded ? num_threads : 1;
+    LOG(info) << "Creating " << num_shards << " server(s) on port " << port
+              << " in " << (sharded ? "sharded" : "shared") << " io mode";
+    for (int i = 0; i < num_shards; ++i) {
+      // A concurrency hint of 1 lets asio skip reactor locking for shards
+      io_services.push_back(sharded
+                                ? std::make_unique<boost::asio::io_service>(1)
+                                : std::make_unique<boost::asio::io_service>());
+      servers.push_back(std::make_unique<Server>(
+          *io_services.back(), port, dispatcher, sharded, nullptr,
+          connection_settings, connection_limiter));
+    }
     LOG(info) << "Server object constructed";
 
-    // Create a pool of threads to run the io_service
+    // Signals are handled on a control thread of their own, so a reload or
+    // report never stalls the connections of an io thread
+    boost::asio::io_service control_io;
+
+    // Stop every io_service on SIGINT / SIGTERM
+    boost::asio::signal_set signals(control_io, SIGINT, SIGTERM);
+    signals.async_wait(
+        [&](const boost::system::error_code& ec, int signal_number) {
+          if (!ec) {
+            LOG(info) << "Signal " << signal_number
+                      << " received, shutting down server";
+            for (auto& io : io_services) {
+              io->stop();
+            }
+            control_io.stop();
+          }
+        });
+
+    // Re-read the config on SIGHUP. Only locations are reloaded; port,
+    // threads, io_mode and connection settings need a restart.
+    boost::asio::signal_set reload_signals(control_io, SIGHUP);
+    std::function<void(const boost::system::error_code&, int)> on_reload =
+        [&](const boost::system::error_code& ec, int) {
+          if (ec) {
+            return;
+          }
+          LOG(info) << "SIGHUP received, reloading " << argv[1];
+          NginxConfig reloaded;
+          try {
+            if (!NginxConfigParser().parse(argv[1], &reloaded)) {
+              LOG(error) << "Error parsing config file, keeping the current "
+                            "routes";
+            } else {
+              dispatcher->reload(reloaded);
+            }
+          } catch (const std::exception& e) {
+            LOG(error) << "Reload failed: " << e.what();
+          }
+          reload_signals.async_wait(on_reload);
+        };
+    reload_signals.async_wait(on_reload);
+
+    // Write the latency histograms to CREEPER_LATENCY_REPORT (default
+    // latency_report.txt) on SIGUSR1, replacing the previous report
+    boost::asio::signal_set report_signals(control_io, SIGUSR1);
+    std::function<void(const boost::system::error_code&, int)> on_report =
+        [&](const boost::system::error_code& ec, int) {
+          if (ec) {
+            return;
+          }
+          const char* path = std::getenv("CREEPER_LATENCY_REPORT");
+          path = path ? path : "latency_report.txt";
+          std::ofstream report(path, std::ios::trunc);
+          metrics::write_latency_report(report, metrics::collect());
+          if (report) {
+            LOG(info) << "SIGUSR1 received, wrote latency report to " << path;
+          } else {
+            LOG(error) << "Failed to write latency report to " << path;
+          }
+          report_signals.async_wait(on_report);
+        };
+    report_signals.async_wait(on_report);
+
+    // Create a pool of threads to run the io_service(s)
     std::vector<boost::thread> threads;
-    LOG(info) << "Starting " << NUM_THREADS << " worker threads";
-
-    for (unsigned int i = 0; i < NUM_THREADS; ++i) {
-      threads.emplace_back([&io_service]() {
-        // io_service is captured by reference (&) because:
-        // 1. All threads need to share the same io_service instance to
-        // coordinate work
-        // 2. io_service is created in main() scope and outlives the threads
-        // 3. We need to be able to stop the io_service from any thread
+    LOG(info) << "Starting " << num_threads << " worker threads"
+              << (cpu_affinity ? " with CPU affinity" : "");
+
+    for (int i = 0; i < num_threads; ++i) {
+      boost::asio::io_service& io_service =
+          sharded ? *io_services[i] : *io_services.front();
+      threads.emplace_back([&io_service, i, cpu_affinity, num_cpus]() {
+        if (cpu_affinity && num_cpus > 0) {
+          pin_to_cpu(i % num_cpus);
+        }
+        // io_service is captured by reference (&) because it is owned by
+        // main() and outlives the threads; in shared mode every thread runs
+        // the same instance, in sharded mode each thread runs its own
         try {
           io_service.run();
-          boost::asio::signal_set signals(io_service, SIGINT, SIGTERM);
-          signals.async_wait(
-              [&](const boost::system::error_code& ec, int signal_number) {
-                if (!ec) {
-                  LOG(info) << "Signal " << signal_number
-                            << " received, shutting down server";
-                  io_service.stop();
-                }
-              });
         } catch (const std::exception& e) {
           LOG(error) << "Thread exception: " << e.what();
         }
       });
     }
 
+    boost::thread control_thread([&control_io]() {
+      try {
+        control_io.run();
+      } catch (const std::exception& e) {
+        LOG(error) << "Control thread exception: " << e.what();
+      }
+    });
+
     // Wait for all threads to complete
     for (auto& thread : threads) {
       thread.join();
     }
+    control_io.stop();
+    control_thread.join();
+    // Writes out the access records still batched
+    set_binary_access_log(nullptr);
 
     LOG(info) << "Server terminated cleanly";
   } catch (std::exception& e) {
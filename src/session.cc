@@ -13,6 +13,7 @@
 
 #include <boost/asio.hpp>
 #include <boost/bind/bind.hpp>
+#include <chrono>
 #include <iostream>
 #include <memory>
 #include <string>
@@ -20,6 +21,7 @@
 #include "echo_request_handler.h"
 #include "http_header.h"
 #include "logging.h"
+#include "metrics.h"
 #include "request_handler_dispatcher.h"
 #include "request_parser.h"
 
@@ -28,31 +30,50 @@ using boost::asio::placeholders::bytes_transferred;
 using boost::asio::placeholders::error;
 
 Session::Session(boost::asio::io_service &io_service,
-                 std::shared_ptr<RequestHandlerDispatcher> dispatcher)
-    : socket_(io_service), dispatcher_(dispatcher) {}
+                 std::shared_ptr<RequestHandlerDispatcher> dispatcher,
+                 std::shared_ptr<TimerWheel> wheel,
+                 ConnectionSettings settings)
+    : socket_(io_service),
+      dispatcher_(dispatcher),
+      strand_(boost::asio::make_strand(io_service)),
+      wheel_(std::move(wheel)),
+      settings_(settings),
+      parser_(settings.parser) {}
+
+Session::~Session() {
+  if (counted_open_) {
+    metrics::add(metrics::Counter::SESSIONS_CLOSED);
+  }
+}
 
 tcp::socket &Session::socket() { return socket_; }
 
+void Session::hold_connection_slot(std::shared_ptr<void> slot) {
+  connection_slot_ = std::move(slot);
+}
+
 void Session::start() {
+  count_open();
+  do_read();
+}
+
+void Session::do_read() {
+  arm_read_timer();
   auto self = shared_from_this();
   socket_.async_read_some(
-      boost::asio::buffer(data_, MAX_LENGTH),
-      boost::bind(&Session::handle_read, self, error, bytes_transferred));
+      boost::asio::buffer(framer_.prepare(DEFAULT_READ_SIZE),
+                          DEFAULT_READ_SIZE),
+      boost::asio::bind_executor(
+          strand_,
+          boost::bind(&Session::handle_read, self, error, bytes_transferred)));
 }
 
 void Session::handle_read(const boost::system::error_code &error,
                           size_t bytes_transferred) {
   if (!error) {
-    std::string response_msg = handle_response(bytes_transferred);
-
-    size_t response_length = response_msg.size();
-    // send Response and continue reading loop
-
-    auto self = shared_from_this();  // keep-alive again
-    boost::asio::async_write(socket_, boost::asio::buffer(response_msg),
-                             boost::bind(&Session::handle_write, self,
-                                         boost::asio::placeholders::error));
-
+    metrics::add(metrics::Counter::BYTES_RECEIVED, bytes_transferred);
+    framer_.commit(bytes_transferred);
+    process_buffer();
   } else if (error == boost::asio::error::eof ||
              error == boost::asio::error::connection_reset) {
     // client closed connection normally
@@ -63,14 +84,58 @@ void Session::handle_read(const boost::system::error_code &error,
   }
 }
 
+void Session::process_buffer() {
+  // A pipelined request is only dispatched once the previous one has been
+  // answered, so handlers see them in order; the batch ends when the
+  // buffer runs out of complete requests
+  while (responses_.size() < MAX_PIPELINED_REQUESTS && !close_after_write_) {
+    RequestFramer::Status status = framer_.next();
+    if (status == RequestFramer::Status::INCOMPLETE) {
+      break;
+    }
+    cancel_read_timer();
+    if (status != RequestFramer::Status::COMPLETE) {
+      // Nothing after a framing error can be trusted to start a request
+      framer_.reset();
+      close_after_write_ = true;
+      responses_.push_back(Outgoing(&framing_error_response(status)));
+      break;
+    }
+
+    // The request views the read buffer, which is left alone until the
+    // whole batch has been answered
+    RequestView req;
+    if (!parse_request(framer_.take_view(), req)) {
+      responses_.push_back(Outgoing(&invalid_request_response(req)));
+      continue;
+    }
+
+    // The handler may answer later and from another thread; the batch
+    // continues from its callback
+    bool keep_alive = keep_alive_after(req);
+    close_after_write_ = !keep_alive;
+    dispatch_request(std::move(req), keep_alive);
+    return;
+  }
+
+  if (responses_.empty()) {
+    do_read();
+  } else {
+    do_write();
+  }
+}
+
 void Session::handle_write(const boost::system::error_code &error) {
   if (!error) {
-    auto self = shared_from_this();  // keep-alive
-    socket_.async_read_some(
-        boost::asio::buffer(data_, MAX_LENGTH),
-        boost::bind(&Session::handle_read, self,
-                    boost::asio::placeholders::error,
-                    boost::asio::placeholders::bytes_transferred));
+    record_latencies();
+    responses_.clear();
+    reset_arena();
+    if (close_after_write_) {
+      close();
+      return;
+    }
+    // Bytes of the next request may already be buffered
+    process_buffer();
   } else if (error == boost::asio::error::eof ||
              error == boost::asio::error::connection_reset) {
     LOG(info) << "Client disconnected during write: " << error.message();
@@ -79,35 +144,363 @@ void Session::handle_write(const boost::system::error_code &error) {
   }
 }
 
-// RequestHandlerDispatcher will base the parsing to generate the specific
-// handler
-std::string Session::handle_response(size_t bytes_transferred) {
-  std::string request_msg(data_, bytes_transferred);
-  RequestParser p;
-  Request req;
-  std::unique_ptr<Response> res;
+void Session::gather_write_buffers() {
+  write_buffers_.clear();
+  if (heads_.size() < responses_.size()) {
+    heads_.resize(responses_.size());
+  }
+  for (size_t i = 0; i < responses_.size(); ++i) {
+    const Outgoing &response = responses_[i];
+    if (!response.res) {
+      write_buffers_.push_back(boost::asio::buffer(*response.bytes));
+      continue;
+    }
+    response.res->serialize_head(heads_[i]);
+    write_buffers_.push_back(boost::asio::buffer(heads_[i]));
+    if (!response.res->body.empty()) {
+      write_buffers_.push_back(boost::asio::buffer(response.res->body));
+    }
+  }
+  metrics::add(metrics::Counter::BYTES_SENT,
+               boost::asio::buffer_size(write_buffers_));
+}
+
+void Session::record_latencies() {
+  auto written = metrics::RequestTimer::Clock::now();
+  for (const Outgoing &response : responses_) {
+    response.timer.record(written);
+  }
+}
+
+void Session::do_write() {
+  gather_write_buffers();
+  auto self = shared_from_this();  // keep-alive again
+  boost::asio::async_write(
+      socket_, write_buffers_,
+      boost::asio::bind_executor(
+          strand_, boost::bind(&Session::handle_write, self,
+                               boost::asio::placeholders::error)));
+}
+
+void Session::dispatch_request(RequestView req, bool keep_alive) {
+  // Completes inline for synchronous handlers since we are already on
+  // strand_, otherwise hops back onto it from the completing thread. Only
+  // this is captured, so the callback does not allocate; whoever answers
+  // keeps the session alive while it runs.
+  run_handler(std::move(req), keep_alive, [this](Outgoing response) {
+    auto self = shared_from_this();
+    boost::asio::dispatch(strand_,
+                          [self, response = std::move(response)]() mutable {
+                            self->responses_.push_back(std::move(response));
+                            self->process_buffer();
+                          });
+  });
+}
+
+Session::InFlight::InFlight(std::shared_ptr<Session> self, RequestView req,
+                            bool keep_alive, ResponseReady on_ready)
+    : self(std::move(self)),
+      req(std::move(req)),
+      keep_alive(keep_alive),
+      on_ready(std::move(on_ready)) {}
+
+void Session::run_handler(RequestView req, bool keep_alive,
+                          ResponseReady on_ready) {
+  InFlight *flight = arena_.create<InFlight>(
+      shared_from_this(), std::move(req), keep_alive, std::move(on_ready));
+  flight->access = access_record(flight->req);
+  flight->route = dispatcher_->get_route(flight->req);
+  if (!flight->route) {
+    log_access(flight->access, 404, "NoLocation");
+    answer(flight, Outgoing(&encoded_stock_response(404).bytes(
+                       flight->req.version, keep_alive)));
+    return;
+  }
+  flight->access.location = flight->route->location;
+  flight->limiter = flight->route->limiter.get();
+  if (flight->limiter && !flight->limiter->try_acquire()) {
+    LOG(debug) << "Location at max_inflight → 503";
+    log_access(flight->access, 503, "Overloaded");
+    answer(flight,
+           Outgoing(&overloaded_response(flight->req.version, keep_alive)));
+    return;
+  }
+
+  // Slow handlers run on their location's pool so this io thread can
+  // keep serving other sessions. The handler is looked up on the thread
+  // that runs it, for locations that keep one per thread.
+  HandlerPool *pool = flight->route->pool.get();
+  ++flight->refs;
+  if (!pool) {
+    flight->handler = dispatcher_->get_handler(flight->route);
+    flight->access.dispatched = AccessRecord::Clock::now();
+    flight->handler.handle_request_view(flight->req,
+                                        response_callback(flight));
+    release(flight);
+    return;
+  }
+
+  auto queued_at = InflightLimiter::Clock::now();
+  bool queued = pool->submit([flight, queued_at]() {
+    Session &session = *flight->self;
+    // A request that sat in the queue too long is answered without
+    // running it, so the pool catches up instead of serving stale work
+    if (flight->limiter &&
+        flight->limiter->should_shed(InflightLimiter::Clock::now() -
+                                     queued_at)) {
+      flight->limiter->release();
+      session.log_access(flight->access, 503, "Shed");
+      session.answer(flight, Outgoing(&overloaded_response(
+                                 flight->req.version, flight->keep_alive)));
+    } else {
+      flight->handler = session.dispatcher_->get_handler(flight->route);
+      flight->access.dispatched = AccessRecord::Clock::now();
+      flight->handler.handle_request_view(flight->req,
+                                          session.response_callback(flight));
+    }
+    session.release(flight);
+  });
+  if (!queued) {
+    LOG(debug) << "Handler pool full → 503";
+    if (flight->limiter) {
+      flight->limiter->release();
+    }
+    log_access(flight->access, 503, "Overloaded");
+    release(flight);
+    answer(flight,
+           Outgoing(&overloaded_response(flight->req.version, keep_alive)));
+  }
+}
+
+RequestHandler::ResponseCallback Session::response_callback(
+    InFlight *flight) {
+  // The flight keeps the session, request and handler alive until the
+  // handler has answered and returned
+  return [flight](std::unique_ptr<Response> res) {
+    Session &session = *flight->self;
+    if (flight->limiter) {
+      flight->limiter->release();
+    }
+    flight->access.cache_tier = res->cache_tier;
+    session.log_access(flight->access, res->status_code,
+                       flight->handler.get_type());
+    if (const EncodedResponse *encoded = res->encoded()) {
+      session.answer(flight, Outgoing(&encoded->bytes(flight->req.version,
+                                                      flight->keep_alive)));
+      return;
+    }
+    set_connection_header(*res, flight->req.version, flight->keep_alive);
+    session.answer(flight, Outgoing(std::move(res)));
+  };
+}
+
+void Session::answer(InFlight *flight, Outgoing response) {
+  response.timer = request_timer(flight->access, flight->handler);
+  // The flight may hold the last reference to this session
+  std::shared_ptr<Session> self = flight->self;
+  ResponseReady on_ready = std::move(flight->on_ready);
+  release(flight);
+  on_ready(std::move(response));
+}
+
+void Session::release(InFlight *flight) {
+  if (flight->refs.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+    return;
+  }
+  // Destroyed while self still holds the session and its arena
+  std::shared_ptr<Session> self = std::move(flight->self);
+  if (strand_.running_in_this_thread()) {
+    destroy(flight);
+    return;
+  }
+  // The arena is not thread safe, and the strand may be allocating from it
+  // for the next request right now
+  boost::asio::post(strand_, [self = std::move(self), flight]() {
+    self->destroy(flight);
+  });
+}
+
+void Session::destroy(InFlight *flight) {
+  arena_.destroy(flight);
+  if (arena_reset_pending_ && arena_.live() == 0) {
+    reset_arena();
+  }
+}
+
+void Session::reset_arena() { arena_reset_pending_ = !arena_.reset(); }
+
+bool Session::keep_alive_after(const RequestView &req) {
+  ++requests_served_;
+  if (settings_.keepalive_requests > 0 &&
+      requests_served_ >= settings_.keepalive_requests) {
+    LOG(debug) << "Connection reached keepalive_requests="
+               << settings_.keepalive_requests;
+    return false;
+  }
+  return req.keep_alive();
+}
+
+void Session::arm_read_timer() {
+  if (!wheel_) {
+    return;
+  }
+  ReadPhase phase = ReadPhase::BODY;
+  int timeout = settings_.body_timeout;
+  if (framer_.buffered() == 0) {
+    phase = ReadPhase::IDLE;
+    timeout = settings_.keepalive_timeout;
+  } else if (!framer_.headers_complete()) {
+    phase = ReadPhase::HEADER;
+    timeout = settings_.header_timeout;
+  }
+  // The header deadline runs from the first byte so a client trickling
+  // headers cannot hold the connection forever
+  if (phase == ReadPhase::HEADER && read_phase_ == ReadPhase::HEADER) {
+    return;
+  }
+  read_phase_ = phase;
+  if (timeout == 0) {
+    if (read_timer_) {
+      wheel_->cancel(*read_timer_);
+    }
+    return;
+  }
+
+  if (!read_timer_) {
+    // The wheel may fire after the session is gone, so hold it weakly
+    std::weak_ptr<Session> weak = shared_from_this();
+    read_timer_ = std::make_unique<TimerWheel::Timer>([weak]() {
+      if (auto self = weak.lock()) {
+        boost::asio::dispatch(self->strand_,
+                              [self]() { self->on_read_timeout(); });
+      }
+    });
+  }
+  auto delay = std::chrono::seconds(timeout);
+  read_deadline_ = std::chrono::steady_clock::now() + delay;
+  wheel_->schedule(*read_timer_, delay);
+}
 
-  p.parse(req, request_msg);
-  if (!req.valid) {
-    // If the request is invalid, return a 400 Bad Request response
-    LOG(warning) << "Invalid request → 400";
-    // Log response metrics for invalid request
-    LOG(info) << "[ResponseMetrics] status_code=400 path=\"" << req.uri
-              << "\" ip=\"" << remote_endpoint().address().to_string()
-              << "\" handler=\"InvalidRequest\"";
-    return STOCK_RESPONSE.at(400).to_string();
+void Session::cancel_read_timer() {
+  read_phase_ = ReadPhase::NONE;
+  if (wheel_ && read_timer_) {
+    wheel_->cancel(*read_timer_);
   }
+}
 
-  // Get handler and response
-  std::unique_ptr<RequestHandler> handler = dispatcher_->get_handler(req);
-  res = handler->handle_request(req);
+void Session::on_read_timeout() {
+  // A stale expiry may arrive after the request completed or the timer
+  // was re-armed for a later deadline
+  if (read_phase_ == ReadPhase::NONE ||
+      std::chrono::steady_clock::now() < read_deadline_) {
+    return;
+  }
+  const char *phase = read_phase_ == ReadPhase::IDLE     ? "keepalive"
+                      : read_phase_ == ReadPhase::HEADER ? "header"
+                                                         : "body";
+  LOG(info) << "Closing connection after " << phase << " timeout";
+  read_phase_ = ReadPhase::NONE;
+  close();
+}
 
-  // Log response metrics in machine-parsable format
-  LOG(info) << "[ResponseMetrics] status_code=" << res->status_code
-            << " path=\"" << req.uri << "\" ip=\""
-            << remote_endpoint().address().to_string() << "\" handler=\""
-            << RequestHandler::handler_type_to_string(handler->get_type())
-            << "\"";
+void Session::close() {
+  boost::system::error_code ec;
+  socket_.shutdown(tcp::socket::shutdown_both, ec);
+  socket_.close(ec);
+}
 
-  return res->to_string();
-}
\ No newline at end of file
+bool Session::parse_request(std::string_view raw_request, RequestView &req) {
+  request_parse_started_ = AccessRecord::Clock::now();
+  parser_.parse(req, raw_request);
+  request_received_ = AccessRecord::Clock::now();
+  return req.valid;
+}
+
+const std::string &Session::invalid_request_response(const RequestView &req) {
+  // If the request is invalid, return a 400 Bad Request response
+  LOG(debug) << "Invalid request → 400";
+  metrics::add(metrics::Counter::PARSE_FAILURES);
+  AccessRecord record = access_record(req);
+  log_access(record, 400, "InvalidRequest");
+  return encoded_stock_response(400).bytes(HTTP_VERSION, true);
+}
+
+const std::string &Session::framing_error_response(RequestFramer::Status status) {
+  int status_code = 400;
+  if (status == RequestFramer::Status::HEADERS_TOO_LARGE) {
+    status_code = 431;
+  } else if (status == RequestFramer::Status::BODY_TOO_LARGE) {
+    status_code = 413;
+  }
+  LOG(debug) << "Unframeable request → " << status_code;
+  metrics::add(metrics::Counter::PARSE_FAILURES);
+  AccessRecord record;
+  record.peer = peer();
+  log_access(record, status_code, "InvalidRequest");
+  // The rest of the stream cannot be framed, so the connection is closed
+  return encoded_stock_response(status_code).bytes(HTTP_VERSION, false);
+}
+
+AccessRecord Session::access_record(const RequestView &req) {
+  AccessRecord record;
+  record.method = req.method;
+  record.path = req.uri;
+  record.peer = peer();
+  record.received = request_received_;
+  return record;
+}
+
+void Session::log_access(AccessRecord &record, int status_code,
+                         RequestHandler::HandlerType handler) {
+  metrics::count_request(handler, status_code);
+  record.status_code = status_code;
+  record.handler = RequestHandler::handler_type_to_string(handler);
+  record.emit();
+}
+
+void Session::log_access(AccessRecord &record, int status_code,
+                         const char *outcome) {
+  metrics::count_request(std::nullopt, status_code);
+  record.status_code = status_code;
+  record.handler = outcome;
+  record.emit();
+}
+
+metrics::RequestTimer Session::request_timer(const AccessRecord &record,
+                                             const HandlerRef &handler) const {
+  metrics::RequestTimer timer;
+  if (!record.location.empty()) {
+    timer.location = metrics::location_index(record.location);
+  }
+  if (handler) {
+    timer.handler = static_cast<int>(handler.get_type());
+  }
+  // Requests on a connection are answered one at a time, so this is still
+  // the start of record's request
+  timer.parse_started = request_parse_started_;
+  timer.parsed = record.received;
+  timer.dispatched = record.dispatched;
+  timer.answered = record.answered;
+  return timer;
+}
+
+void Session::count_open() {
+  if (!counted_open_) {
+    counted_open_ = true;
+    metrics::add(metrics::Counter::SESSIONS_OPENED);
+  }
+}
+
+std::string_view Session::peer() {
+  // Requests on a connection are answered one at a time, so only one
+  // thread formats the address
+  if (peer_.empty()) {
+    try {
+      peer_ = remote_endpoint().address().to_string();
+    } catch (const boost::system::system_error &) {
+      // Disconnected before its first response; try again next time
+      return "unknown";
+    }
+  }
+  return peer_;
+}
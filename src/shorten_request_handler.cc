@@ -2,12 +2,16 @@
 
 #include <fstream>
 #include "logging.h"
+#include "metrics.h"
 #include "real_database_client.h"
 #include "real_redis_client.h"
 #include "registry.h"
 
-REGISTER_HANDLER("ShortenHandler", ShortenRequestHandler,
-                 ShortenRequestHandlerArgs);
+// Only reads its members after construction; the Redis and database
+// clients come from the location's args and were always shared by every
+// request
+REGISTER_HANDLER_WITH_LIFECYCLE("ShortenHandler", ShortenRequestHandler,
+                                ShortenRequestHandlerArgs, SHARED);
 
 ShortenRequestHandlerArgs::ShortenRequestHandlerArgs() {}
 
@@ -128,10 +132,19 @@ std::unique_ptr<Response> ShortenRequestHandler::handle_request(
   }
 
   auto res = std::make_unique<Response>();
-  *res = STOCK_RESPONSE.at(405);
+  *res = Response::stock(405);
   return res;
 }
 
+void ShortenRequestHandler::handle_request_async(const Request& request,
+                                                 ResponseCallback callback) {
+  if (request.method == "GET") {
+    handle_get_request_async(request, std::move(callback));
+    return;
+  }
+  callback(handle_request(request));
+}
+
 // Long URL -> Short URL
 std::unique_ptr<Response> ShortenRequestHandler::handle_post_request(
     const Request& request) {
@@ -148,6 +161,7 @@ std::unique_ptr<Response> ShortenRequestHandler::handle_post_request(
     std::string candidate_short = base62_encode(salted_input);
 
     // Check existing mapping for this candidate short code
+    metrics::add(metrics::Counter::DATABASE_CALLS);
     std::optional<std::string> existing = db_->lookup(candidate_short);
     if (existing.has_value()) {
       // If mapping already exists and matches the requested long URL, reuse it
@@ -164,6 +178,7 @@ std::unique_ptr<Response> ShortenRequestHandler::handle_post_request(
     }
 
     // No existing mapping; store the original long URL under this short code
+    metrics::add(metrics::Counter::DATABASE_CALLS);
     if (!db_->store(candidate_short, long_url)) {
       LOG(error) << "Failed to store URL mapping: " << candidate_short << " -> "
                  << long_url;
@@ -209,55 +224,135 @@ std::unique_ptr<Response> ShortenRequestHandler::handle_get_request(
       file.close();
     } else {
       LOG(error) << "Failed to open shorten.html";
-      *res = STOCK_RESPONSE.at(404);
+      *res = Response::stock(404);
     }
     return res;
   }
 
-  // Must be /base_uri/6UQVxS
-  if (request.uri.length() != base_uri_.length() + SHORT_URL_LENGTH + 1) {
-    LOG(info) << "Invalid short URL: " << request.uri
-              << " (expected short URL length: " << SHORT_URL_LENGTH << ")";
-    *res = STOCK_RESPONSE.at(404);
+  // /base_uri/6UQVxS --> 6UQVxS
+  std::string short_url = extract_short_url(request.uri);
+  if (short_url.empty()) {
+    *res = Response::stock(404);
     return res;
   }
 
-  // /base_uri/6UQVxS --> 6UQVxS
-  std::string short_url = request.uri.substr(base_uri_.length() + 1);
-
   // If Short URL is found in Redis, return 302
+  metrics::add(metrics::Counter::REDIS_CALLS);
   std::optional<std::string> redis_long_url = redis_->get(short_url);
   if (redis_long_url) {
-    LOG(info) << "Found in Redis: " << short_url << " -> "
-              << redis_long_url.value();
-    res->status_code = 302;
-    res->status_message = "Found";
-    res->version = request.version;
-    // Set the location header to the long URL for redirection
-    res->headers.push_back({"Location", redis_long_url.value()});
+    LOG(debug) << "Found in Redis: " << short_url << " -> "
+               << redis_long_url.value();
+    res = make_redirect(request.version, redis_long_url.value());
+    res->cache_tier = "redis";
     return res;
   }
 
   // If Short URL is not found in Redis, check SQL database
   // std::optional<std::string> long_url = get_long_url(short_url);
+  metrics::add(metrics::Counter::DATABASE_CALLS);
   std::optional<std::string> long_url = db_->lookup(short_url);
   if (!long_url) {
-    LOG(info) << "Not Found in DB: " << short_url;
-    *res = STOCK_RESPONSE.at(404);
+    LOG(debug) << "Not Found in DB: " << short_url;
+    *res = Response::stock(404);
+    res->cache_tier = "db";
     return res;
   }
 
   // If Short URL is found in SQL database
-  LOG(info) << "Found in DB: " << short_url << " -> " << long_url.value();
+  LOG(debug) << "Found in DB: " << short_url << " -> " << long_url.value();
 
   // Store the short URL, long URL mapping in Redis
+  metrics::add(metrics::Counter::REDIS_CALLS);
   redis_->set(short_url, long_url.value());
 
+  res = make_redirect(request.version, long_url.value());
+  res->cache_tier = "db";
+  return res;
+}
+
+void ShortenRequestHandler::handle_get_request_async(
+    const Request& request, ResponseCallback callback) {
+  std::string short_url =
+      request.uri == base_uri_ ? "" : extract_short_url(request.uri);
+  if (short_url.empty()) {
+    // UI page and malformed codes never touch a backend
+    callback(handle_get_request(request));
+    return;
+  }
+  redirect_async(short_url, request.version, std::move(callback));
+}
+
+void ShortenRequestHandler::handle_request_view(const RequestView& request,
+                                                ResponseCallback callback) {
+  if (request.method == "GET" && request.uri != base_uri_) {
+    std::string short_url = extract_short_url(request.uri);
+    if (!short_url.empty()) {
+      redirect_async(short_url, std::string(request.version),
+                     std::move(callback));
+      return;
+    }
+  }
+  RequestHandler::handle_request_view(request, std::move(callback));
+}
+
+void ShortenRequestHandler::redirect_async(const std::string& short_url,
+                                           const std::string& version,
+                                           ResponseCallback callback) {
+  // The continuation chain owns copies of everything it needs, so it does
+  // not depend on the request or this handler outliving the first hop
+  std::shared_ptr<IRedisClient> redis = redis_;
+  std::shared_ptr<IDatabaseClient> db = db_;
+  metrics::add(metrics::Counter::REDIS_CALLS);
+  redis->get_async(short_url, [short_url, version, redis, db,
+                               callback](std::optional<std::string> cached) {
+    if (cached) {
+      LOG(debug) << "Found in Redis: " << short_url << " -> "
+                 << cached.value();
+      auto res = make_redirect(version, cached.value());
+      res->cache_tier = "redis";
+      callback(std::move(res));
+      return;
+    }
+    metrics::add(metrics::Counter::DATABASE_CALLS);
+    db->lookup_async(short_url, [short_url, version, redis, callback](
+                                    std::optional<std::string> long_url) {
+      if (!long_url) {
+        LOG(debug) << "Not Found in DB: " << short_url;
+        auto res = std::make_unique<Response>();
+        *res = Response::stock(404);
+        res->cache_tier = "db";
+        callback(std::move(res));
+        return;
+      }
+      LOG(debug) << "Found in DB: " << short_url << " -> " << long_url.value();
+      metrics::add(metrics::Counter::REDIS_CALLS);
+      redis->set(short_url, long_url.value());
+      auto res = make_redirect(version, long_url.value());
+      res->cache_tier = "db";
+      callback(std::move(res));
+    });
+  });
+}
+
+std::string ShortenRequestHandler::extract_short_url(
+    std::string_view uri) const {
+  // Must be /base_uri/6UQVxS
+  if (uri.length() != base_uri_.length() + SHORT_URL_LENGTH + 1) {
+    LOG(debug) << "Invalid short URL: " << uri
+               << " (expected short URL length: " << SHORT_URL_LENGTH << ")";
+    return "";
+  }
+  return std::string(uri.substr(base_uri_.length() + 1));
+}
+
+std::unique_ptr<Response> ShortenRequestHandler::make_redirect(
+    const std::string& version, const std::string& long_url) {
+  auto res = std::make_unique<Response>();
   res->status_code = 302;
   res->status_message = "Found";
-  res->version = request.version;
+  res->version = version;
   // Set the location header to the long URL for redirection
-  res->headers.push_back({"Location", long_url.value()});
+  res->headers.push_back({"Location", long_url});
   return res;
 }
 
@@ -8,8 +8,9 @@
 #include "registry.h"
 #include "request_handler.h"
 
-REGISTER_HANDLER("StaticHandler", StaticRequestHandler,
-                 StaticRequestHandlerArgs);
+// Only reads its paths after construction
+REGISTER_HANDLER_WITH_LIFECYCLE("StaticHandler", StaticRequestHandler,
+                                StaticRequestHandlerArgs, SHARED);
 
 StaticRequestHandlerArgs::StaticRequestHandlerArgs(std::string root_path)
     : root_path_(std::move(root_path)) {}
@@ -86,7 +87,7 @@ std::unique_ptr<Response> StaticRequestHandler::handle_request(
   if (!boost::filesystem::exists(file_path) ||
       !boost::filesystem::is_regular_file(file_path)) {
     LOG(warning) << "File not found or not a regular file: " << file_path;
-    *res = STOCK_RESPONSE.at(404);
+    *res = Response::stock(404);
   } else {
     LOG(info) << "Serving static file: " << file_path;
 
@@ -0,0 +1,114 @@
+#include "timer_wheel.h"
+
+#include "logging.h"
+
+TimerWheel::Timer::Timer(std::function<void()> on_expire)
+    : on_expire_(std::move(on_expire)) {}
+
+TimerWheel::Timer::~Timer() {
+  if (wheel_) {
+    wheel_->cancel(*this);
+  }
+}
+
+TimerWheel::TimerWheel(boost::asio::io_service& io,
+                       std::chrono::milliseconds tick, size_t num_slots)
+    : tick_timer_(io), tick_(tick), slots_(num_slots, nullptr) {}
+
+std::chrono::milliseconds TimerWheel::tick() const { return tick_; }
+
+void TimerWheel::start() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (running_) return;
+  running_ = true;
+  LOG(debug) << "Timer wheel started; tick=" << tick_.count()
+             << "ms slots=" << slots_.size();
+  tick_timer_.expires_after(tick_);
+  auto self = shared_from_this();
+  tick_timer_.async_wait(
+      [self](const boost::system::error_code& ec) { self->on_tick(ec); });
+}
+
+void TimerWheel::stop() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  running_ = false;
+  tick_timer_.cancel();
+}
+
+void TimerWheel::schedule(Timer& timer, std::chrono::milliseconds delay) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (timer.armed_) {
+    unlink(timer);
+  }
+  // Round up, plus one tick because part of the current one has already
+  // gone by, so a timer never fires early
+  size_t ticks = static_cast<size_t>(
+                     (delay + tick_ - std::chrono::milliseconds(1)) / tick_) +
+                 1;
+  timer.slot_ = (cursor_ + ticks) % slots_.size();
+  timer.rounds_ = (ticks - 1) / slots_.size();
+  timer.wheel_ = this;
+  timer.armed_ = true;
+  timer.prev_ = nullptr;
+  timer.next_ = slots_[timer.slot_];
+  if (timer.next_) {
+    timer.next_->prev_ = &timer;
+  }
+  slots_[timer.slot_] = &timer;
+}
+
+void TimerWheel::cancel(Timer& timer) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (timer.armed_) {
+    unlink(timer);
+  }
+}
+
+void TimerWheel::unlink(Timer& timer) {
+  if (timer.prev_) {
+    timer.prev_->next_ = timer.next_;
+  } else {
+    slots_[timer.slot_] = timer.next_;
+  }
+  if (timer.next_) {
+    timer.next_->prev_ = timer.prev_;
+  }
+  timer.prev_ = timer.next_ = nullptr;
+  timer.armed_ = false;
+}
+
+void TimerWheel::on_tick(const boost::system::error_code& ec) {
+  std::vector<std::function<void()>> expired;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (ec == boost::asio::error::operation_aborted || !running_) {
+      return;
+    }
+    cursor_ = (cursor_ + 1) % slots_.size();
+    Timer* timer = slots_[cursor_];
+    while (timer) {
+      Timer* next = timer->next_;
+      if (timer->rounds_ == 0) {
+        // Copy the callback out: once the lock is released the owner may
+        // destroy the timer at any moment
+        unlink(*timer);
+        expired.push_back(timer->on_expire_);
+      } else {
+        --timer->rounds_;
+      }
+      timer = next;
+    }
+
+    // Schedule from the previous deadline so the wheel does not drift
+    tick_timer_.expires_at(tick_timer_.expiry() + tick_);
+    auto self = shared_from_this();
+    tick_timer_.async_wait(
+        [self](const boost::system::error_code& ec) { self->on_tick(ec); });
+  }
+  if (!expired.empty()) {
+    LOG(debug) << "Timer wheel expired " << expired.size() << " timer(s)";
+  }
+  for (auto& on_expire : expired) {
+    on_expire();
+  }
+}
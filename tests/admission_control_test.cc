@@ -0,0 +1,77 @@
+#include "admission_control.h"
+
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+using namespace std::chrono_literals;
+
+TEST(ConnectionLimiterTest, RefusesPastLimitUntilSlotReleased) {
+  ConnectionLimiter limiter(2);
+  ConnectionLimiter::Slot a = limiter.try_acquire();
+  ConnectionLimiter::Slot b = limiter.try_acquire();
+  ASSERT_NE(a, nullptr);
+  ASSERT_NE(b, nullptr);
+  EXPECT_EQ(limiter.try_acquire(), nullptr);
+  EXPECT_EQ(limiter.active(), 2u);
+
+  a.reset();
+  EXPECT_EQ(limiter.active(), 1u);
+  EXPECT_NE(limiter.try_acquire(), nullptr);
+}
+
+TEST(ConnectionLimiterTest, ZeroIsUnlimited) {
+  ConnectionLimiter limiter(0);
+  std::vector<ConnectionLimiter::Slot> slots;
+  for (int i = 0; i < 100; ++i) {
+    slots.push_back(limiter.try_acquire());
+    ASSERT_NE(slots.back(), nullptr);
+  }
+  EXPECT_EQ(limiter.active(), 100u);
+}
+
+TEST(ConnectionLimiterTest, SlotMayOutliveLimiter) {
+  ConnectionLimiter::Slot slot;
+  {
+    ConnectionLimiter limiter(1);
+    slot = limiter.try_acquire();
+  }
+  EXPECT_NO_THROW(slot.reset());
+}
+
+TEST(InflightLimiterTest, CapsConcurrentRequests) {
+  InflightLimiter limiter(1, 0ms);
+  EXPECT_TRUE(limiter.try_acquire());
+  EXPECT_FALSE(limiter.try_acquire());
+  limiter.release();
+  EXPECT_TRUE(limiter.try_acquire());
+  EXPECT_EQ(limiter.inflight(), 1u);
+}
+
+TEST(InflightLimiterTest, NoTargetNeverSheds) {
+  InflightLimiter limiter(0, 0ms);
+  EXPECT_FALSE(limiter.should_shed(10s));
+}
+
+TEST(InflightLimiterTest, ShedsOnlyStaleRequestsWhenNotOverloaded) {
+  InflightLimiter limiter(0, 5ms, 50ms);
+  EXPECT_FALSE(limiter.should_shed(20ms));
+  EXPECT_TRUE(limiter.should_shed(60ms));
+}
+
+TEST(InflightLimiterTest, StandingQueueLowersSheddingThreshold) {
+  InflightLimiter limiter(0, 5ms, 20ms);
+  std::this_thread::sleep_for(25ms);
+  // Starts an interval in which nothing waits less than 10ms
+  EXPECT_FALSE(limiter.should_shed(10ms));
+  std::this_thread::sleep_for(25ms);
+  // The next interval starts overloaded: anything over target is shed
+  EXPECT_TRUE(limiter.should_shed(10ms));
+  EXPECT_FALSE(limiter.should_shed(1ms));
+
+  // An interval whose shortest wait was under target ends the overload
+  std::this_thread::sleep_for(25ms);
+  EXPECT_FALSE(limiter.should_shed(10ms));
+}
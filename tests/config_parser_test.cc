@@ -128,6 +128,112 @@ TEST_F(NginxConfigParserTestFixture, GetPortWithNoPort) {
   EXPECT_EQ(port, -1);
 }
 
+TEST_F(NginxConfigParserTestFixture, GetValidThreads) {
+  bool success = parser.parse("config_testcases/threads_config", &config);
+  EXPECT_TRUE(success);
+  EXPECT_EQ(config.get_threads(), 8);
+  EXPECT_EQ(config.get_cpu_affinity(), CpuAffinity::ON);
+}
+
+TEST_F(NginxConfigParserTestFixture, GetAutoThreads) {
+  bool success = parser.parse("config_testcases/threads_auto_config", &config);
+  EXPECT_TRUE(success);
+  EXPECT_GE(config.get_threads(), 1);
+  EXPECT_EQ(config.get_cpu_affinity(), CpuAffinity::OFF);
+}
+
+TEST_F(NginxConfigParserTestFixture, GetInvalidThreads) {
+  bool success =
+      parser.parse("config_testcases/invalid_threads_config", &config);
+  EXPECT_TRUE(success);
+  EXPECT_EQ(config.get_threads(), -1);
+}
+
+TEST_F(NginxConfigParserTestFixture, GetThreadsWithNoThreads) {
+  bool success = parser.parse("config_testcases/simple_config", &config);
+  EXPECT_TRUE(success);
+  EXPECT_EQ(config.get_threads(), DEFAULT_NUM_THREADS);
+}
+
+TEST_F(NginxConfigParserTestFixture, GetIoMode) {
+  bool success = parser.parse("config_testcases/threads_config", &config);
+  EXPECT_TRUE(success);
+  EXPECT_EQ(config.get_io_mode(), IoMode::SHARDED);
+}
+
+TEST_F(NginxConfigParserTestFixture, GetIoModeDefaultsToShared) {
+  bool success = parser.parse("config_testcases/simple_config", &config);
+  EXPECT_TRUE(success);
+  EXPECT_EQ(config.get_io_mode(), IoMode::SHARED);
+}
+
+TEST_F(NginxConfigParserTestFixture, GetInvalidIoMode) {
+  bool success =
+      parser.parse("config_testcases/invalid_threads_config", &config);
+  EXPECT_TRUE(success);
+  EXPECT_EQ(config.get_io_mode(), IoMode::INVALID);
+}
+
+TEST_F(NginxConfigParserTestFixture, GetInvalidCpuAffinity) {
+  bool success =
+      parser.parse("config_testcases/invalid_threads_config", &config);
+  EXPECT_TRUE(success);
+  EXPECT_EQ(config.get_cpu_affinity(), CpuAffinity::INVALID);
+}
+
+TEST_F(NginxConfigParserTestFixture, GetConnectionSettings) {
+  bool success = parser.parse("config_testcases/connection_config", &config);
+  EXPECT_TRUE(success);
+  ConnectionSettings settings = config.get_connection_settings();
+  EXPECT_TRUE(settings.valid);
+  EXPECT_EQ(settings.keepalive_timeout, 5);
+  EXPECT_EQ(settings.header_timeout, 2);
+  EXPECT_EQ(settings.body_timeout, 0);
+  EXPECT_EQ(settings.keepalive_requests, 100);
+  EXPECT_EQ(settings.max_connections, 3);
+  EXPECT_EQ(settings.parser, ParserBackend::SIMD);
+}
+
+TEST_F(NginxConfigParserTestFixture, GetConnectionSettingsDefaults) {
+  bool success = parser.parse("config_testcases/simple_config", &config);
+  EXPECT_TRUE(success);
+  ConnectionSettings settings = config.get_connection_settings();
+  EXPECT_TRUE(settings.valid);
+  EXPECT_EQ(settings.keepalive_timeout, DEFAULT_KEEPALIVE_TIMEOUT);
+  EXPECT_EQ(settings.header_timeout, DEFAULT_HEADER_TIMEOUT);
+  EXPECT_EQ(settings.body_timeout, DEFAULT_BODY_TIMEOUT);
+  EXPECT_EQ(settings.keepalive_requests, DEFAULT_KEEPALIVE_REQUESTS);
+  EXPECT_EQ(settings.parser, ParserBackend::BEAST);
+}
+
+TEST_F(NginxConfigParserTestFixture, GetInvalidConnectionSettings) {
+  bool success =
+      parser.parse("config_testcases/invalid_connection_config", &config);
+  EXPECT_TRUE(success);
+  EXPECT_FALSE(config.get_connection_settings().valid);
+}
+
+TEST_F(NginxConfigParserTestFixture, GetInvalidParser) {
+  bool success = parser.parse("config_testcases/invalid_parser_config", &config);
+  EXPECT_TRUE(success);
+  EXPECT_FALSE(config.get_connection_settings().valid);
+}
+
+TEST_F(NginxConfigParserTestFixture, GetLocationsWithInvalidHandlerThreads) {
+  bool success =
+      parser.parse("config_testcases/invalid_handler_threads", &config);
+  EXPECT_TRUE(success);
+  result = config.get_locations();
+  EXPECT_FALSE(result.valid);
+}
+
+TEST_F(NginxConfigParserTestFixture, GetLocationsWithInvalidMaxInflight) {
+  bool success = parser.parse("config_testcases/invalid_max_inflight", &config);
+  EXPECT_TRUE(success);
+  result = config.get_locations();
+  EXPECT_FALSE(result.valid);
+}
+
 TEST_F(NginxConfigParserTestFixture, GetValidEchoLocations) {
   bool success = parser.parse("config_testcases/echo_handler_on_root", &config);
   EXPECT_TRUE(success);
@@ -0,0 +1,119 @@
+// tests/coro_session_test.cc --------------------------------------------
+#include "coro_session.h"
+
+#include <boost/asio.hpp>
+#include <chrono>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include "config_parser.h"
+#include "gtest/gtest.h"
+#include "request_handler_dispatcher.h"
+
+namespace asio = boost::asio;
+using tcp = asio::ip::tcp;
+
+// Accepts one loopback connection into a CoroSession served by a
+// background io thread; the test talks to it through client_
+class CoroSessionTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    std::istringstream config_stream(
+        "location /echo EchoHandler {\n"
+        "}\n");
+    NginxConfig config;
+    ASSERT_TRUE(NginxConfigParser().parse(&config_stream, &config));
+    auto dispatcher = std::make_shared<RequestHandlerDispatcher>(config);
+
+    tcp::acceptor acceptor(io_, tcp::endpoint(tcp::v4(), 0));
+    auto session = std::make_shared<CoroSession>(io_, dispatcher);
+    session_ = session;
+    client_.connect(tcp::endpoint(asio::ip::address_v4::loopback(),
+                                  acceptor.local_endpoint().port()));
+    acceptor.accept(session->socket());
+    session->start();
+    // the coroutine now owns the only strong reference
+    io_thread_ = std::thread([this] { io_.run(); });
+  }
+
+  void TearDown() override {
+    io_.stop();
+    if (io_thread_.joinable()) io_thread_.join();
+  }
+
+  std::string round_trip(const std::string& request) {
+    asio::write(client_, asio::buffer(request));
+    asio::streambuf buf;
+    size_t header_end = asio::read_until(client_, buf, "\r\n\r\n");
+    std::string head(asio::buffers_begin(buf.data()),
+                     asio::buffers_begin(buf.data()) + header_end);
+    size_t pos = head.find("Content-Length: ");
+    size_t length = std::stoul(head.substr(pos + 16));
+    if (buf.size() < header_end + length) {
+      asio::read(client_, buf,
+                 asio::transfer_exactly(header_end + length - buf.size()));
+    }
+    return std::string(asio::buffers_begin(buf.data()),
+                       asio::buffers_begin(buf.data()) + header_end + length);
+  }
+
+  asio::io_service io_;
+  asio::io_service client_io_;
+  tcp::socket client_{client_io_};
+  std::weak_ptr<CoroSession> session_;
+  std::thread io_thread_;
+};
+
+TEST_F(CoroSessionTest, EchoesRequestsOnKeepAliveConnection) {
+  std::string request =
+      "GET /echo HTTP/1.1\r\n"
+      "Host: www.example.com\r\n"
+      "\r\n";
+  std::string expected =
+      "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nContent-Length: " +
+      std::to_string(request.size()) + "\r\n\r\n" + request;
+
+  EXPECT_EQ(round_trip(request), expected);
+  EXPECT_EQ(round_trip(request), expected);
+}
+
+TEST_F(CoroSessionTest, PipelinedRequestsAnsweredInOrder) {
+  std::string first =
+      "GET /echo HTTP/1.1\r\n"
+      "Host: first\r\n"
+      "\r\n";
+  std::string second =
+      "GET /echo HTTP/1.1\r\n"
+      "Host: second\r\n"
+      "\r\n";
+  asio::write(client_, asio::buffer(first + second));
+
+  auto expected = [](const std::string& request) {
+    return "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\n"
+           "Content-Length: " +
+           std::to_string(request.size()) + "\r\n\r\n" + request;
+  };
+  std::string want = expected(first) + expected(second);
+  std::string got(want.size(), '\0');
+  asio::read(client_, asio::buffer(got));
+  EXPECT_EQ(got, want);
+}
+
+TEST_F(CoroSessionTest, InvalidRequestReturns400) {
+  std::string response = round_trip(
+      " /weird HTTP/1.1\r\n"
+      "Host: weird.com\r\n"
+      "\r\n");
+
+  EXPECT_EQ(response.rfind("HTTP/1.1 400 Bad Request\r\n", 0), 0u);
+}
+
+TEST_F(CoroSessionTest, ClientCloseEndsSession) {
+  client_.close();
+  for (int i = 0; i < 200 && !session_.expired(); ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+  EXPECT_TRUE(session_.expired());
+}
@@ -16,7 +16,7 @@ Request make_request(const std::string &method, const std::string &uri,
   req.version = "HTTP/1.1";
   req.valid = true;
   req.body = body;
-  req.headers = headers;
+  req.headers.assign(headers.begin(), headers.end());
   return req;
 }
 
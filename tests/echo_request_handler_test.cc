@@ -91,4 +91,20 @@ TEST_F(EchoRequestHandlerTestFixture, InvalidEchoRequestWithArgs) {
 TEST_F(EchoRequestHandlerTestFixture, GetType) {
   EXPECT_EQ(handler->get_type(),
             RequestHandler::HandlerType::ECHO_REQUEST_HANDLER);
-}
\ No newline at end of file
+}
+
+TEST_F(EchoRequestHandlerTestFixture, AsyncDefaultsToSyncHandler) {
+  req.valid = true;
+  req.version = "HTTP/1.1";
+  req.method = "GET";
+  req.uri = "/echo";
+
+  std::unique_ptr<Response> async_res;
+  handler->handle_request_async(
+      req, [&](std::unique_ptr<Response> r) { async_res = std::move(r); });
+
+  // The default adapter completes inline with the sync result
+  ASSERT_NE(async_res, nullptr);
+  EXPECT_EQ(async_res->status_code, 200);
+  EXPECT_EQ(async_res->body, handler->call_handle_request(req).body);
+}
@@ -0,0 +1,74 @@
+#include "handler_pool.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <future>
+#include <mutex>
+#include <thread>
+
+#include "gtest/gtest.h"
+
+class HandlerPoolTest : public ::testing::Test {};
+
+TEST_F(HandlerPoolTest, RunsSubmittedTasks) {
+  std::atomic<int> count{0};
+  {
+    HandlerPool pool(2);
+    for (int i = 0; i < 10; ++i) {
+      EXPECT_TRUE(pool.submit([&count] { ++count; }));
+    }
+  }  // destructor drains the queue and joins
+  EXPECT_EQ(count, 10);
+}
+
+TEST_F(HandlerPoolTest, RunsTasksOffCallerThread) {
+  HandlerPool pool(1);
+  std::promise<std::thread::id> id;
+  pool.submit([&id] { id.set_value(std::this_thread::get_id()); });
+  EXPECT_NE(id.get_future().get(), std::this_thread::get_id());
+}
+
+TEST_F(HandlerPoolTest, RejectsWhenQueueFull) {
+  HandlerPool pool(1, /*max_queue_size=*/1);
+  std::mutex mutex;
+  std::condition_variable cv;
+  bool release = false;
+  std::promise<void> started;
+
+  // Occupy the only worker
+  EXPECT_TRUE(pool.submit([&] {
+    started.set_value();
+    std::unique_lock<std::mutex> lock(mutex);
+    cv.wait(lock, [&] { return release; });
+  }));
+  started.get_future().wait();
+
+  EXPECT_TRUE(pool.submit([] {}));   // fills the queue
+  EXPECT_FALSE(pool.submit([] {}));  // over the bound
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    release = true;
+  }
+  cv.notify_all();
+}
+
+TEST_F(HandlerPoolTest, ReportsSize) {
+  HandlerPool pool(3, 7);
+  EXPECT_EQ(pool.num_threads(), 3);
+  EXPECT_EQ(pool.max_queue_size(), 7);
+}
+
+TEST_F(HandlerPoolTest, LastReferenceDroppedOnWorkerDoesNotDeadlock) {
+  auto pool = std::make_shared<HandlerPool>(1);
+  std::promise<void> done;
+  auto weak = std::weak_ptr<HandlerPool>(pool);
+  pool->submit([pool_ref = pool, &done]() mutable {
+    pool_ref.reset();
+    done.set_value();
+  });
+  pool.reset();
+  EXPECT_EQ(done.get_future().wait_for(std::chrono::seconds(5)),
+            std::future_status::ready);
+}
@@ -0,0 +1,96 @@
+#include "header_scanner.h"
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+class HeaderScannerTest : public ::testing::Test {
+ protected:
+  // Every isa this CPU can run, widest last
+  std::vector<ScannerIsa> supported_isas() {
+    std::vector<ScannerIsa> isas;
+    for (ScannerIsa isa :
+         {ScannerIsa::SCALAR, ScannerIsa::SSE42, ScannerIsa::AVX2}) {
+      if (HeaderScanner(isa).isa() == isa) {
+        isas.push_back(isa);
+      }
+    }
+    return isas;
+  }
+
+  size_t line_end_at(const HeaderScanner& scanner, const std::string& s) {
+    return scanner.find_line_end(s.data(), s.data() + s.size()) - s.data();
+  }
+
+  size_t colon_at(const HeaderScanner& scanner, const std::string& s) {
+    return scanner.find_colon(s.data(), s.data() + s.size()) - s.data();
+  }
+};
+
+TEST_F(HeaderScannerTest, DefaultUsesBestIsa) {
+  EXPECT_EQ(HeaderScanner().isa(), HeaderScanner::best_isa());
+  EXPECT_EQ(HeaderScanner(ScannerIsa::SCALAR).isa(), ScannerIsa::SCALAR);
+}
+
+TEST_F(HeaderScannerTest, FindsDelimiterAtEveryPosition) {
+  for (ScannerIsa isa : supported_isas()) {
+    HeaderScanner scanner(isa);
+    for (size_t pos = 0; pos < 80; ++pos) {
+      std::string line(100, 'a');
+      line[pos] = '\r';
+      EXPECT_EQ(line_end_at(scanner, line), pos)
+          << HeaderScanner::isa_name(isa);
+      line[pos] = ':';
+      EXPECT_EQ(colon_at(scanner, line), pos) << HeaderScanner::isa_name(isa);
+      EXPECT_EQ(line_end_at(scanner, line), line.size())
+          << HeaderScanner::isa_name(isa);
+    }
+  }
+}
+
+TEST_F(HeaderScannerTest, ReturnsEndWhenAbsent) {
+  for (ScannerIsa isa : supported_isas()) {
+    HeaderScanner scanner(isa);
+    for (size_t size = 0; size < 70; ++size) {
+      std::string value(size, 'v');
+      EXPECT_EQ(line_end_at(scanner, value), size)
+          << HeaderScanner::isa_name(isa);
+      EXPECT_EQ(colon_at(scanner, value), size)
+          << HeaderScanner::isa_name(isa);
+    }
+  }
+}
+
+TEST_F(HeaderScannerTest, TabAndHighBytesAreNotDelimiters) {
+  std::string value = "a\tb \x80\xff~";
+  for (ScannerIsa isa : supported_isas()) {
+    HeaderScanner scanner(isa);
+    std::string padded = value + std::string(40, '\t') + "\n";
+    EXPECT_EQ(line_end_at(scanner, padded), padded.size() - 1)
+        << HeaderScanner::isa_name(isa);
+  }
+}
+
+TEST_F(HeaderScannerTest, AgreesWithScalarOnRandomInput) {
+  HeaderScanner scalar(ScannerIsa::SCALAR);
+  std::mt19937 rng(1234);
+  // Mostly printable, with the occasional delimiter or control byte
+  std::uniform_int_distribution<int> byte(0, 255);
+  std::uniform_int_distribution<int> percent(0, 99);
+  for (int round = 0; round < 2000; ++round) {
+    std::string s(1 + round % 97, 'x');
+    for (char& c : s) {
+      c = percent(rng) < 97 ? static_cast<char>(' ' + percent(rng) % 95)
+                            : static_cast<char>(byte(rng));
+    }
+    for (ScannerIsa isa : supported_isas()) {
+      HeaderScanner scanner(isa);
+      ASSERT_EQ(line_end_at(scanner, s), line_end_at(scalar, s))
+          << HeaderScanner::isa_name(isa);
+      ASSERT_EQ(colon_at(scanner, s), colon_at(scalar, s))
+          << HeaderScanner::isa_name(isa);
+    }
+  }
+}
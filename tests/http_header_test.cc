@@ -69,4 +69,178 @@ TEST_F(HttpHeaderTestFixture, RepsonseConstructor) {
   EXPECT_EQ(res.headers[0].name, "Content-Type");
   EXPECT_EQ(res.headers[0].value, "text/plain");
   EXPECT_EQ(res.body, "Hello, World!");
-}
\ No newline at end of file
+}
+TEST_F(HttpHeaderTestFixture, Http11DefaultsToKeepAlive) {
+  req.version = "HTTP/1.1";
+  EXPECT_TRUE(req.keep_alive());
+  req.headers.push_back({"connection", "Upgrade, Close"});
+  EXPECT_FALSE(req.keep_alive());
+}
+
+TEST_F(HttpHeaderTestFixture, Http10DefaultsToClose) {
+  req.version = "HTTP/1.0";
+  EXPECT_FALSE(req.keep_alive());
+  req.headers.push_back({"Connection", "Keep-Alive"});
+  EXPECT_TRUE(req.keep_alive());
+}
+
+TEST_F(HttpHeaderTestFixture, RequestViewToRequest) {
+  std::string raw = "GET /echo HTTP/1.0 Host www.example.com";
+  RequestView view;
+  view.method = std::string_view(raw).substr(0, 3);
+  view.uri = std::string_view(raw).substr(4, 5);
+  view.version = std::string_view(raw).substr(10, 8);
+  view.headers.push_back({std::string_view(raw).substr(19, 4),
+                          std::string_view(raw).substr(24)});
+  view.valid = true;
+
+  req = view.to_request();
+  EXPECT_TRUE(req.valid);
+  EXPECT_EQ(req.to_string(),
+            "GET /echo HTTP/1.0\r\n"
+            "Host: www.example.com\r\n"
+            "\r\n");
+  EXPECT_FALSE(view.keep_alive());
+}
+
+TEST_F(HttpHeaderTestFixture, FindHeaderIgnoresCase) {
+  req.headers.push_back({"content-type", "application/json"});
+  req.headers.push_back({"X-Request-Id", "42"});
+  req.headers.push_back({"Content-Type", "text/plain"});
+
+  // The first of repeated headers
+  const Header* content_type = req.find_header(KnownHeader::CONTENT_TYPE);
+  ASSERT_NE(content_type, nullptr);
+  EXPECT_EQ(content_type->value, "application/json");
+  EXPECT_EQ(req.find_header("CONTENT-TYPE"), content_type);
+
+  const Header* request_id = req.find_header("x-request-id");
+  ASSERT_NE(request_id, nullptr);
+  EXPECT_EQ(request_id->value, "42");
+
+  EXPECT_EQ(req.find_header(KnownHeader::HOST), nullptr);
+  EXPECT_EQ(req.find_header("X-Missing"), nullptr);
+}
+
+TEST_F(HttpHeaderTestFixture, KnownHeaderNames) {
+  EXPECT_EQ(known_header("host"), KnownHeader::HOST);
+  EXPECT_EQ(known_header("Accept-Encoding"), KnownHeader::ACCEPT_ENCODING);
+  EXPECT_EQ(known_header("TRANSFER-ENCODING"), KnownHeader::TRANSFER_ENCODING);
+  EXPECT_EQ(known_header("Hostname"), KnownHeader::OTHER);
+  EXPECT_EQ(known_header(""), KnownHeader::OTHER);
+}
+
+TEST_F(HttpHeaderTestFixture, HeadersGrowPastInlineCapacity) {
+  for (int i = 0; i < INLINE_HEADERS * 2; ++i) {
+    req.headers.push_back({"X-Header-" + std::to_string(i), std::to_string(i)});
+  }
+  req.headers.push_back({"Host", "www.example.com"});
+  ASSERT_EQ(req.headers.size(), static_cast<size_t>(INLINE_HEADERS * 2 + 1));
+  EXPECT_EQ(req.headers[INLINE_HEADERS + 3].value,
+            std::to_string(INLINE_HEADERS + 3));
+  ASSERT_NE(req.find_header(KnownHeader::HOST), nullptr);
+  EXPECT_EQ(req.find_header(KnownHeader::HOST)->value, "www.example.com");
+
+  // Copies and moves keep the headers and their index
+  Request copy = req;
+  Request moved = std::move(req);
+  for (const Request* r : {&copy, &moved}) {
+    ASSERT_EQ(r->headers.size(), static_cast<size_t>(INLINE_HEADERS * 2 + 1));
+    EXPECT_EQ(r->headers[0].name, "X-Header-0");
+    EXPECT_EQ(r->find_header(KnownHeader::HOST), &r->headers.end()[-1]);
+  }
+}
+
+TEST(SmallVectorTest, StaysInlineUntilFull) {
+  SmallVector<std::string, 2> v;
+  v.push_back("a");
+  v.push_back("b");
+  EXPECT_TRUE(v.is_inline());
+  v.push_back("c");
+  EXPECT_FALSE(v.is_inline());
+  EXPECT_EQ(v.size(), 3u);
+  EXPECT_EQ(v[0], "a");
+  EXPECT_EQ(v[2], "c");
+
+  SmallVector<std::string, 2> small = {"x"};
+  small = std::move(v);
+  EXPECT_EQ(small.size(), 3u);
+  EXPECT_EQ(small.back(), "c");
+  EXPECT_TRUE(v.empty());
+  EXPECT_TRUE(v.is_inline());
+}
+
+TEST_F(HttpHeaderTestFixture, SerializeHeadMatchesToString) {
+  res = Response(HTTP_VERSION, 200, "OK", {{"Content-Type", "text/plain"}},
+                 "Hello, World!");
+  std::string head = "left over from an earlier response";
+  res.serialize_head(head);
+  EXPECT_EQ(head,
+            "HTTP/1.1 200 OK\r\n"
+            "Content-Type: text/plain\r\n"
+            "Content-Length: 13\r\n"
+            "\r\n");
+  EXPECT_EQ(head + res.body, res.to_string());
+
+  // A status message other than the standard one is kept
+  res.status_message = "Fine";
+  res.serialize_head(head);
+  EXPECT_EQ(head.substr(0, 17), "HTTP/1.1 200 Fine");
+}
+
+TEST_F(HttpHeaderTestFixture, EncodedResponseMatchesToString) {
+  const EncodedResponse& encoded = encoded_stock_response(404);
+  EXPECT_EQ(encoded.bytes("HTTP/1.1", true),
+            STOCK_RESPONSE.at(404).to_string());
+
+  res = STOCK_RESPONSE.at(404);
+  res.headers.push_back({"Connection", "close"});
+  EXPECT_EQ(encoded.bytes("HTTP/1.1", false), res.to_string());
+  EXPECT_EQ(encoded.bytes("HTTP/1.0", false), res.to_string());
+
+  res = STOCK_RESPONSE.at(404);
+  res.headers.push_back({"Connection", "keep-alive"});
+  EXPECT_EQ(encoded.bytes("HTTP/1.0", true), res.to_string());
+
+  // Shared, not rebuilt per call
+  EXPECT_EQ(&encoded_stock_response(404), &encoded);
+  EXPECT_EQ(&encoded.bytes("HTTP/1.1", true), &encoded.bytes("HTTP/1.1", true));
+}
+
+TEST_F(HttpHeaderTestFixture, StockResponsePointsAtItsEncoding) {
+  res = Response::stock(400);
+  EXPECT_EQ(res.encoded(), &encoded_stock_response(400));
+  EXPECT_EQ(res.status_code, 400);
+  EXPECT_EQ(res.body, "400 Bad Request");
+  // The map keeps plain responses
+  EXPECT_EQ(STOCK_RESPONSE.at(400).encoded(), nullptr);
+}
+
+TEST_F(HttpHeaderTestFixture, EditedStockResponseLosesItsEncoding) {
+  Response copy = Response::stock(404);
+  copy.version = "HTTP/1.0";
+  EXPECT_EQ(copy.encoded(), &encoded_stock_response(404));
+
+  res = copy;
+  res.body = "No such short code";
+  EXPECT_EQ(res.encoded(), nullptr);
+  res = copy;
+  res.status_code = 410;
+  EXPECT_EQ(res.encoded(), nullptr);
+  res = copy;
+  res.status_message = "Gone";
+  EXPECT_EQ(res.encoded(), nullptr);
+  res = copy;
+  res.headers.push_back({"Cache-Control", "no-store"});
+  EXPECT_EQ(res.encoded(), nullptr);
+  res = copy;
+  res.headers[0].value = "text/html";
+  EXPECT_EQ(res.encoded(), nullptr);
+}
+
+TEST_F(HttpHeaderTestFixture, OverloadedResponseCarriesRetryAfter) {
+  const std::string& bytes = overloaded_response("HTTP/1.1", false);
+  EXPECT_EQ(bytes.substr(0, 33), "HTTP/1.1 503 Service Unavailable\r");
+  EXPECT_NE(bytes.find("Retry-After: 1\r\n"), std::string::npos);
+  EXPECT_NE(bytes.find("Connection: close\r\n"), std::string::npos);
+}
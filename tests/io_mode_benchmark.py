@@ -0,0 +1,172 @@
+#!/usr/bin/env python3
+"""
+IO Mode Benchmark Script
+
+This script compares the shared io_service mode against the sharded
+(one io_service + SO_REUSEPORT acceptor per thread) mode. For each mode it
+starts the server with a generated config that only serves /health, drives
+it with keep-alive clients and reports throughput and latency percentiles.
+
+Usage (from the build directory):
+    ../tests/io_mode_benchmark.py [--threads N] [--clients C] [--seconds S]
+
+If `wrk` is installed it is used as the load generator, otherwise a
+multiprocessing client written in Python is used (which will saturate long
+before a many-core server does, so prefer wrk for real numbers).
+"""
+
+import argparse
+import multiprocessing
+import os
+import re
+import shutil
+import socket
+import subprocess
+import tempfile
+import time
+
+SERVER_BIN = "bin/server"
+TEST_PORT = 8081
+REQUEST = (
+    "GET /health HTTP/1.1\r\n"
+    "Host: localhost\r\n"
+    "\r\n"
+).encode()
+
+
+def write_config(mode, threads):
+    config = tempfile.NamedTemporaryFile("w", delete=False, suffix="_config")
+    config.write(
+        f"port {TEST_PORT};\n"
+        f"threads {threads};\n"
+        f"io_mode {mode};\n"
+        "\n"
+        "location /health HealthHandler {\n"
+        "}\n"
+    )
+    config.close()
+    return config.name
+
+
+def wait_for_port(timeout=5.0):
+    deadline = time.time() + timeout
+    while time.time() < deadline:
+        try:
+            with socket.create_connection(("127.0.0.1", TEST_PORT), 0.2):
+                return True
+        except OSError:
+            time.sleep(0.05)
+    return False
+
+
+def read_response(sock, buf):
+    # The health handler always answers with a small Content-Length body
+    while b"\r\n\r\n" not in buf:
+        chunk = sock.recv(4096)
+        if not chunk:
+            raise ConnectionError("server closed connection")
+        buf += chunk
+    head, rest = buf.split(b"\r\n\r\n", 1)
+    length = int(re.search(rb"Content-Length: (\d+)", head).group(1))
+    while len(rest) < length:
+        rest += sock.recv(4096)
+    return rest[length:]
+
+
+def client_worker(seconds, queue):
+    latencies = []
+    sock = socket.create_connection(("127.0.0.1", TEST_PORT))
+    sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+    buf = b""
+    deadline = time.time() + seconds
+    while time.time() < deadline:
+        start = time.perf_counter()
+        sock.sendall(REQUEST)
+        buf = read_response(sock, buf)
+        latencies.append(time.perf_counter() - start)
+    sock.close()
+    queue.put(latencies)
+
+
+def run_python_load(clients, seconds):
+    queue = multiprocessing.Queue()
+    procs = [
+        multiprocessing.Process(target=client_worker, args=(seconds, queue))
+        for _ in range(clients)
+    ]
+    for p in procs:
+        p.start()
+    latencies = []
+    for _ in procs:
+        latencies.extend(queue.get())
+    for p in procs:
+        p.join()
+
+    latencies.sort()
+
+    def pct(p):
+        return latencies[min(len(latencies) - 1, int(len(latencies) * p))]
+
+    return {
+        "rps": len(latencies) / seconds,
+        "p50_ms": pct(0.50) * 1000,
+        "p99_ms": pct(0.99) * 1000,
+    }
+
+
+def run_wrk_load(clients, seconds, threads):
+    out = subprocess.run(
+        ["wrk", f"-t{threads}", f"-c{clients}", f"-d{seconds}s", "--latency",
+         f"http://127.0.0.1:{TEST_PORT}/health"],
+        capture_output=True, text=True, check=True).stdout
+
+    def to_ms(value, unit):
+        scale = {"us": 0.001, "ms": 1.0, "s": 1000.0}[unit]
+        return float(value) * scale
+
+    p50 = re.search(r"50%\s+([\d.]+)(us|ms|s)", out)
+    p99 = re.search(r"99%\s+([\d.]+)(us|ms|s)", out)
+    return {
+        "rps": float(re.search(r"Requests/sec:\s+([\d.]+)", out).group(1)),
+        "p50_ms": to_ms(*p50.groups()),
+        "p99_ms": to_ms(*p99.groups()),
+    }
+
+
+def bench_mode(mode, args):
+    config = write_config(mode, args.threads)
+    log = tempfile.TemporaryFile()
+    server = subprocess.Popen([os.path.abspath(SERVER_BIN), config],
+                              stdout=log, stderr=subprocess.STDOUT)
+    try:
+        if not wait_for_port():
+            raise RuntimeError(f"server did not start in {mode} mode")
+        if shutil.which("wrk"):
+            return run_wrk_load(args.clients, args.seconds, args.threads)
+        return run_python_load(args.clients, args.seconds)
+    finally:
+        server.terminate()
+        server.wait()
+        os.unlink(config)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[1])
+    parser.add_argument("--threads", type=int,
+                        default=os.cpu_count() or 2)
+    parser.add_argument("--clients", type=int, default=64)
+    parser.add_argument("--seconds", type=int, default=10)
+    args = parser.parse_args()
+
+    results = {mode: bench_mode(mode, args) for mode in ("shared", "sharded")}
+
+    print(f"threads={args.threads} clients={args.clients} "
+          f"seconds={args.seconds}")
+    print(f"{'mode':<10}{'req/s':>12}{'p50 ms':>10}{'p99 ms':>10}")
+    for mode, r in results.items():
+        print(f"{mode:<10}{r['rps']:>12.0f}{r['p50_ms']:>10.3f}"
+              f"{r['p99_ms']:>10.3f}")
+
+
+if __name__ == "__main__":
+    main()
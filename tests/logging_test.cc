@@ -1,5 +1,9 @@
 // tests/logging_tests.cc
 
+// LOG(trace) in this file is compiled out, unless the build sets a level
+#ifndef CREEPER_MIN_LOG_LEVEL
+#define CREEPER_MIN_LOG_LEVEL 1
+#endif
 #include "logging.h"
 
 #include <gtest/gtest.h>
@@ -7,10 +11,17 @@
 #include <boost/filesystem.hpp>
 #include <boost/log/core.hpp>
 #include <boost/log/trivial.hpp>
+#include <algorithm>
+#include <chrono>
 #include <fstream>
 #include <sstream>
+#include <thread>
 #include <vector>
 
+#include "access_log.h"
+#include "binary_access_log.h"
+#include "mpsc_ring.h"
+
 namespace fs = boost::filesystem;
 using severity_level = boost::log::trivial::severity_level;
 
@@ -58,6 +69,17 @@ TEST_F(LoggingConsoleTest, InfoAndWarningAreCaptured) {
   EXPECT_NE(output.find("WarningCaptured"), std::string::npos);
 }
 
+// LOG does not evaluate its arguments for a level no sink takes
+TEST_F(LoggingConsoleTest, LogSkipsLevelsNoSinkTakes) {
+  int evaluated = 0;
+  auto evaluate = [&evaluated] { return ++evaluated; };
+  LOG(debug) << "Debug argument " << evaluate();
+  EXPECT_EQ(evaluated, 0);
+  LOG(info) << "Info argument " << evaluate();
+  EXPECT_EQ(evaluated, 1);
+  EXPECT_NE(capture_stream.str().find("Info argument 1"), std::string::npos);
+}
+
 // --------------------
 // File-sink tests
 // --------------------
@@ -162,4 +184,355 @@ TEST_F(LoggingFileTest, TraceEnabledLogsTraceAndDebug) {
       << "DEBUG should be logged when CREEPER_LOG_DEBUG=trace";
   EXPECT_NE(out.find("Trace message"), std::string::npos)
       << "TRACE should be logged when CREEPER_LOG_DEBUG=trace";
-}
\ No newline at end of file
+}
+
+// Levels below CREEPER_MIN_LOG_LEVEL are gone whatever the sinks take
+TEST_F(LoggingFileTest, CompiledOutLevelsAreNeverLogged) {
+  setenv("CREEPER_LOG_DEBUG", "trace", /*overwrite=*/1);
+  reinit_file_sink(pattern);
+  unsetenv("CREEPER_LOG_DEBUG");
+
+  int evaluated = 0;
+  auto evaluate = [&evaluated] { return ++evaluated; };
+  LOG(trace) << "Trace argument " << evaluate();
+  LOG(debug) << "Debug argument " << evaluate();
+  boost::log::core::get()->flush();
+
+  std::string out = read_file();
+  bool trace_compiled = boost::log::trivial::trace >= CREEPER_MIN_LOG_LEVEL;
+  bool debug_compiled = boost::log::trivial::debug >= CREEPER_MIN_LOG_LEVEL;
+  EXPECT_EQ(evaluated, int(trace_compiled) + int(debug_compiled));
+  EXPECT_EQ(out.find("Trace argument") != std::string::npos, trace_compiled);
+  EXPECT_EQ(out.find("Debug argument") != std::string::npos, debug_compiled);
+}
+
+// --------------------
+// Asynchronous logging
+// --------------------
+static size_t count_lines_with(const std::string &out,
+                               const std::string &needle) {
+  size_t count = 0;
+  for (size_t pos = out.find(needle); pos != std::string::npos;
+       pos = out.find(needle, pos + 1)) {
+    ++count;
+  }
+  return count;
+}
+
+// Logs per_thread records from each of threads threads at once
+static void log_from_threads(int threads, int per_thread) {
+  std::vector<std::thread> loggers;
+  for (int t = 0; t < threads; ++t) {
+    loggers.emplace_back([per_thread] {
+      for (int i = 0; i < per_thread; ++i) {
+        BOOST_LOG_TRIVIAL(info) << "Async record " << i;
+      }
+    });
+  }
+  for (auto &logger : loggers) {
+    logger.join();
+  }
+}
+
+TEST_F(LoggingFileTest, AsyncBlockWritesEveryRecord) {
+  unsetenv("CREEPER_LOG_DEBUG");
+  logging::AsyncLogOptions async;
+  async.enabled = true;
+  async.queue_size = 16;
+  async.overflow = logging::LogOverflow::BLOCK;
+  logging::init_logging(nullptr, pattern, async);
+  uint64_t dropped = logging::dropped_records();
+
+  log_from_threads(4, 500);
+  BOOST_LOG_TRIVIAL(debug) << "Debug message";
+  boost::log::core::get()->flush();
+
+  std::string out = read_file();
+  EXPECT_EQ(count_lines_with(out, "Async record"), 2000u);
+  EXPECT_EQ(out.find("Debug message"), std::string::npos);
+  EXPECT_EQ(logging::dropped_records(), dropped);
+}
+
+TEST_F(LoggingFileTest, AsyncDropCountsWhatItDrops) {
+  logging::AsyncLogOptions async;
+  async.enabled = true;
+  async.queue_size = 2;
+  async.overflow = logging::LogOverflow::DROP;
+  logging::init_logging(nullptr, pattern, async);
+  uint64_t dropped = logging::dropped_records();
+
+  log_from_threads(4, 2000);
+  boost::log::core::get()->flush();
+
+  std::string out = read_file();
+  EXPECT_EQ(count_lines_with(out, "Async record") +
+                (logging::dropped_records() - dropped),
+            8000u);
+}
+
+TEST(AsyncLoggingConsoleTest, RecordsReachConsoleAfterFlush) {
+  std::ostringstream capture_stream;
+  logging::AsyncLogOptions async;
+  async.enabled = true;
+  logging::init_logging(&capture_stream, "", async);
+
+  BOOST_LOG_TRIVIAL(error) << "Async console message";
+  BOOST_LOG_TRIVIAL(debug) << "Async debug message";
+  boost::log::core::get()->flush();
+  std::string out = capture_stream.str();
+  EXPECT_NE(out.find("Async console message"), std::string::npos);
+  EXPECT_EQ(out.find("Async debug message"), std::string::npos);
+
+  // Replacing the sinks writes out what is still queued
+  BOOST_LOG_TRIVIAL(error) << "Queued at reinit";
+  logging::init_logging(nullptr, "", logging::AsyncLogOptions());
+  EXPECT_NE(capture_stream.str().find("Queued at reinit"), std::string::npos);
+}
+
+TEST(AccessRecordTest, FormatsOnlyTheFieldsThatWereSet) {
+  AccessRecord record;
+  record.method = "GET";
+  record.location = "/s";
+  record.path = "/s/abc123";
+  record.peer = "10.0.0.1";
+  record.handler = "ShortenHandler";
+  record.status_code = 302;
+  record.cache_tier = "redis";
+  record.received = AccessRecord::Clock::time_point(std::chrono::seconds(1));
+  record.dispatched = record.received + std::chrono::microseconds(5);
+  record.answered = record.received + std::chrono::microseconds(42);
+  std::ostringstream out;
+  out << record;
+  EXPECT_EQ(out.str(),
+            "[ResponseMetrics] status_code=302 path=\"/s/abc123\" "
+            "ip=\"10.0.0.1\" handler=\"ShortenHandler\" method=GET "
+            "location=\"/s\" cache=redis handler_us=37 total_us=42");
+
+  // A stream that could not be framed has no request and never ran
+  AccessRecord unframed;
+  unframed.peer = "10.0.0.1";
+  unframed.handler = "InvalidRequest";
+  unframed.status_code = 431;
+  std::ostringstream short_out;
+  short_out << unframed;
+  EXPECT_EQ(short_out.str(),
+            "[ResponseMetrics] status_code=431 path=\"\" ip=\"10.0.0.1\" "
+            "handler=\"InvalidRequest\"");
+}
+
+TEST(AccessRecordTest, EmitLogsOneInfoRecord) {
+  std::ostringstream capture_stream;
+  logging::init_logging(&capture_stream, "", logging::AsyncLogOptions());
+  AccessRecord record;
+  record.path = "/health";
+  record.status_code = 200;
+  record.received = AccessRecord::Clock::now();
+  record.emit();
+  logging::init_logging(nullptr, "", logging::AsyncLogOptions());
+  std::string out = capture_stream.str();
+  EXPECT_EQ(std::count(out.begin(), out.end(), '\n'), 1);
+  EXPECT_NE(out.find("<info>"), std::string::npos);
+  EXPECT_NE(out.find("total_us="), std::string::npos);
+}
+
+// --------------------
+// Binary access log
+// --------------------
+class BinaryAccessLogTest : public LoggingFileTest {
+ protected:
+  void SetUp() override {
+    LoggingFileTest::SetUp();
+    // tmp_dir only holds access logs
+    logging::init_logging(nullptr, "", logging::AsyncLogOptions());
+  }
+
+  std::vector<BinaryAccessEntry> read_entries(const std::string &contents) {
+    std::vector<BinaryAccessEntry> entries;
+    EXPECT_TRUE(for_each_access_entry(
+        contents, [&](const BinaryAccessEntry &entry) {
+          entries.push_back(entry);
+        }));
+    return entries;
+  }
+
+  static AccessRecord make_record(int status_code) {
+    AccessRecord record;
+    record.method = "GET";
+    record.location = "/s";
+    record.path = "/s/abc123";
+    record.peer = "10.0.0.1";
+    record.handler = "ShortenHandler";
+    record.status_code = status_code;
+    record.received = AccessRecord::Clock::now();
+    record.answered = record.received + std::chrono::microseconds(250);
+    return record;
+  }
+};
+
+TEST_F(BinaryAccessLogTest, ReadsBackWhatWasAppended) {
+  AccessRecord redirect = make_record(302);
+  redirect.cache_tier = "redis";
+  redirect.dispatched = redirect.received + std::chrono::microseconds(50);
+  AccessRecord unframed;
+  unframed.peer = "10.0.0.2";
+  unframed.handler = "InvalidRequest";
+  unframed.status_code = 431;
+  {
+    BinaryAccessLog log((tmp_dir / "access").string());
+    log.append(redirect);
+    log.append(unframed);
+  }
+
+  std::string contents = read_file();
+  std::vector<BinaryAccessEntry> entries = read_entries(contents);
+  ASSERT_EQ(entries.size(), 2u);
+  EXPECT_EQ(entries[0].status_code, 302);
+  EXPECT_EQ(entries[0].method, "GET");
+  EXPECT_EQ(entries[0].location, "/s");
+  EXPECT_EQ(entries[0].path, "/s/abc123");
+  EXPECT_EQ(entries[0].peer, "10.0.0.1");
+  EXPECT_EQ(entries[0].handler, "ShortenHandler");
+  EXPECT_EQ(entries[0].cache_tier, "redis");
+  EXPECT_EQ(entries[0].total_us, 250u);
+  EXPECT_EQ(entries[0].handler_us, 200u);
+  EXPECT_GT(entries[0].unix_us, 0u);
+  EXPECT_EQ(entries[1].status_code, 431);
+  EXPECT_EQ(entries[1].path, "");
+  EXPECT_EQ(entries[1].handler_us, ACCESS_LOG_NO_HANDLER);
+
+  // A record cut short is not read
+  contents.pop_back();
+  size_t visited = 0;
+  EXPECT_FALSE(for_each_access_entry(
+      contents, [&](const BinaryAccessEntry &) { ++visited; }));
+  EXPECT_EQ(visited, 1u);
+  EXPECT_FALSE(for_each_access_entry("not a log", [](auto &) {}));
+}
+
+TEST_F(BinaryAccessLogTest, RotatesAtSize) {
+  std::string encoded;
+  BinaryAccessLog::encode(make_record(200), 0, encoded);
+  // Three records to a file, each appended batch written at once
+  size_t rotation = ACCESS_LOG_MAGIC_SIZE + 3 * encoded.size();
+  {
+    BinaryAccessLog log((tmp_dir / "access").string(), rotation, 1);
+    for (int i = 0; i < 10; ++i) {
+      log.append(make_record(200 + i));
+    }
+  }
+
+  std::vector<std::string> files;
+  for (auto &ent : fs::directory_iterator(tmp_dir)) {
+    if (ent.path().extension() == ".bin") {
+      files.push_back(ent.path().string());
+    }
+  }
+  std::sort(files.begin(), files.end());
+  ASSERT_EQ(files.size(), 4u);
+  std::vector<int> statuses;
+  for (const std::string &file : files) {
+    std::ifstream in(file, std::ios::binary);
+    std::string contents((std::istreambuf_iterator<char>(in)),
+                         std::istreambuf_iterator<char>());
+    EXPECT_LE(contents.size(), rotation);
+    for (const BinaryAccessEntry &entry : read_entries(contents)) {
+      statuses.push_back(entry.status_code);
+    }
+  }
+  std::sort(statuses.begin(), statuses.end());
+  ASSERT_EQ(statuses.size(), 10u);
+  EXPECT_EQ(statuses.front(), 200);
+  EXPECT_EQ(statuses.back(), 209);
+}
+
+TEST_F(BinaryAccessLogTest, WritesWithinASecondWithoutMoreAppends) {
+  BinaryAccessLog log((tmp_dir / "access").string());
+  auto appended = std::chrono::steady_clock::now();
+  log.append(make_record(200));
+  // Far below the batch size, and nothing else is appended
+  std::string contents;
+  while (std::chrono::steady_clock::now() - appended <
+         std::chrono::seconds(3)) {
+    std::ifstream in(log.current_file(), std::ios::binary);
+    contents.assign(std::istreambuf_iterator<char>(in),
+                    std::istreambuf_iterator<char>());
+    if (contents.size() > ACCESS_LOG_MAGIC_SIZE) {
+      break;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  }
+  EXPECT_LT(std::chrono::steady_clock::now() - appended,
+            std::chrono::milliseconds(1500));
+  EXPECT_EQ(read_entries(contents).size(), 1u);
+  EXPECT_EQ(log.dropped(), 0u);
+}
+
+TEST_F(BinaryAccessLogTest, EmitSkipsTheTextLogWhileSet) {
+  std::ostringstream capture_stream;
+  logging::init_logging(&capture_stream, "", logging::AsyncLogOptions());
+  auto log = std::make_shared<BinaryAccessLog>((tmp_dir / "access").string());
+  set_binary_access_log(log);
+  make_record(200).emit();
+  set_binary_access_log(nullptr);
+  make_record(404).emit();
+  logging::init_logging(nullptr, "", logging::AsyncLogOptions());
+
+  std::vector<BinaryAccessEntry> entries = read_entries(read_file());
+  ASSERT_EQ(entries.size(), 1u);
+  EXPECT_EQ(entries[0].status_code, 200);
+  EXPECT_EQ(count_lines_with(capture_stream.str(), "[ResponseMetrics]"), 1u);
+  EXPECT_NE(capture_stream.str().find("status_code=404"), std::string::npos);
+}
+
+TEST(MpscRingTest, RoundsCapacityUpAndReportsFull) {
+  MpscRing<int> ring(5);
+  EXPECT_EQ(ring.capacity(), 8u);
+  for (int i = 0; i < 8; ++i) {
+    EXPECT_TRUE(ring.try_push(int(i)));
+  }
+  EXPECT_FALSE(ring.try_push(8));
+  int value = -1;
+  for (int i = 0; i < 8; ++i) {
+    ASSERT_TRUE(ring.try_pop(value));
+    EXPECT_EQ(value, i);
+  }
+  EXPECT_TRUE(ring.empty());
+  EXPECT_FALSE(ring.try_pop(value));
+}
+
+TEST(MpscRingTest, EveryPushFromManyThreadsIsPoppedOnce) {
+  MpscRing<int> ring(64);
+  const int kThreads = 4;
+  const int kPerThread = 5000;
+  std::vector<std::thread> producers;
+  for (int t = 0; t < kThreads; ++t) {
+    producers.emplace_back([&ring, t] {
+      for (int i = 0; i < kPerThread; ++i) {
+        int value = t * kPerThread + i;
+        while (!ring.try_push(std::move(value))) {
+          std::this_thread::yield();
+        }
+      }
+    });
+  }
+  std::vector<int> popped;
+  std::vector<int> last(kThreads, -1);
+  bool ordered = true;
+  while (popped.size() < size_t(kThreads * kPerThread)) {
+    int value;
+    if (ring.try_pop(value)) {
+      // Each producer's values come out in the order it pushed them
+      ordered &= value > last[value / kPerThread];
+      last[value / kPerThread] = value;
+      popped.push_back(value);
+    }
+  }
+  for (auto &producer : producers) {
+    producer.join();
+  }
+  EXPECT_TRUE(ordered);
+  std::sort(popped.begin(), popped.end());
+  for (int i = 0; i < kThreads * kPerThread; ++i) {
+    ASSERT_EQ(popped[i], i);
+  }
+}
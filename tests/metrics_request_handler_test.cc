@@ -0,0 +1,240 @@
+#include "metrics_request_handler.h"
+
+#include <chrono>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "http_header.h"
+#include "latency_histogram.h"
+#include "metrics.h"
+
+class MetricsRequestHandlerTestFixture : public ::testing::Test {
+ protected:
+  MetricsRequestHandler handler =
+      MetricsRequestHandler("", std::make_shared<MetricsRequestHandlerArgs>());
+  NginxConfigParser parser = NginxConfigParser();
+  NginxConfig config;
+};
+
+TEST_F(MetricsRequestHandlerTestFixture, AnswersWithTextExposition) {
+  Request req;
+  req.valid = true;
+  req.version = "HTTP/1.1";
+  req.method = "GET";
+  req.uri = "/metrics";
+
+  std::unique_ptr<Response> res = handler.handle_request(req);
+
+  EXPECT_EQ(res->status_code, 200);
+  EXPECT_EQ(res->version, "HTTP/1.1");
+  EXPECT_EQ(res->headers[0].name, "Content-Type");
+  EXPECT_EQ(res->headers[0].value, "text/plain; version=0.0.4");
+  EXPECT_NE(res->body.find("# TYPE creeper_requests_total counter\n"),
+            std::string::npos);
+  EXPECT_NE(res->body.find("# TYPE creeper_open_sessions gauge\n"),
+            std::string::npos);
+  EXPECT_EQ(handler.get_type(),
+            RequestHandler::HandlerType::METRICS_REQUEST_HANDLER);
+}
+
+TEST_F(MetricsRequestHandlerTestFixture, FormatsEverySample) {
+  metrics::Snapshot snapshot;
+  snapshot.requests[static_cast<int>(
+      RequestHandler::HandlerType::ECHO_REQUEST_HANDLER)][200 -
+                                                          MIN_STATUS_CODE] = 7;
+  snapshot.requests[METRICS_HANDLER_SLOTS - 1][404 - MIN_STATUS_CODE] = 2;
+  snapshot.counters[static_cast<size_t>(metrics::Counter::BYTES_RECEIVED)] = 10;
+  snapshot.counters[static_cast<size_t>(metrics::Counter::SESSIONS_OPENED)] = 5;
+  snapshot.counters[static_cast<size_t>(metrics::Counter::SESSIONS_CLOSED)] = 3;
+  snapshot.counters[static_cast<size_t>(metrics::Counter::REDIS_CALLS)] = 4;
+
+  std::string body = MetricsRequestHandler::format(snapshot);
+
+  EXPECT_NE(
+      body.find("creeper_requests_total{handler=\"EchoHandler\",code=\"200\"} "
+                "7\n"),
+      std::string::npos);
+  EXPECT_NE(body.find("creeper_requests_total{handler=\"none\",code=\"404\"} "
+                      "2\n"),
+            std::string::npos);
+  // Handlers and codes nothing was counted for are left out
+  EXPECT_EQ(body.find("code=\"500\""), std::string::npos);
+  EXPECT_NE(body.find("creeper_received_bytes_total 10\n"), std::string::npos);
+  EXPECT_NE(body.find("creeper_open_sessions 2\n"), std::string::npos);
+  EXPECT_NE(body.find("creeper_backend_calls_total{backend=\"redis\"} 4\n"),
+            std::string::npos);
+}
+
+TEST_F(MetricsRequestHandlerTestFixture, ValidMetricsConfig) {
+  EXPECT_TRUE(
+      parser.parse("request_handler_testcases/valid_metrics_config", &config));
+  EXPECT_NE(MetricsRequestHandlerArgs::create_from_config(config.statements_[0]),
+            nullptr);
+}
+
+TEST_F(MetricsRequestHandlerTestFixture, InvalidMetricsConfig) {
+  EXPECT_TRUE(parser.parse("request_handler_testcases/invalid_metrics_config",
+                           &config));
+  EXPECT_EQ(MetricsRequestHandlerArgs::create_from_config(config.statements_[0]),
+            nullptr);
+}
+
+TEST(MetricsTest, SumsCountsOfLiveAndExitedThreads) {
+  metrics::Snapshot before = metrics::collect();
+  const int kThreads = 4;
+  const int kPerThread = 1000;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; ++t) {
+    threads.emplace_back([] {
+      for (int i = 0; i < kPerThread; ++i) {
+        metrics::add(metrics::Counter::BYTES_SENT, 3);
+        metrics::count_request(
+            RequestHandler::HandlerType::HEALTH_REQUEST_HANDLER, 200);
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  metrics::add(metrics::Counter::BYTES_SENT, 1);
+  metrics::count_request(std::nullopt, 503);
+
+  metrics::Snapshot after = metrics::collect();
+  EXPECT_EQ(after[metrics::Counter::BYTES_SENT] -
+                before[metrics::Counter::BYTES_SENT],
+            3u * kThreads * kPerThread + 1);
+  int health =
+      static_cast<int>(RequestHandler::HandlerType::HEALTH_REQUEST_HANDLER);
+  EXPECT_EQ(after.requests[health][200 - MIN_STATUS_CODE] -
+                before.requests[health][200 - MIN_STATUS_CODE],
+            static_cast<uint64_t>(kThreads * kPerThread));
+  EXPECT_EQ(after.requests[METRICS_HANDLER_SLOTS - 1][503 - MIN_STATUS_CODE] -
+                before.requests[METRICS_HANDLER_SLOTS - 1]
+                               [503 - MIN_STATUS_CODE],
+            1u);
+}
+
+TEST(MetricsTest, IgnoresStatusCodesOutOfRange) {
+  metrics::Snapshot before = metrics::collect();
+  metrics::count_request(std::nullopt, 99);
+  metrics::count_request(std::nullopt, 600);
+  metrics::Snapshot after = metrics::collect();
+  EXPECT_EQ(after.requests, before.requests);
+}
+
+TEST(LatencyHistogramTest, PercentilesAreWithinABucket) {
+  LatencyHistogram histogram;
+  for (uint32_t micros = 1; micros <= 10000; ++micros) {
+    histogram.record(micros);
+  }
+  EXPECT_EQ(histogram.count(), 10000u);
+  EXPECT_EQ(histogram.sum(), 10000u * 10001u / 2);
+  for (double q : {0.5, 0.9, 0.99, 0.999}) {
+    double exact = q * 10000;
+    EXPECT_GE(histogram.percentile(q), exact);
+    EXPECT_LE(histogram.percentile(q), exact * 1.07);
+  }
+  // Small values get a bucket each
+  LatencyHistogram small;
+  small.record(3);
+  EXPECT_EQ(small.percentile(0.5), 3u);
+  EXPECT_EQ(LatencyHistogram().percentile(0.5), 0u);
+  EXPECT_LT(LatencyHistogram::bucket_of(UINT32_MAX), LatencyHistogram::BUCKETS);
+}
+
+TEST(LatencyHistogramTest, MergeAddsBuckets) {
+  LatencyHistogram fast;
+  LatencyHistogram slow;
+  for (int i = 0; i < 99; ++i) {
+    fast.record(10);
+  }
+  slow.record(5000);
+  fast.merge(slow);
+  EXPECT_EQ(fast.count(), 100u);
+  EXPECT_EQ(fast.percentile(0.5), 10u);
+  EXPECT_GE(fast.percentile(0.995), 5000u);
+}
+
+// A request that spent 2us parsing, 3us waiting, 40us in its handler and
+// 5us being written
+metrics::RequestTimer timer_at(metrics::RequestTimer::Clock::time_point start,
+                               int location, int handler) {
+  using std::chrono::microseconds;
+  metrics::RequestTimer timer;
+  timer.location = location;
+  timer.handler = handler;
+  timer.parse_started = start;
+  timer.parsed = start + microseconds(2);
+  timer.dispatched = timer.parsed + microseconds(3);
+  timer.answered = timer.dispatched + microseconds(40);
+  return timer;
+}
+
+TEST(MetricsTest, TimesEveryStageByLocationAndHandler) {
+  int location = metrics::location_index("/timed");
+  EXPECT_EQ(metrics::location_index("/timed"), location);
+  int shorten =
+      static_cast<int>(RequestHandler::HandlerType::SHORTEN_REQUEST_HANDLER);
+  auto start = metrics::RequestTimer::Clock::now();
+
+  const int kThreads = 4;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; ++t) {
+    threads.emplace_back([&] {
+      metrics::RequestTimer timer = timer_at(start, location, shorten);
+      timer.record(timer.answered + std::chrono::microseconds(5));
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  // Answered without reaching a handler: no dispatch or handler stage
+  metrics::RequestTimer shed = timer_at(start, location, -1);
+  shed.dispatched = {};
+  shed.record(shed.answered);
+
+  metrics::Snapshot snapshot = metrics::collect();
+  ASSERT_GT(snapshot.locations.size(), static_cast<size_t>(location));
+  EXPECT_EQ(snapshot.locations[location].location, "/timed");
+  const metrics::StageLatencies& stages = snapshot.locations[location].stages;
+  auto stage = [&](const metrics::StageLatencies& latencies,
+                   metrics::Stage s) -> const LatencyHistogram& {
+    return latencies[static_cast<size_t>(s)];
+  };
+  EXPECT_EQ(stage(stages, metrics::Stage::PARSE).count(), kThreads + 1u);
+  EXPECT_EQ(stage(stages, metrics::Stage::PARSE).percentile(0.5), 2u);
+  EXPECT_EQ(stage(stages, metrics::Stage::DISPATCH).count(),
+            static_cast<uint64_t>(kThreads));
+  EXPECT_EQ(stage(stages, metrics::Stage::DISPATCH).percentile(0.5), 3u);
+  EXPECT_EQ(stage(stages, metrics::Stage::HANDLER).sum(), 40u * kThreads);
+  EXPECT_EQ(stage(stages, metrics::Stage::WRITE).percentile(0.99), 5u);
+  EXPECT_EQ(stage(stages, metrics::Stage::TOTAL).count(), kThreads + 1u);
+
+  const metrics::StageLatencies& handler = snapshot.handlers[shorten];
+  EXPECT_EQ(stage(handler, metrics::Stage::TOTAL).count(),
+            static_cast<uint64_t>(kThreads));
+  EXPECT_EQ(stage(handler, metrics::Stage::TOTAL).sum(), 50u * kThreads);
+
+  std::ostringstream report;
+  metrics::write_latency_report(report, snapshot);
+  EXPECT_NE(report.str().find("/timed"), std::string::npos);
+  EXPECT_NE(report.str().find("ShortenHandler"), std::string::npos);
+
+  std::string body = MetricsRequestHandler::format(snapshot);
+  EXPECT_NE(body.find("# TYPE creeper_location_latency_microseconds "
+                      "summary\n"),
+            std::string::npos);
+  // Reported as the upper end of 40's bucket
+  EXPECT_NE(body.find("creeper_location_latency_microseconds{location=\"/"
+                      "timed\",stage=\"handler\",quantile=\"0.99\"} " +
+                      std::to_string(LatencyHistogram::upper_bound(
+                          LatencyHistogram::bucket_of(40))) +
+                      "\n"),
+            std::string::npos);
+  EXPECT_NE(body.find("creeper_handler_latency_microseconds_count{handler=\""
+                      "ShortenHandler\",stage=\"total\"} 4\n"),
+            std::string::npos);
+}
@@ -46,6 +46,13 @@ TEST_F(RegistryTest, BuiltInCreateFromConfigRegistration) {
   ASSERT_NE(create_from_config_fn, nullptr);
 }
 
+TEST_F(RegistryTest, HandlerLifecycle) {
+  EXPECT_EQ(Registry::get_lifecycle("EchoHandler"), HandlerLifecycle::SHARED);
+  // Handlers registered without one are built per request
+  EXPECT_EQ(Registry::get_lifecycle("NoSuchHandler"),
+            HandlerLifecycle::PER_REQUEST);
+}
+
 TEST_F(RegistryTest, NonexistentFactory) {
   EXPECT_EQ(Registry::get_handler_factory("NoSuchHandler"), nullptr);
 }
@@ -0,0 +1,94 @@
+#include "request_arena.h"
+
+#include <memory>
+#include <memory_resource>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+class RequestArenaTest : public ::testing::Test {
+ protected:
+  // Counters gathered since the test started
+  ArenaCounters delta() {
+    ArenaCounters now = RequestArena::counters();
+    return {now.allocations - before.allocations, now.bytes - before.bytes,
+            now.heap_allocations - before.heap_allocations,
+            now.resets - before.resets,
+            now.deferred_resets - before.deferred_resets};
+  }
+
+  ArenaCounters before = RequestArena::counters();
+};
+
+TEST_F(RequestArenaTest, ServesFromItsBuffer) {
+  RequestArena arena(1024);
+  std::pmr::vector<int> numbers(&arena);
+  numbers.reserve(16);
+  for (int i = 0; i < 16; ++i) {
+    numbers.push_back(i);
+  }
+  EXPECT_EQ(numbers[15], 15);
+  EXPECT_EQ(arena.live(), 1u);
+  numbers = std::pmr::vector<int>(&arena);
+  EXPECT_EQ(arena.live(), 0u);
+  EXPECT_TRUE(arena.reset());
+
+  ArenaCounters counted = delta();
+  EXPECT_EQ(counted.allocations, 1u);
+  EXPECT_EQ(counted.bytes, 16 * sizeof(int));
+  EXPECT_EQ(counted.heap_allocations, 0u);
+  EXPECT_EQ(counted.resets, 1u);
+}
+
+TEST_F(RequestArenaTest, BorrowsFromHeapOnceFullUntilReset) {
+  RequestArena arena(256);
+  for (int round = 0; round < 3; ++round) {
+    std::vector<std::string *> strings;
+    for (int i = 0; i < 12; ++i) {
+      strings.push_back(arena.create<std::string>(40, 'x'));
+    }
+    // The strings' own characters come from the heap; only the objects
+    // live in the arena
+    EXPECT_EQ(*strings[11], std::string(40, 'x'));
+    for (std::string *s : strings) {
+      arena.destroy(s);
+    }
+    EXPECT_TRUE(arena.reset());
+  }
+  ArenaCounters counted = delta();
+  EXPECT_EQ(counted.allocations, 36u);
+  // 12 strings overflow 256 bytes once per round, and a reset gives the
+  // borrowed block back
+  EXPECT_GE(counted.heap_allocations, 3u);
+  EXPECT_LE(counted.heap_allocations, 6u);
+  EXPECT_EQ(counted.resets, 3u);
+}
+
+TEST_F(RequestArenaTest, ReusesBufferAfterReset) {
+  RequestArena arena(512);
+  void *first = arena.allocate(100);
+  arena.deallocate(first, 100);
+  ASSERT_TRUE(arena.reset());
+  void *second = arena.allocate(100);
+  EXPECT_EQ(first, second);
+  arena.deallocate(second, 100);
+}
+
+TEST_F(RequestArenaTest, DefersResetWhileAllocationAlive) {
+  RequestArena arena(512);
+  int *value = arena.create<int>(7);
+  EXPECT_FALSE(arena.reset());
+  // Still intact, not handed out again
+  int *other = arena.create<int>(8);
+  EXPECT_NE(value, other);
+  EXPECT_EQ(*value, 7);
+  arena.destroy(other);
+
+  // The last reference may go away on another thread
+  std::thread([&] { arena.destroy(value); }).join();
+  EXPECT_EQ(arena.live(), 0u);
+  EXPECT_TRUE(arena.reset());
+  EXPECT_EQ(delta().deferred_resets, 1u);
+}
@@ -0,0 +1,134 @@
+#include "request_framer.h"
+
+#include <algorithm>
+#include <string>
+
+#include "gtest/gtest.h"
+
+class RequestFramerTest : public ::testing::Test {
+ protected:
+  // Simulate one socket read delivering s
+  void feed(const std::string& s) {
+    std::copy(s.begin(), s.end(), framer.prepare(s.size()));
+    framer.commit(s.size());
+  }
+
+  RequestFramer framer;
+};
+
+TEST_F(RequestFramerTest, CompleteRequestInOneRead) {
+  std::string request = "GET /echo HTTP/1.1\r\nHost: a\r\n\r\n";
+  feed(request);
+  ASSERT_EQ(framer.next(), RequestFramer::Status::COMPLETE);
+  EXPECT_EQ(framer.take(), request);
+  EXPECT_EQ(framer.buffered(), 0u);
+}
+
+TEST_F(RequestFramerTest, RequestSplitAcrossReads) {
+  std::string request =
+      "POST /api/shoes HTTP/1.1\r\nContent-Length: 5\r\n\r\nhello";
+  for (char c : request) {
+    EXPECT_EQ(framer.next(), RequestFramer::Status::INCOMPLETE);
+    feed(std::string(1, c));
+  }
+  ASSERT_EQ(framer.next(), RequestFramer::Status::COMPLETE);
+  EXPECT_EQ(framer.take(), request);
+}
+
+TEST_F(RequestFramerTest, LargeBodyGrowsBuffer) {
+  std::string body(100 * 1024, 'x');
+  std::string request = "POST /shorten HTTP/1.1\r\nContent-Length: " +
+                        std::to_string(body.size()) + "\r\n\r\n" + body;
+  for (size_t i = 0; i < request.size(); i += DEFAULT_READ_SIZE) {
+    EXPECT_EQ(framer.next(), RequestFramer::Status::INCOMPLETE);
+    feed(request.substr(i, DEFAULT_READ_SIZE));
+  }
+  ASSERT_EQ(framer.next(), RequestFramer::Status::COMPLETE);
+  EXPECT_EQ(framer.take(), request);
+}
+
+TEST_F(RequestFramerTest, KeepsBytesOfFollowingRequest) {
+  std::string first = "POST /api/a HTTP/1.1\r\nContent-Length: 2\r\n\r\n{}";
+  std::string second = "GET /health HTTP/1.1\r\n\r\n";
+  feed(first + second.substr(0, 10));
+  ASSERT_EQ(framer.next(), RequestFramer::Status::COMPLETE);
+  EXPECT_EQ(framer.take(), first);
+  EXPECT_EQ(framer.next(), RequestFramer::Status::INCOMPLETE);
+  feed(second.substr(10));
+  ASSERT_EQ(framer.next(), RequestFramer::Status::COMPLETE);
+  EXPECT_EQ(framer.take(), second);
+}
+
+TEST_F(RequestFramerTest, ChunkedBody) {
+  std::string request =
+      "POST /api/a HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n"
+      "5\r\nhello\r\n6;ext=1\r\n world\r\n0\r\n\r\n";
+  feed(request.substr(0, request.size() - 3));
+  EXPECT_EQ(framer.next(), RequestFramer::Status::INCOMPLETE);
+  feed(request.substr(request.size() - 3));
+  ASSERT_EQ(framer.next(), RequestFramer::Status::COMPLETE);
+  EXPECT_EQ(framer.take(), request);
+}
+
+TEST_F(RequestFramerTest, HeadersTooLarge) {
+  feed("GET / HTTP/1.1\r\nX-Big: " + std::string(DEFAULT_MAX_HEADER_SIZE, 'a'));
+  EXPECT_EQ(framer.next(), RequestFramer::Status::HEADERS_TOO_LARGE);
+}
+
+TEST_F(RequestFramerTest, TrailersTooLarge) {
+  feed("POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n0\r\n");
+  // Each line is short, but together they pass max_header_size
+  std::string trailer = "X-Trailer: " + std::string(100, 'a') + "\r\n";
+  RequestFramer::Status status = RequestFramer::Status::INCOMPLETE;
+  size_t sent = 0;
+  while (status == RequestFramer::Status::INCOMPLETE &&
+         sent <= 2 * DEFAULT_MAX_HEADER_SIZE) {
+    feed(trailer);
+    sent += trailer.size();
+    status = framer.next();
+  }
+  EXPECT_EQ(status, RequestFramer::Status::HEADERS_TOO_LARGE);
+  EXPECT_LE(sent, DEFAULT_MAX_HEADER_SIZE + trailer.size());
+}
+
+TEST_F(RequestFramerTest, BodyTooLarge) {
+  feed("POST / HTTP/1.1\r\nContent-Length: " +
+       std::to_string(DEFAULT_MAX_BODY_SIZE + 1) + "\r\n\r\n");
+  EXPECT_EQ(framer.next(), RequestFramer::Status::BODY_TOO_LARGE);
+}
+
+TEST_F(RequestFramerTest, InvalidContentLength) {
+  feed("POST / HTTP/1.1\r\nContent-Length: ten\r\n\r\n");
+  EXPECT_EQ(framer.next(), RequestFramer::Status::INVALID);
+}
+
+TEST_F(RequestFramerTest, ContentLengthWithChunkedIsInvalid) {
+  feed(
+      "POST / HTTP/1.1\r\nContent-Length: 5\r\n"
+      "Transfer-Encoding: chunked\r\n\r\n");
+  EXPECT_EQ(framer.next(), RequestFramer::Status::INVALID);
+}
+
+TEST_F(RequestFramerTest, ResetDropsBufferedBytes) {
+  feed("GET / HTTP/1.1\r\n");
+  framer.reset();
+  EXPECT_EQ(framer.buffered(), 0u);
+  std::string request = "GET /health HTTP/1.1\r\n\r\n";
+  feed(request);
+  ASSERT_EQ(framer.next(), RequestFramer::Status::COMPLETE);
+  EXPECT_EQ(framer.take(), request);
+}
+
+TEST_F(RequestFramerTest, TakeViewPointsIntoBuffer) {
+  std::string first = "GET /a HTTP/1.1\r\n\r\n";
+  std::string second = "GET /b HTTP/1.1\r\n\r\n";
+  feed(first + second);
+  ASSERT_EQ(framer.next(), RequestFramer::Status::COMPLETE);
+  std::string_view a = framer.take_view();
+  ASSERT_EQ(framer.next(), RequestFramer::Status::COMPLETE);
+  std::string_view b = framer.take_view();
+  // Both stay valid until the buffer is next prepared
+  EXPECT_EQ(a, first);
+  EXPECT_EQ(b, second);
+  EXPECT_EQ(a.data() + a.size(), b.data());
+}
@@ -1,14 +1,59 @@
 #include "request_handler_dispatcher.h"
 
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <future>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 #include "config_parser.h"
 #include "echo_request_handler.h"
 #include "gtest/gtest.h"
 #include "http_header.h"
 #include "registry.h"
+#include "route_trie.h"
 #include "static_request_handler.h"
 
+class LifecycleTestHandlerArgs : public RequestHandlerArgs {
+ public:
+  static std::shared_ptr<LifecycleTestHandlerArgs> create_from_config(
+      std::shared_ptr<NginxConfigStatement> statement) {
+    return std::make_shared<LifecycleTestHandlerArgs>();
+  }
+};
+
+// Counts how often the dispatcher builds it
+class PerRequestTestHandler : public RequestHandler {
+ public:
+  PerRequestTestHandler(const std::string& base_uri,
+                        std::shared_ptr<LifecycleTestHandlerArgs> args) {
+    ++built;
+  }
+  std::unique_ptr<Response> handle_request(const Request& req) override {
+    return std::make_unique<Response>(Response::stock(404));
+  }
+  HandlerType get_type() const override {
+    return HandlerType::NOT_FOUND_REQUEST_HANDLER;
+  }
+  static inline std::atomic<int> built{0};
+};
+
+class PerThreadTestHandler : public PerRequestTestHandler {
+ public:
+  using PerRequestTestHandler::PerRequestTestHandler;
+  ~PerThreadTestHandler() override { ++destroyed; }
+  static inline std::atomic<int> destroyed{0};
+};
+
+REGISTER_HANDLER("PerRequestTestHandler", PerRequestTestHandler,
+                 LifecycleTestHandlerArgs);
+REGISTER_HANDLER_WITH_LIFECYCLE("PerThreadTestHandler", PerThreadTestHandler,
+                                LifecycleTestHandlerArgs, PER_THREAD);
+
 class RequestHandlerDispatcherTestFixtrue : public ::testing::Test {
  protected:
   std::shared_ptr<RequestHandlerDispatcher> dispatcher;
@@ -82,6 +127,32 @@ TEST_F(RequestHandlerDispatcherTestFixtrue, GetEchoHandlerWithTrailingSlash) {
             RequestHandler::HandlerType::ECHO_REQUEST_HANDLER);
 }
 
+TEST_F(RequestHandlerDispatcherTestFixtrue, NestedLocationsLongestMatch) {
+  parser.parse("dispatcher_testcases/nested_locations", &config);
+  dispatcher = std::make_shared<RequestHandlerDispatcher>(config);
+
+  req.uri = "/echo/health/now";
+  EXPECT_EQ(dispatcher->get_handler(req)->get_type(),
+            RequestHandler::HandlerType::HEALTH_REQUEST_HANDLER);
+  // Diverges from /echo/health partway through its label
+  req.uri = "/echo/heal";
+  EXPECT_EQ(dispatcher->get_handler(req)->get_type(),
+            RequestHandler::HandlerType::ECHO_REQUEST_HANDLER);
+  req.uri = "/ech";
+  EXPECT_EQ(dispatcher->get_handler(req)->get_type(),
+            RequestHandler::HandlerType::NOT_FOUND_REQUEST_HANDLER);
+}
+
+TEST_F(RequestHandlerDispatcherTestFixtrue, NoMatchingLocation) {
+  parser.parse("dispatcher_testcases/echo_handler", &config);
+  dispatcher = std::make_shared<RequestHandlerDispatcher>(config);
+
+  req.uri = "/static";
+  EXPECT_FALSE(dispatcher->get_handler(req));
+  EXPECT_EQ(dispatcher->get_handler_pool(req), nullptr);
+  EXPECT_EQ(dispatcher->get_inflight_limiter(req), nullptr);
+}
+
 TEST_F(RequestHandlerDispatcherTestFixtrue, InvalidStaticHandlerFilePath) {
   req.uri = "/static";
   parser.parse("dispatcher_testcases/invalid_static_file_path", &config);
@@ -117,4 +188,366 @@ TEST_F(RequestHandlerDispatcherTestFixtrue, QuotedRootPath) {
   parser.parse("dispatcher_testcases/quoted_root_path", &config);
   EXPECT_THROW(dispatcher = std::make_shared<RequestHandlerDispatcher>(config),
                std::runtime_error);
-}
\ No newline at end of file
+}
+TEST_F(RequestHandlerDispatcherTestFixtrue, HandlerPoolPerLocation) {
+  parser.parse("dispatcher_testcases/handler_pool", &config);
+  dispatcher = std::make_shared<RequestHandlerDispatcher>(config);
+
+  req.uri = "/sleep";
+  auto pool = dispatcher->get_handler_pool(req);
+  ASSERT_NE(pool, nullptr);
+  EXPECT_EQ(pool->num_threads(), 4);
+  EXPECT_EQ(pool->max_queue_size(), 16);
+  EXPECT_EQ(dispatcher->get_handler(req)->get_type(),
+            RequestHandler::HandlerType::BLOCKING_REQUEST_HANDLER);
+
+  req.uri = "/echo";
+  EXPECT_EQ(dispatcher->get_handler_pool(req), nullptr);
+}
+
+TEST_F(RequestHandlerDispatcherTestFixtrue, InflightLimiterPerLocation) {
+  parser.parse("dispatcher_testcases/admission", &config);
+  dispatcher = std::make_shared<RequestHandlerDispatcher>(config);
+
+  req.uri = "/sleep";
+  auto limiter = dispatcher->get_inflight_limiter(req);
+  ASSERT_NE(limiter, nullptr);
+  EXPECT_TRUE(limiter->try_acquire());
+  EXPECT_TRUE(limiter->try_acquire());
+  EXPECT_FALSE(limiter->try_acquire());
+
+  req.uri = "/echo";
+  EXPECT_EQ(dispatcher->get_inflight_limiter(req), nullptr);
+}
+
+TEST_F(RequestHandlerDispatcherTestFixtrue, SharedHandlerBuiltOnce) {
+  parser.parse("dispatcher_testcases/handler_lifecycles", &config);
+  dispatcher = std::make_shared<RequestHandlerDispatcher>(config);
+
+  req.uri = "/echo";
+  HandlerRef first = dispatcher->get_handler(req);
+  HandlerRef second = dispatcher->get_handler(req);
+  ASSERT_TRUE(first);
+  EXPECT_FALSE(first.owned());
+  EXPECT_EQ(first.get(), second.get());
+  EXPECT_EQ(first->get_type(),
+            RequestHandler::HandlerType::ECHO_REQUEST_HANDLER);
+}
+
+TEST_F(RequestHandlerDispatcherTestFixtrue, PerRequestHandlerBuiltEachTime) {
+  parser.parse("dispatcher_testcases/handler_lifecycles", &config);
+  dispatcher = std::make_shared<RequestHandlerDispatcher>(config);
+
+  req.uri = "/per_request";
+  int built = PerRequestTestHandler::built;
+  HandlerRef first = dispatcher->get_handler(req);
+  HandlerRef second = dispatcher->get_handler(req);
+  EXPECT_TRUE(first.owned());
+  EXPECT_NE(first.get(), second.get());
+  EXPECT_EQ(PerRequestTestHandler::built, built + 2);
+}
+
+TEST_F(RequestHandlerDispatcherTestFixtrue, PerThreadHandlerBuiltPerThread) {
+  parser.parse("dispatcher_testcases/handler_lifecycles", &config);
+  dispatcher = std::make_shared<RequestHandlerDispatcher>(config);
+
+  req.uri = "/per_thread";
+  int built = PerRequestTestHandler::built;
+  HandlerRef first = dispatcher->get_handler(req);
+  HandlerRef second = dispatcher->get_handler(req);
+  EXPECT_FALSE(first.owned());
+  EXPECT_EQ(first.get(), second.get());
+  EXPECT_EQ(PerRequestTestHandler::built, built + 1);
+
+  RequestHandler* other_thread = nullptr;
+  std::thread([&] { other_thread = dispatcher->get_handler(req).get(); })
+      .join();
+  EXPECT_NE(other_thread, first.get());
+  EXPECT_EQ(PerRequestTestHandler::built, built + 2);
+
+  // A new dispatcher never inherits the old one's handler, even if its
+  // route lands at the same address
+  dispatcher = nullptr;
+  dispatcher = std::make_shared<RequestHandlerDispatcher>(config);
+  dispatcher->get_handler(req);
+  EXPECT_EQ(PerRequestTestHandler::built, built + 3);
+}
+
+TEST_F(RequestHandlerDispatcherTestFixtrue, ReloadDropsOldPerThreadHandlers) {
+  parser.parse("dispatcher_testcases/handler_lifecycles", &config);
+  dispatcher = std::make_shared<RequestHandlerDispatcher>(config);
+
+  RequestView view;
+  view.uri = "/per_thread";
+  RoutePtr in_use = dispatcher->get_route(view);
+  RequestHandler* old_handler = dispatcher->get_handler(in_use).get();
+  // After the lookup, which may prune handlers earlier tests left
+  int destroyed = PerThreadTestHandler::destroyed;
+
+  ASSERT_TRUE(dispatcher->reload(config));
+  RoutePtr reloaded = dispatcher->get_route(view);
+  ASSERT_NE(reloaded, in_use);
+  EXPECT_NE(dispatcher->get_handler(reloaded).get(), old_handler);
+  // Kept while a request still holds the old route
+  EXPECT_EQ(PerThreadTestHandler::destroyed, destroyed);
+  EXPECT_EQ(dispatcher->get_handler(in_use).get(), old_handler);
+
+  in_use = nullptr;
+  dispatcher->get_handler(reloaded);
+  EXPECT_EQ(PerThreadTestHandler::destroyed, destroyed + 1);
+}
+
+TEST_F(RequestHandlerDispatcherTestFixtrue, BuiltinHandlersSkipVirtualCalls) {
+  parser.parse("dispatcher_testcases/handler_lifecycles", &config);
+  dispatcher = std::make_shared<RequestHandlerDispatcher>(config);
+
+  req.uri = "/echo";
+  HandlerRef echo = dispatcher->get_handler(req);
+  EXPECT_TRUE(echo.is_builtin());
+  EXPECT_EQ(echo.get_type(), RequestHandler::HandlerType::ECHO_REQUEST_HANDLER);
+  RequestView view;
+  view.method = "GET";
+  view.uri = "/echo";
+  view.version = "HTTP/1.1";
+  view.valid = true;
+  std::unique_ptr<Response> res;
+  echo.handle_request_view(
+      view, [&](std::unique_ptr<Response> answer) { res = std::move(answer); });
+  ASSERT_NE(res, nullptr);
+  EXPECT_EQ(res->status_code, 200);
+
+  // Handlers only known to the registry go through RequestHandler
+  req.uri = "/per_thread";
+  EXPECT_FALSE(dispatcher->get_handler(req).is_builtin());
+}
+
+TEST(BuiltinHandlersTest, ResolvesExactTypesOnly) {
+  EchoRequestHandler echo("/echo", nullptr);
+  BuiltinHandler resolved = BuiltinHandlers::resolve(&echo);
+  ASSERT_TRUE(std::holds_alternative<EchoRequestHandler*>(resolved));
+  EXPECT_EQ(std::get<EchoRequestHandler*>(resolved), &echo);
+
+  PerRequestTestHandler other("/other", nullptr);
+  EXPECT_EQ(BuiltinHandlers::resolve(&other).index(), 0u);
+  EXPECT_EQ(BuiltinHandlers::resolve(nullptr).index(), 0u);
+  EXPECT_TRUE(answers_inline<EchoRequestHandler>);
+  EXPECT_FALSE(answers_inline<HealthRequestHandler>);
+}
+
+TEST_F(RequestHandlerDispatcherTestFixtrue, ReloadReplacesRoutes) {
+  parser.parse("dispatcher_testcases/echo_handler", &config);
+  dispatcher = std::make_shared<RequestHandlerDispatcher>(config);
+  req.uri = "/echo/health";
+  EXPECT_EQ(dispatcher->get_handler(req)->get_type(),
+            RequestHandler::HandlerType::ECHO_REQUEST_HANDLER);
+
+  NginxConfig reloaded;
+  parser.parse("dispatcher_testcases/nested_locations", &reloaded);
+  ASSERT_TRUE(dispatcher->reload(reloaded));
+  EXPECT_EQ(dispatcher->get_handler(req)->get_type(),
+            RequestHandler::HandlerType::HEALTH_REQUEST_HANDLER);
+
+  // Other threads pick the new routes up too
+  RequestHandler::HandlerType other_thread;
+  std::thread([&] {
+    other_thread = dispatcher->get_handler(req)->get_type();
+  }).join();
+  EXPECT_EQ(other_thread, RequestHandler::HandlerType::HEALTH_REQUEST_HANDLER);
+}
+
+TEST_F(RequestHandlerDispatcherTestFixtrue, FailedReloadKeepsRoutes) {
+  parser.parse("dispatcher_testcases/echo_handler", &config);
+  dispatcher = std::make_shared<RequestHandlerDispatcher>(config);
+
+  NginxConfig invalid;
+  parser.parse("dispatcher_testcases/invalid_handler", &invalid);
+  EXPECT_FALSE(dispatcher->reload(invalid));
+  req.uri = "/echo";
+  EXPECT_EQ(dispatcher->get_handler(req)->get_type(),
+            RequestHandler::HandlerType::ECHO_REQUEST_HANDLER);
+}
+
+TEST_F(RequestHandlerDispatcherTestFixtrue, RouteOutlivesReload) {
+  parser.parse("dispatcher_testcases/handler_pool", &config);
+  dispatcher = std::make_shared<RequestHandlerDispatcher>(config);
+  RequestView view;
+  view.uri = "/sleep";
+  RoutePtr route = dispatcher->get_route(view);
+  ASSERT_NE(route, nullptr);
+
+  NginxConfig reloaded;
+  parser.parse("dispatcher_testcases/echo_handler", &reloaded);
+  ASSERT_TRUE(dispatcher->reload(reloaded));
+  EXPECT_EQ(dispatcher->get_route(view), nullptr);
+
+  // A request routed before the reload still has its handler and pool
+  EXPECT_EQ(dispatcher->get_handler(route)->get_type(),
+            RequestHandler::HandlerType::BLOCKING_REQUEST_HANDLER);
+  std::shared_ptr<HandlerPool> pool = route->pool;
+  ASSERT_NE(pool, nullptr);
+  std::atomic<bool> ran{false};
+  ASSERT_TRUE(pool->submit([&] { ran = true; }));
+  pool = nullptr;
+  route = nullptr;  // Last reference: drains and joins the pool
+  EXPECT_TRUE(ran);
+}
+
+// Runs tasks on one thread that stays alive, idle, between them
+class IdleThread {
+ public:
+  IdleThread() : thread_([this] { run(); }) {}
+  ~IdleThread() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopping_ = true;
+    }
+    ready_.notify_one();
+    thread_.join();
+  }
+  void run_and_wait(std::function<void()> task) {
+    std::promise<void> done;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      task_ = [&] {
+        task();
+        done.set_value();
+      };
+    }
+    ready_.notify_one();
+    done.get_future().wait();
+  }
+
+ private:
+  void run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+      ready_.wait(lock, [this] { return stopping_ || task_; });
+      if (task_) {
+        std::function<void()> task = std::move(task_);
+        task_ = nullptr;
+        task();
+      } else {
+        return;
+      }
+    }
+  }
+
+  std::mutex mutex_;
+  std::condition_variable ready_;
+  std::function<void()> task_;
+  bool stopping_ = false;
+  std::thread thread_;
+};
+
+TEST_F(RequestHandlerDispatcherTestFixtrue, ReloadFreesRoutesIdleThreadsUsed) {
+  parser.parse("dispatcher_testcases/handler_pool", &config);
+  dispatcher = std::make_shared<RequestHandlerDispatcher>(config);
+  RequestView view;
+  view.uri = "/sleep";
+  std::weak_ptr<const Route> route = dispatcher->get_route(view);
+  IdleThread idle;
+  idle.run_and_wait([&] { EXPECT_NE(dispatcher->get_route(view), nullptr); });
+
+  NginxConfig reloaded;
+  parser.parse("dispatcher_testcases/echo_handler", &reloaded);
+  ASSERT_TRUE(dispatcher->reload(reloaded));
+  // Neither thread routes again, and the old route and its pool are gone
+  EXPECT_TRUE(route.expired());
+  idle.run_and_wait([&] { EXPECT_EQ(dispatcher->get_route(view), nullptr); });
+}
+
+TEST_F(RequestHandlerDispatcherTestFixtrue, DestroyingFreesRoutesOfAllThreads) {
+  parser.parse("dispatcher_testcases/handler_pool", &config);
+  dispatcher = std::make_shared<RequestHandlerDispatcher>(config);
+  RequestView view;
+  view.uri = "/sleep";
+  std::weak_ptr<const Route> route = dispatcher->get_route(view);
+  IdleThread idle;
+  idle.run_and_wait([&] { EXPECT_NE(dispatcher->get_route(view), nullptr); });
+
+  dispatcher = nullptr;
+  EXPECT_TRUE(route.expired());
+  // A dispatcher made later is not confused with the destroyed one
+  NginxConfig other;
+  parser.parse("dispatcher_testcases/echo_handler", &other);
+  dispatcher = std::make_shared<RequestHandlerDispatcher>(other);
+  idle.run_and_wait([&] { EXPECT_EQ(dispatcher->get_route(view), nullptr); });
+}
+
+TEST_F(RequestHandlerDispatcherTestFixtrue, RoutesWhileReloading) {
+  parser.parse("dispatcher_testcases/echo_handler", &config);
+  dispatcher = std::make_shared<RequestHandlerDispatcher>(config);
+  NginxConfig other;
+  parser.parse("dispatcher_testcases/multiple_handlers", &other);
+  std::atomic<int> routing{4};
+  std::atomic<int> misrouted{0};
+  std::vector<std::thread> readers;
+  for (int i = 0; i < 4; ++i) {
+    readers.emplace_back([&] {
+      RequestView view;
+      view.uri = "/echo/hello";
+      for (int j = 0; j < 2000; ++j) {
+        RoutePtr route = dispatcher->get_route(view);
+        if (route == nullptr || route->location != "/echo") {
+          ++misrouted;
+        }
+      }
+      --routing;
+    });
+  }
+  // Every reload waits out the lookups still reading what it replaced
+  for (int i = 0; routing > 0; ++i) {
+    EXPECT_TRUE(dispatcher->reload(i % 2 ? config : other));
+  }
+  for (auto& reader : readers) {
+    reader.join();
+  }
+  EXPECT_EQ(misrouted, 0);
+}
+
+TEST(RouteTrieTest, LongestPrefixWins) {
+  RouteTrie<int> trie({{"/", 1}, {"/api", 2}, {"/api/v1", 3}, {"/apix", 4}});
+  EXPECT_EQ(trie.size(), 4u);
+  EXPECT_EQ(*trie.longest_prefix_match("/api/v1/users").value, 3);
+  EXPECT_EQ(trie.longest_prefix_match("/api/v1/users").location, "/api/v1");
+  EXPECT_EQ(*trie.longest_prefix_match("/api/v2").value, 2);
+  EXPECT_EQ(*trie.longest_prefix_match("/apix").value, 4);
+  EXPECT_EQ(*trie.longest_prefix_match("/ap").value, 1);
+  EXPECT_EQ(*trie.longest_prefix_match("/").value, 1);
+}
+
+TEST(RouteTrieTest, NoMatch) {
+  RouteTrie<int> trie({{"/static", 1}});
+  EXPECT_FALSE(trie.longest_prefix_match("/stat"));
+  EXPECT_FALSE(trie.longest_prefix_match(""));
+  EXPECT_FALSE(trie.longest_prefix_match("/echo"));
+  EXPECT_FALSE(RouteTrie<int>().longest_prefix_match("/"));
+}
+
+TEST(RouteTrieTest, FirstDuplicateKept) {
+  RouteTrie<int> trie({{"/echo", 1}, {"/echo", 2}});
+  EXPECT_EQ(trie.size(), 1u);
+  EXPECT_EQ(*trie.longest_prefix_match("/echo").value, 1);
+}
+
+TEST(RouteTrieTest, CompressesChains) {
+  RouteTrie<int> trie({{"/static/images", 1}, {"/static/scripts", 2}});
+  // Root, "/static/", "images" and "scripts"
+  EXPECT_EQ(trie.node_count(), 4u);
+  EXPECT_EQ(*trie.longest_prefix_match("/static/scripts/app.js").value, 2);
+  EXPECT_FALSE(trie.longest_prefix_match("/static/"));
+}
+
+TEST(RouteTrieTest, ManySiblings) {
+  std::vector<std::pair<std::string, int>> routes;
+  for (int i = 0; i < 200; ++i) {
+    routes.emplace_back("/r" + std::to_string(i), i);
+  }
+  RouteTrie<int> trie(routes);
+  for (int i = 0; i < 200; ++i) {
+    std::string url = "/r" + std::to_string(i) + "/x";
+    auto match = trie.longest_prefix_match(url);
+    ASSERT_TRUE(match) << url;
+    EXPECT_EQ(*match.value, i);
+  }
+}
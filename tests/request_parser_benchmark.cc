@@ -0,0 +1,117 @@
+// Request parser benchmark: beast backend vs SIMD backend.
+//
+// Parses a few representative requests in a tight loop with each backend,
+// and with the SIMD backend once per instruction set the CPU supports, and
+// reports nanoseconds per parse. Logging is disabled so only parsing is
+// measured.
+//
+// Usage (from the build directory):
+//     bin/request_parser_benchmark [iterations]
+
+#include <boost/log/core.hpp>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "header_scanner.h"
+#include "http_header.h"
+#include "request_parser.h"
+
+struct Case {
+  const char* name;
+  std::string raw;
+};
+
+static std::vector<Case> make_cases() {
+  return {
+      {"redirect",
+       "GET /s/abc123 HTTP/1.1\r\n"
+       "Host: localhost\r\n"
+       "\r\n"},
+      {"browser",
+       "GET /static/index.html HTTP/1.1\r\n"
+       "Host: www.example.com\r\n"
+       "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 "
+       "(KHTML, like Gecko) Chrome/124.0.0.0 Safari/537.36\r\n"
+       "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,"
+       "image/avif,image/webp,*/*;q=0.8\r\n"
+       "Accept-Language: en-US,en;q=0.5\r\n"
+       "Accept-Encoding: gzip, deflate, br\r\n"
+       "Cookie: session=" +
+           std::string(120, 'c') +
+           "\r\n"
+           "Connection: keep-alive\r\n"
+           "\r\n"},
+      {"post",
+       "POST /shorten HTTP/1.1\r\n"
+       "Host: localhost\r\n"
+       "Content-Type: application/json\r\n"
+       "Content-Length: 42\r\n"
+       "\r\n"
+       "{\"url\": \"https://www.example.com/a/b/c/d\"}"},
+  };
+}
+
+// Nanoseconds per parse of raw, or -1 if it does not parse
+static double time_parse(RequestParser& parser, const std::string& raw,
+                         int iterations) {
+  RequestView view;
+  parser.parse(view, raw);
+  if (!view.valid) {
+    return -1;
+  }
+  size_t checksum = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < iterations; ++i) {
+    parser.parse(view, raw);
+    checksum += view.headers.size();
+  }
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  // Keeps the loop from being optimized out
+  if (checksum == 0) {
+    std::fprintf(stderr, "no headers parsed\n");
+  }
+  return std::chrono::duration<double, std::nano>(elapsed).count() /
+         iterations;
+}
+
+int main(int argc, char* argv[]) {
+  int iterations = argc > 1 ? std::atoi(argv[1]) : 200000;
+  if (iterations <= 0) {
+    std::fprintf(stderr, "Usage: request_parser_benchmark [iterations]\n");
+    return 1;
+  }
+  boost::log::core::get()->set_logging_enabled(false);
+
+  struct Backend {
+    std::string name;
+    RequestParser parser;
+  };
+  std::vector<Backend> backends;
+  backends.push_back({"beast", RequestParser(ParserBackend::BEAST)});
+  for (ScannerIsa isa :
+       {ScannerIsa::SCALAR, ScannerIsa::SSE42, ScannerIsa::AVX2}) {
+    if (HeaderScanner(isa).isa() == isa) {
+      backends.push_back({std::string("simd/") + HeaderScanner::isa_name(isa),
+                          RequestParser(ParserBackend::SIMD, isa)});
+    }
+  }
+
+  std::vector<Case> cases = make_cases();
+  std::printf("iterations=%d, ns/parse\n", iterations);
+  std::printf("%-14s", "backend");
+  for (const Case& c : cases) {
+    std::printf("%12s", c.name);
+  }
+  std::printf("\n");
+  for (Backend& backend : backends) {
+    std::printf("%-14s", backend.name.c_str());
+    for (const Case& c : cases) {
+      std::printf("%12.1f", time_parse(backend.parser, c.raw, iterations));
+    }
+    std::printf("\n");
+  }
+  return 0;
+}
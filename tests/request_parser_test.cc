@@ -3,14 +3,16 @@
 #include "gtest/gtest.h"
 #include "http_header.h"
 
-class RequestParserTextFixture : public ::testing::Test {
+// Every case runs against both parser backends
+class RequestParserTextFixture
+    : public ::testing::TestWithParam<ParserBackend> {
  protected:
-  RequestParser parser;
+  RequestParser parser{GetParam()};
   Request req;
   std::string input;
 };
 
-TEST_F(RequestParserTextFixture, SimpleRequest) {
+TEST_P(RequestParserTextFixture, SimpleRequest) {
   input =
       "GET /index.html HTTP/1.1\r\n"
       "Host: www.example.com\r\n"
@@ -23,7 +25,7 @@ TEST_F(RequestParserTextFixture, SimpleRequest) {
   EXPECT_EQ(req.headers.size(), 1);
 }
 
-TEST_F(RequestParserTextFixture, RequestWithNoHeader) {
+TEST_P(RequestParserTextFixture, RequestWithNoHeader) {
   input =
       "GET /no-header HTTP/1.1\r\n"
       "\r\n";
@@ -35,7 +37,7 @@ TEST_F(RequestParserTextFixture, RequestWithNoHeader) {
   EXPECT_EQ(req.headers.size(), 0);
 }
 
-TEST_F(RequestParserTextFixture, RequestWithExtraHeaders) {
+TEST_P(RequestParserTextFixture, RequestWithExtraHeaders) {
   input =
       "GET /home HTTP/1.1\r\n"
       "Host: test.com\r\n"
@@ -51,7 +53,7 @@ TEST_F(RequestParserTextFixture, RequestWithExtraHeaders) {
   EXPECT_EQ(req.headers.size(), 4);
 }
 
-TEST_F(RequestParserTextFixture, InvalidMethodRequest) {
+TEST_P(RequestParserTextFixture, InvalidMethodRequest) {
   input =
       "FETCH /weird HTTP/1.1\r\n"
       "Host: weird.com\r\n"
@@ -60,7 +62,7 @@ TEST_F(RequestParserTextFixture, InvalidMethodRequest) {
   EXPECT_EQ(req.valid, false);
 }
 
-TEST_F(RequestParserTextFixture, MissingMethodRequest) {
+TEST_P(RequestParserTextFixture, MissingMethodRequest) {
   input =
       " /weird HTTP/1.1\r\n"
       "Host: weird.com\r\n"
@@ -69,7 +71,7 @@ TEST_F(RequestParserTextFixture, MissingMethodRequest) {
   EXPECT_EQ(req.valid, false);
 }
 
-TEST_F(RequestParserTextFixture, MissingSpaceRequest) {
+TEST_P(RequestParserTextFixture, MissingSpaceRequest) {
   input =
       "GET/nospace HTTP/1.1\r\n"
       "Host: www.nospace.com\r\n"
@@ -78,7 +80,7 @@ TEST_F(RequestParserTextFixture, MissingSpaceRequest) {
   EXPECT_EQ(req.valid, false);
 }
 
-TEST_F(RequestParserTextFixture, MissingHttpVersion) {
+TEST_P(RequestParserTextFixture, MissingHttpVersion) {
   input =
       "GET /no-version\r\n"
       "Host: noversion.com\r\n"
@@ -87,7 +89,7 @@ TEST_F(RequestParserTextFixture, MissingHttpVersion) {
   EXPECT_EQ(req.valid, false);
 }
 
-TEST_F(RequestParserTextFixture, WrongHttpVersion) {
+TEST_P(RequestParserTextFixture, WrongHttpVersion) {
   input =
       "GET /wrong-version HTTP/2.0\r\n"
       "Host: wrongversion.com\r\n"
@@ -96,7 +98,17 @@ TEST_F(RequestParserTextFixture, WrongHttpVersion) {
   EXPECT_EQ(req.valid, false);
 }
 
-TEST_F(RequestParserTextFixture, MalformedRequest) {
+TEST_P(RequestParserTextFixture, Http10Request) {
+  input =
+      "GET /old HTTP/1.0\r\n"
+      "Host: old.com\r\n"
+      "\r\n";
+  parser.parse(req, input);
+  EXPECT_EQ(req.valid, true);
+  EXPECT_EQ(req.version, "HTTP/1.0");
+}
+
+TEST_P(RequestParserTextFixture, MalformedRequest) {
   input =
       "GET: /malformed HTTP/1.1\r\n"
       "Host: malformed.com\r\n"
@@ -105,7 +117,7 @@ TEST_F(RequestParserTextFixture, MalformedRequest) {
   EXPECT_EQ(req.valid, false);
 }
 
-TEST_F(RequestParserTextFixture, MalformedHeader) {
+TEST_P(RequestParserTextFixture, MalformedHeader) {
   input =
       "GET /malformed HTTP/1.1\r\n"
       "Host malformed.com\r\n"
@@ -114,13 +126,13 @@ TEST_F(RequestParserTextFixture, MalformedHeader) {
   EXPECT_EQ(req.valid, false);
 }
 
-TEST_F(RequestParserTextFixture, EmptyRequest) {
+TEST_P(RequestParserTextFixture, EmptyRequest) {
   input = "\r\n";
   parser.parse(req, input);
   EXPECT_EQ(req.valid, false);
 }
 
-TEST_F(RequestParserTextFixture, IncompleteRequest) {
+TEST_P(RequestParserTextFixture, IncompleteRequest) {
   input =
       "GET /incomplete HTTP/1.1\r\n"
       "Host: incomplete.com\r\n";
@@ -128,7 +140,7 @@ TEST_F(RequestParserTextFixture, IncompleteRequest) {
   EXPECT_EQ(req.valid, false);
 }
 
-TEST_F(RequestParserTextFixture, MissingNewlineRequest1) {
+TEST_P(RequestParserTextFixture, MissingNewlineRequest1) {
   input =
       "GET /incomplete HTTP/1.1"
       "Host: incomplete.com\r\n"
@@ -137,7 +149,7 @@ TEST_F(RequestParserTextFixture, MissingNewlineRequest1) {
   EXPECT_EQ(req.valid, false);
 }
 
-TEST_F(RequestParserTextFixture, MissingNewlineRequest2) {
+TEST_P(RequestParserTextFixture, MissingNewlineRequest2) {
   input =
       "GET /incomplete HTTP/1.1\r"
       "Host: incomplete.com\r\n"
@@ -146,11 +158,116 @@ TEST_F(RequestParserTextFixture, MissingNewlineRequest2) {
   EXPECT_EQ(req.valid, false);
 }
 
-TEST_F(RequestParserTextFixture, MissingNewlineRequest3) {
+TEST_P(RequestParserTextFixture, MissingNewlineRequest3) {
   input =
       "GET /incomplete HTTP/1.1\n"
       "Host: incomplete.com\r\n"
       "\r\n";
   parser.parse(req, input);
   EXPECT_EQ(req.valid, false);
-}
\ No newline at end of file
+}
+
+TEST_P(RequestParserTextFixture, ViewPointsIntoRawRequest) {
+  input =
+      "POST /api/shoes HTTP/1.1\r\n"
+      "Host: www.example.com\r\n"
+      "Content-Length: 5\r\n"
+      "\r\n"
+      "hello";
+  RequestView view;
+  parser.parse(view, input);
+  ASSERT_TRUE(view.valid);
+  EXPECT_EQ(view.method, "POST");
+  EXPECT_EQ(view.uri, "/api/shoes");
+  EXPECT_EQ(view.version, "HTTP/1.1");
+  ASSERT_EQ(view.headers.size(), 2u);
+  EXPECT_EQ(view.headers[0].name, "Host");
+  EXPECT_EQ(view.headers[0].value, "www.example.com");
+  EXPECT_EQ(view.body, "hello");
+
+  // Nothing was copied
+  EXPECT_EQ(view.uri.data(), input.data() + 5);
+  EXPECT_EQ(view.body.data(), input.data() + input.size() - 5);
+  EXPECT_EQ(view.decoded_body, nullptr);
+}
+
+TEST_P(RequestParserTextFixture, ViewDecodesChunkedBody) {
+  input =
+      "POST /api/shoes HTTP/1.1\r\n"
+      "Transfer-Encoding: chunked\r\n"
+      "\r\n"
+      "5\r\nhello\r\n6\r\n world\r\n0\r\n\r\n";
+  RequestView view;
+  parser.parse(view, input);
+  ASSERT_TRUE(view.valid);
+  EXPECT_EQ(view.body, "hello world");
+  ASSERT_NE(view.decoded_body, nullptr);
+}
+
+TEST_P(RequestParserTextFixture, ViewRejectsIncompleteBody) {
+  input =
+      "POST /api/shoes HTTP/1.1\r\n"
+      "Content-Length: 10\r\n"
+      "\r\n"
+      "hello";
+  RequestView view;
+  parser.parse(view, input);
+  EXPECT_FALSE(view.valid);
+}
+
+TEST_P(RequestParserTextFixture, HeaderWhitespaceIsTrimmed) {
+  input =
+      "GET /spaces HTTP/1.1\r\n"
+      "Host:  spaces.com \t\r\n"
+      "Accept:\r\n"
+      "\r\n";
+  RequestView view;
+  parser.parse(view, input);
+  ASSERT_TRUE(view.valid);
+  ASSERT_EQ(view.headers.size(), 2u);
+  EXPECT_EQ(view.headers[0].value, "spaces.com");
+  EXPECT_EQ(view.headers[1].value, "");
+}
+
+TEST_P(RequestParserTextFixture, LongHeaderValueSpansVectorWidths) {
+  std::string cookie(100, 'c');
+  input = "GET /cookie HTTP/1.1\r\nCookie: " + cookie + "\r\n\r\n";
+  RequestView view;
+  parser.parse(view, input);
+  ASSERT_TRUE(view.valid);
+  ASSERT_EQ(view.headers.size(), 1u);
+  EXPECT_EQ(view.headers[0].value, cookie);
+}
+
+TEST_P(RequestParserTextFixture, ControlCharacterInHeaderValue) {
+  input =
+      "GET /control HTTP/1.1\r\n"
+      "Host: control\x01.com\r\n"
+      "\r\n";
+  parser.parse(req, input);
+  EXPECT_EQ(req.valid, false);
+}
+
+TEST_P(RequestParserTextFixture, FoldedHeaderLine) {
+  input =
+      "GET /folded HTTP/1.1\r\n"
+      "X-Folded: first\r\n"
+      " second\r\n"
+      "\r\n";
+  parser.parse(req, input);
+  EXPECT_EQ(req.valid, false);
+}
+
+TEST_P(RequestParserTextFixture, InvalidContentLength) {
+  input =
+      "POST /length HTTP/1.1\r\n"
+      "Content-Length: 5x\r\n"
+      "\r\n"
+      "hello";
+  parser.parse(req, input);
+  EXPECT_EQ(req.valid, false);
+}
+
+INSTANTIATE_TEST_SUITE_P(Backends, RequestParserTextFixture,
+                         ::testing::Values(ParserBackend::BEAST,
+                                           ParserBackend::SIMD));
@@ -3,6 +3,8 @@
 
 #include <boost/asio.hpp>
 #include <boost/system/error_code.hpp>
+#include <chrono>
+#include <thread>
 
 #include "config_parser.h"  // for NginxConfig
 #include "gmock/gmock.h"
@@ -32,6 +34,8 @@ class ServerTest : public Server {
   }
 
   SessionPtr capture_session() { return make_session_(); }
+
+  unsigned short bound_port() { return acceptor_.local_endpoint().port(); }
 };
 
 // ------------------------------------------------ 2. Mock session
@@ -115,3 +119,54 @@ TEST(ServerTest, DefaultFactory_ProducesSession) {
   EXPECT_NE(dynamic_cast<Session*>(sp.get()), nullptr)
       << "Default factory must create a concrete Session";
 }
+
+// ------------------------------------------------ 6. SO_REUSEPORT shards
+// share one port
+TEST(ServerTest, ReusePort_TwoShardsBindSamePort) {
+  asio::io_service ios1;
+  asio::io_service ios2;
+  auto dispatcher =
+      std::make_shared<RequestHandlerDispatcher>(NginxConfig());
+
+  ServerTest first(ios1, /*port=*/0, dispatcher, /*reuse_port=*/true);
+  unsigned short port = first.bound_port();
+
+  EXPECT_NO_THROW(
+      ServerTest second(ios2, port, dispatcher, /*reuse_port=*/true));
+}
+
+// ------------------------------------------------ 7. max_connections sheds
+// extra connections with a 503
+TEST(ServerTest, MaxConnections_RejectsWith503) {
+  asio::io_service ios;
+  auto dispatcher =
+      std::make_shared<RequestHandlerDispatcher>(NginxConfig());
+  ConnectionSettings settings;
+  settings.max_connections = 1;
+  ServerTest srv(ios, /*port=*/0, dispatcher, /*reuse_port=*/false, nullptr,
+                 settings);
+  tcp::endpoint endpoint(asio::ip::address::from_string("127.0.0.1"),
+                         srv.bound_port());
+  std::thread io_thread([&] { ios.run(); });
+
+  asio::io_service client_io;
+  tcp::socket first(client_io);
+  first.connect(endpoint);
+  // Let the server accept the first connection before the second arrives
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  tcp::socket second(client_io);
+  second.connect(endpoint);
+
+  std::string response;
+  error_code ec;
+  char buf[512];
+  size_t n;
+  while ((n = second.read_some(asio::buffer(buf), ec)) > 0) {
+    response.append(buf, n);
+  }
+  EXPECT_EQ(response, overloaded_response(HTTP_VERSION, false));
+  EXPECT_NE(response.find("Retry-After: 1\r\n"), std::string::npos);
+
+  ios.stop();
+  io_thread.join();
+}
@@ -0,0 +1,217 @@
+// Session benchmark: callback Session vs coroutine CoroSession.
+//
+// Serves /health and short URL redirects (against in-process fake Redis
+// and database clients) through a real Server on a loopback port and
+// drives it with one blocking keep-alive client. For each workload and
+// session type it reports heap allocations made by the io thread per
+// request, allocations served by the sessions' request arenas instead,
+// and the client-side round trip latency. Logging is disabled so only the
+// session, parser and handler machinery is measured.
+//
+// Usage (from the build directory, needs -DCREEPER_COROUTINE_SESSION=ON):
+//     bin/session_benchmark [requests] [port]
+
+#include <algorithm>
+#include <utility>  // before asio; see coro_session.h
+#include <atomic>
+#include <boost/asio.hpp>
+#include <boost/log/core.hpp>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "config_parser.h"
+#include "coro_session.h"
+#include "request_arena.h"
+#include "request_handler_dispatcher.h"
+#include "server.h"
+#include "session.h"
+
+using boost::asio::ip::tcp;
+
+// Only allocations made on the server's io thread are counted
+static std::atomic<size_t> g_allocations{0};
+static thread_local bool t_count_allocations = false;
+
+void* operator new(std::size_t size) {
+  if (t_count_allocations) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+  }
+  if (void* p = std::malloc(size ? size : 1)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+
+static const char kConfig[] =
+    "location /health HealthHandler {\n"
+    "}\n"
+    "location /s ShortenHandler {\n"
+    "}\n";
+
+static const char kHealthRequest[] =
+    "GET /health HTTP/1.1\r\n"
+    "Host: localhost\r\n"
+    "\r\n";
+
+static const char kLongUrl[] = "https://www.example.com/a/fairly/long/path";
+
+static const int kWarmupRequests = 1000;
+
+struct Result {
+  double allocs_per_request;
+  double arena_allocs_per_request;
+  double p50_us;
+  double p99_us;
+};
+
+// Read one response with a Content-Length body off the socket and return
+// the body
+static std::string read_response(tcp::socket& sock,
+                                 boost::asio::streambuf& buf) {
+  size_t header_end = boost::asio::read_until(sock, buf, "\r\n\r\n");
+  std::string head(boost::asio::buffers_begin(buf.data()),
+                   boost::asio::buffers_begin(buf.data()) + header_end);
+  buf.consume(header_end);
+  size_t length = 0;
+  size_t pos = head.find("Content-Length: ");
+  if (pos != std::string::npos) {
+    length = std::stoul(head.substr(pos + 16));
+  }
+  if (buf.size() < length) {
+    boost::asio::read(sock, buf,
+                      boost::asio::transfer_exactly(length - buf.size()));
+  }
+  std::string body(boost::asio::buffers_begin(buf.data()),
+                   boost::asio::buffers_begin(buf.data()) + length);
+  buf.consume(length);
+  return body;
+}
+
+// Send one request and return the response body
+static std::string round_trip(tcp::socket& sock, boost::asio::streambuf& buf,
+                              const std::string& request) {
+  boost::asio::write(sock, boost::asio::buffer(request));
+  return read_response(sock, buf);
+}
+
+// Shorten kLongUrl and return the redirect request for its short URL
+static std::string make_redirect_request(tcp::socket& sock,
+                                         boost::asio::streambuf& buf) {
+  std::string body = kLongUrl;
+  std::string code = round_trip(
+      sock, buf,
+      "POST /s HTTP/1.1\r\nHost: localhost\r\nContent-Length: " +
+          std::to_string(body.size()) + "\r\n\r\n" + body);
+  return "GET /s/" + code + " HTTP/1.1\r\nHost: localhost\r\n\r\n";
+}
+
+// Serve with SessionType sessions on their own io thread and time
+// `requests` round trips from a single client connection, of /health or
+// of a redirect
+template <typename SessionType>
+static Result run(std::shared_ptr<RequestHandlerDispatcher> dispatcher,
+                  unsigned short port, int requests, bool redirect) {
+  boost::asio::io_service io;
+  // Every request goes over one connection, so lift the per-connection
+  // request limit
+  ConnectionSettings settings;
+  settings.keepalive_requests = 0;
+  SessionFactory factory = [&io, dispatcher, settings] {
+    return std::make_shared<SessionType>(io, dispatcher, nullptr, settings);
+  };
+  Server server(io, port, dispatcher, /*reuse_port=*/false, factory);
+  std::thread io_thread([&io] {
+    t_count_allocations = true;
+    io.run();
+  });
+
+  boost::asio::io_service client_io;
+  tcp::socket sock(client_io);
+  sock.connect(tcp::endpoint(boost::asio::ip::address_v4::loopback(), port));
+  sock.set_option(tcp::no_delay(true));
+  boost::asio::streambuf buf;
+  std::string request =
+      redirect ? make_redirect_request(sock, buf) : kHealthRequest;
+
+  for (int i = 0; i < kWarmupRequests; ++i) {
+    round_trip(sock, buf, request);
+  }
+
+  std::vector<double> latencies;
+  latencies.reserve(requests);
+  size_t allocations_before = g_allocations.load();
+  uint64_t arena_before = RequestArena::counters().allocations;
+  for (int i = 0; i < requests; ++i) {
+    auto start = std::chrono::steady_clock::now();
+    round_trip(sock, buf, request);
+    latencies.push_back(std::chrono::duration<double, std::micro>(
+                            std::chrono::steady_clock::now() - start)
+                            .count());
+  }
+  size_t allocations = g_allocations.load() - allocations_before;
+  // An arena publishes its counts when it is reset after a write, which
+  // may trail the client by a request; noise over many requests
+  uint64_t arena_allocations =
+      RequestArena::counters().allocations - arena_before;
+
+  sock.close();
+  io.stop();
+  io_thread.join();
+
+  std::sort(latencies.begin(), latencies.end());
+  auto pct = [&](double p) {
+    return latencies[std::min(latencies.size() - 1,
+                              static_cast<size_t>(latencies.size() * p))];
+  };
+  return {static_cast<double>(allocations) / requests,
+          static_cast<double>(arena_allocations) / requests, pct(0.50),
+          pct(0.99)};
+}
+
+int main(int argc, char* argv[]) {
+  int requests = argc > 1 ? std::atoi(argv[1]) : 20000;
+  unsigned short port =
+      static_cast<unsigned short>(argc > 2 ? std::atoi(argv[2]) : 8093);
+  if (requests <= 0) {
+    std::fprintf(stderr, "Usage: session_benchmark [requests] [port]\n");
+    return 1;
+  }
+  boost::log::core::get()->set_logging_enabled(false);
+  // Redirects resolve against in-process maps instead of Redis / Postgres
+  setenv("USE_FAKE_SHORTEN_CLIENTS", "1", 0);
+
+  NginxConfigParser parser;
+  NginxConfig config;
+  std::istringstream config_stream(kConfig);
+  if (!parser.parse(&config_stream, &config)) {
+    std::fprintf(stderr, "Failed to parse benchmark config\n");
+    return 1;
+  }
+  auto dispatcher = std::make_shared<RequestHandlerDispatcher>(config);
+
+  std::printf("requests=%d\n", requests);
+  std::printf("%-10s%-12s%16s%16s%10s%10s\n", "workload", "session",
+              "allocs/request", "arena/request", "p50 us", "p99 us");
+  for (bool redirect : {false, true}) {
+    const char* workload = redirect ? "redirect" : "health";
+    Result callback = run<Session>(dispatcher, port, requests, redirect);
+    Result coroutine = run<CoroSession>(dispatcher, port, requests, redirect);
+    for (auto [name, result] : {std::make_pair("callback", callback),
+                                std::make_pair("coroutine", coroutine)}) {
+      std::printf("%-10s%-12s%16.1f%16.1f%10.1f%10.1f\n", workload, name,
+                  result.allocs_per_request, result.arena_allocs_per_request,
+                  result.p50_us, result.p99_us);
+    }
+  }
+  return 0;
+}
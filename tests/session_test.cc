@@ -1,14 +1,29 @@
 // tests/session_test.cc -------------------------------------------------
 #include "session.h"
 
+#include <algorithm>
 #include <boost/asio.hpp>
 #include <boost/system/error_code.hpp>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <sstream>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
 
 #include "config_parser.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
+#include "logging.h"
+#include "metrics.h"
+#include "registry.h"
+#include "request_arena.h"
 #include "request_handler_dispatcher.h"
+#include "timer_wheel.h"
 
 using ::testing::AtLeast;
 
@@ -17,106 +32,576 @@ namespace sys = boost::system;
 using tcp = asio::ip::tcp;
 using error_code = sys::error_code;
 
-// ---------------------------------------------------------------- 1. Testable
-// Session
-class SessionTest : public Session {
+// ---------------------------------------------------------------- 1. Gated
+// handler
+class GateTestHandlerArgs : public RequestHandlerArgs {
  public:
-  explicit SessionTest(asio::io_service& io)
-      : Session(io, std::make_shared<RequestHandlerDispatcher>(NginxConfig())),
-        deleted_flag_(nullptr) {
-    // Use mock configuration for tests
-    NginxConfig cfg;
-    NginxConfigParser().parse("../tests/mock_config", &cfg);
-    dispatcher_ = std::make_shared<RequestHandlerDispatcher>(cfg);
+  static std::shared_ptr<GateTestHandlerArgs> create_from_config(
+      std::shared_ptr<NginxConfigStatement> statement) {
+    return std::make_shared<GateTestHandlerArgs>();
   }
+};
 
-  ~SessionTest() override {
-    if (deleted_flag_) *deleted_flag_ = true;
+// Blocks in handle_request() until the test opens the gate, so a test can
+// hold a location's handler threads or max_inflight slots busy. Records
+// the threads it ran on.
+class GateTestHandler : public RequestHandler {
+ public:
+  GateTestHandler(const std::string& base_uri,
+                  std::shared_ptr<GateTestHandlerArgs> args) {}
+  std::unique_ptr<Response> handle_request(const Request& req) override {
+    std::unique_lock<std::mutex> lock(mutex);
+    threads.push_back(std::this_thread::get_id());
+    changed.notify_all();
+    changed.wait(lock, [] { return open; });
+    return std::make_unique<Response>(HTTP_VERSION, 200, "OK",
+                                      std::vector<Header>{}, "");
+  }
+  HandlerType get_type() const override {
+    return HandlerType::BLOCKING_REQUEST_HANDLER;
   }
 
-  // Override remote_endpoint to return a test-friendly endpoint
-  tcp::endpoint remote_endpoint() override {
-    return tcp::endpoint(asio::ip::address::from_string("127.0.0.1"), 4242);
+  static void set_open(bool is_open) {
+    std::lock_guard<std::mutex> lock(mutex);
+    open = is_open;
+    if (!open) {
+      threads.clear();
+    }
+    changed.notify_all();
+  }
+  // Whether n requests have entered handle_request() since the gate was
+  // closed, waiting up to a few seconds for them
+  static bool wait_entered(size_t n) {
+    std::unique_lock<std::mutex> lock(mutex);
+    return changed.wait_for(lock, std::chrono::seconds(5),
+                            [n] { return threads.size() >= n; });
+  }
+  // The thread the i-th of those requests ran on
+  static std::thread::id thread(size_t i) {
+    std::lock_guard<std::mutex> lock(mutex);
+    return threads.at(i);
   }
 
-  // helpers to reach the protected/private bits
-  std::string call_handle_response(std::size_t n) {
-    return Session::handle_response(n);
+ private:
+  // Guards open and threads
+  static inline std::mutex mutex;
+  static inline std::condition_variable changed;
+  static inline bool open = true;
+  static inline std::vector<std::thread::id> threads;
+};
+
+REGISTER_HANDLER("GateTestHandler", GateTestHandler, GateTestHandlerArgs);
+
+// Answers at once, then holds on to its request until the gate opens, like
+// a handler that finishes work after replying
+class AnswerFirstTestHandler : public GateTestHandler {
+ public:
+  using GateTestHandler::GateTestHandler;
+  void handle_request_async(const Request& req,
+                            ResponseCallback callback) override {
+    callback(std::make_unique<Response>(HTTP_VERSION, 200, "OK",
+                                        std::vector<Header>{}, ""));
+    handle_request(req);
   }
-  void call_handle_read(const error_code& ec, std::size_t n) {
-    Session::handle_read(ec, n);
+};
+
+REGISTER_HANDLER("AnswerFirstTestHandler", AnswerFirstTestHandler,
+                 GateTestHandlerArgs);
+
+// Whether condition holds within a few seconds
+static bool eventually(const std::function<bool()>& condition) {
+  for (int i = 0; i < 1000; ++i) {
+    if (condition()) {
+      return true;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
   }
-  void call_handle_write(const error_code& ec) { Session::handle_write(ec); }
+  return false;
+}
 
-  void set_data(const std::string& s) {
-    std::copy(s.begin(), s.end(), data_);
-    data_[s.size()] = '\0';
+// ---------------------------------------------------------------- 2. Client
+// A blocking loopback client with its own io_service, so its reads can time
+// out instead of hanging a test whose session never answers
+class Client {
+ public:
+  explicit Client(unsigned short port) : socket_(io_) {
+    socket_.connect(tcp::endpoint(asio::ip::address_v4::loopback(), port));
   }
 
-  bool* deleted_flag_;
+  void send(const std::string& bytes) {
+    asio::write(socket_, asio::buffer(bytes));
+  }
+
+  // The next response, read up to its Content-Length; empty if the
+  // connection closes or nothing arrives within timeout
+  std::string read_response(
+      std::chrono::milliseconds timeout = std::chrono::seconds(5)) {
+    while (true) {
+      std::string_view data(static_cast<const char*>(buf_.data().data()),
+                            buf_.size());
+      size_t header_end = data.find("\r\n\r\n");
+      if (header_end != std::string_view::npos) {
+        header_end += 4;
+        size_t pos = data.find("Content-Length: ");
+        size_t length = 0;
+        if (pos < header_end) {
+          length = std::stoul(std::string(data.substr(pos + 16)));
+        }
+        if (data.size() >= header_end + length) {
+          std::string response(data.substr(0, header_end + length));
+          buf_.consume(response.size());
+          return response;
+        }
+      }
+      if (read_more(timeout)) {
+        return "";
+      }
+    }
+  }
+
+  // Whether the session closes the connection within timeout with no
+  // further bytes
+  bool closed(std::chrono::milliseconds timeout = std::chrono::seconds(5)) {
+    if (buf_.size() != 0) {
+      return false;
+    }
+    error_code ec = read_more(timeout);
+    return buf_.size() == 0 &&
+           (ec == asio::error::eof || ec == asio::error::connection_reset);
+  }
+
+ private:
+  // Append whatever arrives next to buf_
+  error_code read_more(std::chrono::milliseconds timeout) {
+    error_code result;
+    bool done = false;
+    socket_.async_read_some(buf_.prepare(4096),
+                            [&](const error_code& ec, size_t n) {
+                              buf_.commit(n);
+                              result = ec;
+                              done = true;
+                            });
+    io_.restart();
+    io_.run_for(timeout);
+    if (!done) {
+      socket_.cancel();
+      io_.restart();
+      io_.run();
+      return asio::error::timed_out;
+    }
+    return result;
+  }
+
+  asio::io_service io_;
+  tcp::socket socket_;
+  asio::streambuf buf_;
 };
 
-// ---------------------------------------------------------------- 2. Fixture
+// ---------------------------------------------------------------- 3. Fixture
+// Serves each connect() with a Session on background io threads, with
+// timeouts driven by a fast wheel
 class SessionTestFixture : public ::testing::Test {
  protected:
+  void SetUp() override {
+    std::istringstream config_stream(
+        "location /echo EchoHandler {\n"
+        "}\n"
+        "location /pooled GateTestHandler {\n"
+        "  handler_threads 1;\n"
+        "  handler_queue 1;\n"
+        "}\n"
+        "location /answer_first AnswerFirstTestHandler {\n"
+        "  handler_threads 1;\n"
+        "}\n"
+        "location /limited GateTestHandler {\n"
+        "  handler_threads 2;\n"
+        "  max_inflight 1;\n"
+        "}\n");
+    ASSERT_TRUE(NginxConfigParser().parse(&config_stream, &config));
+    dispatcher = std::make_shared<RequestHandlerDispatcher>(config);
+    wheel = std::make_shared<TimerWheel>(io, std::chrono::milliseconds(50));
+    wheel->start();
+    for (int i = 0; i < 2; ++i) {
+      io_threads.emplace_back([this] { io.run(); });
+    }
+  }
+
+  void TearDown() override {
+    GateTestHandler::set_open(true);
+    io.stop();
+    for (std::thread& thread : io_threads) {
+      thread.join();
+    }
+  }
+
+  // A client connected to a new, started Session
+  std::unique_ptr<Client> connect(
+      ConnectionSettings settings = ConnectionSettings()) {
+    auto session = std::make_shared<Session>(io, dispatcher, wheel, settings);
+    auto client = std::make_unique<Client>(acceptor.local_endpoint().port());
+    acceptor.accept(session->socket());
+    session->start();
+    return client;
+  }
+
+  bool on_io_thread(std::thread::id id) const {
+    return std::any_of(io_threads.begin(), io_threads.end(),
+                       [id](const std::thread& t) { return t.get_id() == id; });
+  }
+
+  static std::string echoed(const std::string& request,
+                            const std::string& connection = "") {
+    return "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\n" + connection +
+           "Content-Length: " + std::to_string(request.size()) + "\r\n\r\n" +
+           request;
+  }
+
   asio::io_service io;
-  std::string http_version = "HTTP/1.1";
-  std::string input;
-  std::shared_ptr<SessionTest> sess = std::make_shared<SessionTest>(io);
+  tcp::acceptor acceptor{
+      io, tcp::endpoint(asio::ip::address_v4::loopback(), 0)};
+  NginxConfig config;
+  std::shared_ptr<RequestHandlerDispatcher> dispatcher;
+  std::shared_ptr<TimerWheel> wheel;
+  std::vector<std::thread> io_threads;
+  std::string echo =
+      "GET /echo HTTP/1.1\r\n"
+      "Host: www.example.com\r\n"
+      "\r\n";
+  std::string missing =
+      "GET /nonexistent HTTP/1.1\r\n"
+      "Host: www.example.com\r\n"
+      "\r\n";
 };
 
-// ---------------------------------------------------------------- 3. Response
+// ---------------------------------------------------------------- 4. Response
 // logic
 TEST_F(SessionTestFixture, ValidRequestReturns200) {
-  input =
+  auto client = connect();
+  client->send(echo);
+  EXPECT_EQ(client->read_response(), echoed(echo));
+  // The connection stays open for the next request
+  client->send(echo);
+  EXPECT_EQ(client->read_response(), echoed(echo));
+}
+
+TEST_F(SessionTestFixture, InvalidRequestReturns400) {
+  auto client = connect();
+  client->send(
+      " /weird HTTP/1.1\r\n"
+      "Host: weird.com\r\n"
+      "\r\n");
+  EXPECT_EQ(client->read_response(), STOCK_RESPONSE.at(400).to_string());
+}
+
+TEST_F(SessionTestFixture, InvalidLocationReturns404) {
+  auto client = connect();
+  client->send(missing);
+  EXPECT_EQ(client->read_response(), STOCK_RESPONSE.at(404).to_string());
+}
+
+TEST_F(SessionTestFixture, RequestSplitAcrossReadsIsAnsweredOnce) {
+  std::string input =
       "GET /echo HTTP/1.1\r\n"
       "Host: www.example.com\r\n"
-      "\r\n";
-  sess->set_data(input);
+      "X-Padding: " +
+      std::string(2000, 'x') + "\r\n\r\n";
+  auto client = connect();
+  client->send(input.substr(0, 1024));
+  EXPECT_EQ(client->read_response(std::chrono::milliseconds(100)), "");
+
+  client->send(input.substr(1024));
+  EXPECT_EQ(client->read_response(), echoed(input));
+  client->send(echo);
+  EXPECT_EQ(client->read_response(), echoed(echo));
+}
 
-  std::string expected =
-      http_version + " 200 OK\r\nContent-Type: text/plain\r\nContent-Length: " +
-      std::to_string(input.size()) + "\r\n\r\n" + input;
+TEST_F(SessionTestFixture, OversizedBodyReturns413) {
+  auto client = connect();
+  client->send(
+      "POST /echo HTTP/1.1\r\n"
+      "Content-Length: 99999999\r\n"
+      "\r\n");
+
+  // the stream cannot be framed past the oversized body
+  EXPECT_EQ(client->read_response(),
+            "HTTP/1.1 413 Payload Too Large\r\nContent-Type: text/plain\r\n"
+            "Connection: close\r\nContent-Length: 21\r\n\r\n"
+            "413 Payload Too Large");
+  EXPECT_TRUE(client->closed());
+}
+
+TEST_F(SessionTestFixture, ConnectionCloseEndsPipeline) {
+  std::string closing =
+      "GET /echo HTTP/1.1\r\n"
+      "Connection: close\r\n"
+      "\r\n";
+  auto client = connect();
+  client->send(closing + echo);
 
-  EXPECT_EQ(sess->call_handle_response(input.size()), expected);
+  EXPECT_EQ(client->read_response(),
+            echoed(closing, "Connection: close\r\n"));
+  EXPECT_TRUE(client->closed());
 }
 
-TEST_F(SessionTestFixture, InvalidRequestReturns400) {
-  input =
-      " /weird HTTP/1.1\r\n"
-      "Host: weird.com\r\n"
+TEST_F(SessionTestFixture, Http10KeepAliveIsConfirmed) {
+  std::string input =
+      "GET /echo HTTP/1.0\r\n"
+      "Connection: keep-alive\r\n"
       "\r\n";
-  sess->set_data(input);
+  auto client = connect();
+  client->send(input);
 
-  std::string body = "400 Bad Request";
-  std::string expected = http_version +
-                         " 400 Bad Request\r\nContent-Type: text/plain\r\n"
-                         "Content-Length: " +
-                         std::to_string(body.size()) + "\r\n\r\n" + body;
+  EXPECT_EQ(client->read_response(),
+            echoed(input, "Connection: keep-alive\r\n"));
+}
+
+TEST_F(SessionTestFixture, KeepaliveRequestsLimitClosesConnection) {
+  ConnectionSettings settings;
+  settings.keepalive_requests = 2;
+  auto client = connect(settings);
+  client->send(echo + echo + echo);
 
-  EXPECT_EQ(sess->call_handle_response(input.size()), expected);
+  EXPECT_EQ(client->read_response(), echoed(echo));
+  EXPECT_EQ(client->read_response(), echoed(echo, "Connection: close\r\n"));
+  EXPECT_TRUE(client->closed());
 }
 
-TEST_F(SessionTestFixture, InvalidLocationReturns404) {
-  input =
-      "GET /nonexistent HTTP/1.1\r\n"
-      "Host: www.example.com\r\n"
-      "\r\n";
-  sess->set_data(input);
+TEST_F(SessionTestFixture, PipelinedRequestsAnsweredInOrder) {
+  auto client = connect();
+  client->send(echo + missing + echo.substr(0, 10));
+
+  EXPECT_EQ(client->read_response(), echoed(echo));
+  EXPECT_EQ(client->read_response(), STOCK_RESPONSE.at(404).to_string());
+
+  // the partial third request stays buffered for the next read
+  EXPECT_EQ(client->read_response(std::chrono::milliseconds(100)), "");
+  client->send(echo.substr(10));
+  EXPECT_EQ(client->read_response(), echoed(echo));
+}
+
+TEST_F(SessionTestFixture, EachRequestLogsOneAccessRecord) {
+  std::ostringstream log;
+  logging::init_logging(&log, "", logging::AsyncLogOptions());
+  auto client = connect();
+  client->send(echo + missing);
+  client->read_response();
+  client->read_response();
+  logging::init_logging(nullptr, "", logging::AsyncLogOptions());
+
+  std::vector<std::string> records;
+  std::istringstream lines(log.str());
+  for (std::string line; std::getline(lines, line);) {
+    if (line.find("[ResponseMetrics]") != std::string::npos) {
+      records.push_back(line);
+    }
+  }
+  ASSERT_EQ(records.size(), 2u);
+  EXPECT_NE(records[0].find("status_code=200 path=\"/echo\" "
+                            "ip=\"127.0.0.1\" handler=\"EchoHandler\" "
+                            "method=GET"),
+            std::string::npos);
+  EXPECT_NE(records[0].find("handler_us="), std::string::npos);
+  EXPECT_NE(records[1].find("status_code=404 path=\"/nonexistent\""),
+            std::string::npos);
+  // Per-step lines are below the console's level
+  EXPECT_EQ(log.str().find("Valid request"), std::string::npos);
+}
+
+TEST_F(SessionTestFixture, EachRequestIsCounted) {
+  int echo_type =
+      static_cast<int>(RequestHandler::HandlerType::ECHO_REQUEST_HANDLER);
+  metrics::Snapshot before = metrics::collect();
+  auto client = connect();
+  client->send(echo + missing);
+  client->read_response();
+  client->read_response();
+
+  metrics::Snapshot after = metrics::collect();
+  EXPECT_EQ(after.requests[echo_type][200 - MIN_STATUS_CODE] -
+                before.requests[echo_type][200 - MIN_STATUS_CODE],
+            1u);
+  EXPECT_EQ(after[metrics::Counter::BYTES_RECEIVED] -
+                before[metrics::Counter::BYTES_RECEIVED],
+            echo.size() + missing.size());
+}
+
+TEST_F(SessionTestFixture, EachRequestIsTimed) {
+  int echo_type =
+      static_cast<int>(RequestHandler::HandlerType::ECHO_REQUEST_HANDLER);
+  auto total = static_cast<size_t>(metrics::Stage::TOTAL);
+  uint64_t before = metrics::collect().handlers[echo_type][total].count();
+  auto client = connect();
+  client->send(echo);
+  client->read_response();
+  // Latencies are recorded once the write completes, which is before the
+  // next request is answered
+  client->send(missing);
+  client->read_response();
+
+  metrics::Snapshot after = metrics::collect();
+  EXPECT_EQ(after.handlers[echo_type][total].count() - before, 1u);
+  int location = metrics::location_index("/echo");
+  ASSERT_GT(after.locations.size(), static_cast<size_t>(location));
+  EXPECT_GE(after.locations[location].stages[total].count(), 1u);
+}
+
+// ------------------------------------------------------ 5. Handler threads
+// and admission
+TEST_F(SessionTestFixture, PooledHandlerAnswersBackOnTheSession) {
+  GateTestHandler::set_open(false);
+  auto client = connect();
+  std::string pooled = "GET /pooled HTTP/1.1\r\n\r\n";
+  client->send(pooled + echo);
+
+  ASSERT_TRUE(GateTestHandler::wait_entered(1));
+  EXPECT_FALSE(on_io_thread(GateTestHandler::thread(0)));
+  // The echo behind it waits for the pooled response
+  EXPECT_EQ(client->read_response(std::chrono::milliseconds(100)), "");
+
+  GateTestHandler::set_open(true);
+  EXPECT_EQ(client->read_response(),
+            "HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n");
+  EXPECT_EQ(client->read_response(), echoed(echo));
+}
+
+TEST_F(SessionTestFixture, FullHandlerPoolReturns503) {
+  GateTestHandler::set_open(false);
+  std::string pooled = "GET /pooled HTTP/1.1\r\n\r\n";
+  auto running = connect();
+  running->send(pooled);
+  ASSERT_TRUE(GateTestHandler::wait_entered(1));
+
+  // One of these takes the only queue slot, the other is turned away
+  auto first = connect();
+  auto second = connect();
+  first->send(pooled);
+  second->send(pooled);
+  std::string rejected;
+  Client* queued = nullptr;
+  for (int i = 0; i < 50 && rejected.empty(); ++i) {
+    for (Client* client : {first.get(), second.get()}) {
+      rejected = client->read_response(std::chrono::milliseconds(50));
+      if (!rejected.empty()) {
+        queued = client == first.get() ? second.get() : first.get();
+        break;
+      }
+    }
+  }
+  EXPECT_EQ(rejected, overloaded_response("HTTP/1.1", true));
+  ASSERT_NE(queued, nullptr);
+
+  GateTestHandler::set_open(true);
+  std::string ok = "HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n";
+  EXPECT_EQ(running->read_response(), ok);
+  EXPECT_EQ(queued->read_response(), ok);
+}
 
-  std::string body = "404 Not Found";
-  std::string expected = http_version +
-                         " 404 Not Found\r\nContent-Type: text/plain\r\n"
-                         "Content-Length: " +
-                         std::to_string(body.size()) + "\r\n\r\n" + body;
+TEST_F(SessionTestFixture, ArenaRewindsOnceLingeringRequestEnds) {
+  GateTestHandler::set_open(false);
+  ArenaCounters before = RequestArena::counters();
+  auto client = connect();
+  client->send("GET /answer_first HTTP/1.1\r\n\r\n");
+  EXPECT_EQ(client->read_response(),
+            "HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n");
+  // Written while the pool thread still holds the request
+  ASSERT_TRUE(eventually([&] {
+    return RequestArena::counters().deferred_resets > before.deferred_resets;
+  }));
+
+  uint64_t resets = RequestArena::counters().resets;
+  GateTestHandler::set_open(true);
+  // Rewound when the request goes, not only after the next write
+  EXPECT_TRUE(
+      eventually([&] { return RequestArena::counters().resets > resets; }));
+}
+
+TEST_F(SessionTestFixture, MaxInflightReturns503) {
+  GateTestHandler::set_open(false);
+  std::string limited = "GET /limited HTTP/1.1\r\n\r\n";
+  auto admitted = connect();
+  admitted->send(limited);
+  ASSERT_TRUE(GateTestHandler::wait_entered(1));
+
+  auto refused = connect();
+  refused->send(limited);
+  EXPECT_EQ(refused->read_response(), overloaded_response("HTTP/1.1", true));
+
+  GateTestHandler::set_open(true);
+  EXPECT_EQ(admitted->read_response(),
+            "HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n");
+  // The slot is free again
+  refused->send(limited);
+  EXPECT_EQ(refused->read_response(),
+            "HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n");
+}
+
+// ---------------------------------------------------------------- 6. Timeouts
+// Only the timeout under test is short, so it is the one that fires
+TEST_F(SessionTestFixture, IdleTimeoutClosesConnection) {
+  ConnectionSettings settings;
+  settings.keepalive_timeout = 1;
+  auto client = connect(settings);
+  client->send(echo);
+  EXPECT_EQ(client->read_response(), echoed(echo));
+  EXPECT_TRUE(client->closed());
+}
+
+TEST_F(SessionTestFixture, HeaderTimeoutClosesConnection) {
+  ConnectionSettings settings;
+  settings.header_timeout = 1;
+  auto client = connect(settings);
+  client->send("GET /echo HTTP/1.1\r\nHost: www.exa");
+  EXPECT_TRUE(client->closed());
+}
 
-  EXPECT_EQ(sess->call_handle_response(input.size()), expected);
+TEST_F(SessionTestFixture, BodyTimeoutClosesConnection) {
+  ConnectionSettings settings;
+  settings.body_timeout = 1;
+  auto client = connect(settings);
+  client->send(
+      "POST /echo HTTP/1.1\r\n"
+      "Content-Length: 10\r\n"
+      "\r\n"
+      "abc");
+  EXPECT_TRUE(client->closed());
 }
 
-// ------------------------------------------------------ 4. Read / write
-// handlers Success path – object should remain alive.
+// ------------------------------------------------------ 7. Read / write
+// handlers on an unconnected session
+class SessionTest : public Session {
+ public:
+  SessionTest(asio::io_service& io,
+              std::shared_ptr<RequestHandlerDispatcher> dispatcher)
+      : Session(io, std::move(dispatcher)), deleted_flag_(nullptr) {}
+
+  ~SessionTest() override {
+    if (deleted_flag_) *deleted_flag_ = true;
+  }
+
+  // Override remote_endpoint to return a test-friendly endpoint
+  tcp::endpoint remote_endpoint() override {
+    return tcp::endpoint(asio::ip::address::from_string("127.0.0.1"), 4242);
+  }
+
+  // helpers to reach the protected/private bits
+  void call_handle_read(const error_code& ec, std::size_t n) {
+    Session::handle_read(ec, n);
+  }
+  void call_handle_write(const error_code& ec) { Session::handle_write(ec); }
+
+  // Place s in the read buffer as if the socket had just received it
+  void set_data(const std::string& s) {
+    std::copy(s.begin(), s.end(), framer_.prepare(s.size()));
+  }
+
+  bool* deleted_flag_;
+};
+
+// Success path – object should remain alive.
 TEST_F(SessionTestFixture, HandleReadSuccessKeepsSessionAlive) {
-  input =
+  asio::io_service idle;
+  auto sess = std::make_shared<SessionTest>(idle, dispatcher);
+  std::string input =
       "GET /index.html HTTP/1.1\r\n"
       "Host: www.example.com\r\n"
       "\r\n";
@@ -133,6 +618,8 @@ TEST_F(SessionTestFixture, HandleReadSuccessKeepsSessionAlive) {
 }
 
 TEST_F(SessionTestFixture, HandleWriteSuccessKeepsSessionAlive) {
+  asio::io_service idle;
+  auto sess = std::make_shared<SessionTest>(idle, dispatcher);
   bool deleted = false;
   sess->deleted_flag_ = &deleted;
 
@@ -144,14 +631,16 @@ TEST_F(SessionTestFixture, HandleWriteSuccessKeepsSessionAlive) {
 }
 
 // Error paths – destroy only when the last shared_ptr is gone.
-static void expect_destruction_after(const std::function<void()>& invoke) {
+static void expect_destruction_after(
+    std::shared_ptr<RequestHandlerDispatcher> dispatcher,
+    const std::function<void(SessionTest&)>& invoke) {
   asio::io_service io;
-  auto s = std::make_shared<SessionTest>(io);
+  auto s = std::make_shared<SessionTest>(io, dispatcher);
   bool deleted = false;
   s->deleted_flag_ = &deleted;
   std::weak_ptr<SessionTest> weak = s;
 
-  invoke();  // run the handler while `s` is still held
+  invoke(*s);  // run the handler while `s` is still held
 
   s.reset();  // drop the last strong ref
   EXPECT_TRUE(deleted);
@@ -159,21 +648,23 @@ static void expect_destruction_after(const std::function<void()>& invoke) {
 }
 
 TEST_F(SessionTestFixture, HandleReadErrorDestroysSession) {
-  expect_destruction_after([&] {
+  expect_destruction_after(dispatcher, [](SessionTest& sess) {
     error_code ec = asio::error::eof;
-    sess->call_handle_read(ec, 0);
+    sess.call_handle_read(ec, 0);
   });
 }
 
 TEST_F(SessionTestFixture, HandleWriteErrorDestroysSession) {
-  expect_destruction_after([&] {
+  expect_destruction_after(dispatcher, [](SessionTest& sess) {
     error_code ec = asio::error::eof;
-    sess->call_handle_write(ec);
+    sess.call_handle_write(ec);
   });
 }
 
-// ---------------------------------------------------------------- 5. start()
+// ---------------------------------------------------------------- 8. start()
 TEST_F(SessionTestFixture, StartDoesNotDestroySessionImmediately) {
+  asio::io_service idle;
+  auto sess = std::make_shared<SessionTest>(idle, dispatcher);
   bool deleted = false;
   sess->deleted_flag_ = &deleted;
   sess->start();
@@ -1,10 +1,12 @@
 #include "shorten_request_handler.h"
 
 #include <cstdlib>
+#include <functional>
 #include <memory>
 #include <mutex>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 #include "gtest/gtest.h"
 #include "idatabase_client.h"
@@ -75,6 +77,28 @@ class AlwaysFailDB : public IDatabaseClient {
   }
 };
 
+// Wraps the fakes so async callbacks are only run when the test says so,
+// like a real non-blocking client completing on its own thread later.
+class DeferredRedisClient : public FakeRedisClient {
+ public:
+  void get_async(const std::string& short_code,
+                 GetCallback callback) override {
+    auto value = get(short_code);
+    pending.push_back([value, callback] { callback(value); });
+  }
+  std::vector<std::function<void()>> pending;
+};
+
+class DeferredDatabaseClient : public FakeDatabaseClient {
+ public:
+  void lookup_async(const std::string& short_code,
+                    LookupCallback callback) override {
+    auto value = lookup(short_code);
+    pending.push_back([value, callback] { callback(value); });
+  }
+  std::vector<std::function<void()>> pending;
+};
+
 // -----------------------------------------------------------------------------
 // Helper functions to create minimal Request objects.
 // -----------------------------------------------------------------------------
@@ -184,6 +208,7 @@ TEST_F(ShortenHandlerTest, GetFallbackToDBAndCacheRedis) {
   ASSERT_EQ(resp->headers.size(), 1u);
   EXPECT_EQ(resp->headers[0].name, "Location");
   EXPECT_EQ(resp->headers[0].value, long_url);
+  EXPECT_STREQ(resp->cache_tier, "db");
 
   // Now Redis should have been populated
   auto redis_val = fake_redis->get(code);
@@ -213,6 +238,7 @@ TEST_F(ShortenHandlerTest, GetHitsRedisDirectly) {
   ASSERT_EQ(resp->headers.size(), 1u);
   EXPECT_EQ(resp->headers[0].name, "Location");
   EXPECT_EQ(resp->headers[0].value, long_url);
+  EXPECT_STREQ(resp->cache_tier, "redis");
 
   // DB should remain unchanged (still no entry)
   EXPECT_FALSE(fake_db->lookup(code).has_value());
@@ -329,6 +355,96 @@ TEST_F(ShortenHandlerTest, WhenDbStoreFails_Returns500) {
   EXPECT_EQ(resp->body, "Failed to store URL mapping");
 }
 
+// -----------------------------------------------------------------------------
+//  Async GET resolves through Redis then DB without blocking the caller
+// -----------------------------------------------------------------------------
+TEST(ShortenHandlerAsyncTest, AsyncGetCompletesOnlyWhenBackendsAnswer) {
+  auto redis = std::make_shared<DeferredRedisClient>();
+  auto db = std::make_shared<DeferredDatabaseClient>();
+  auto args = std::make_shared<ShortenRequestHandlerArgs>();
+  args->redis_client = redis;
+  args->db_client = db;
+  auto handler = std::make_unique<ShortenRequestHandler>("/shorten", args);
+
+  const std::string code = "ASYNC1";
+  const std::string long_url = "https://async.example.com";
+  db->store(code, long_url);
+
+  std::unique_ptr<Response> resp;
+  {
+    Request req = make_get_request("/shorten", code);
+    handler->handle_request_async(
+        req, [&](std::unique_ptr<Response> r) { resp = std::move(r); });
+  }
+  // Neither the request nor the handler has to outlive the first hop
+  handler.reset();
+  EXPECT_EQ(resp, nullptr);
+
+  ASSERT_EQ(redis->pending.size(), 1u);
+  redis->pending[0]();  // Redis miss
+  EXPECT_EQ(resp, nullptr);
+
+  ASSERT_EQ(db->pending.size(), 1u);
+  db->pending[0]();  // DB hit
+  ASSERT_NE(resp, nullptr);
+  EXPECT_EQ(resp->status_code, 302);
+  EXPECT_EQ(resp->headers[0].value, long_url);
+  EXPECT_EQ(redis->get(code).value(), long_url);
+}
+
+TEST_F(ShortenHandlerTest, AsyncGetMissingReturns404) {
+  std::unique_ptr<Response> resp;
+  handler->handle_request_async(
+      make_get_request(base_uri, "NOPE00"),
+      [&](std::unique_ptr<Response> r) { resp = std::move(r); });
+  ASSERT_NE(resp, nullptr);
+  EXPECT_EQ(resp->status_code, 404);
+}
+
+TEST_F(ShortenHandlerTest, AsyncPostFallsBackToSync) {
+  std::unique_ptr<Response> resp;
+  handler->handle_request_async(
+      make_post_request(base_uri, "https://example.com/async"),
+      [&](std::unique_ptr<Response> r) { resp = std::move(r); });
+  ASSERT_NE(resp, nullptr);
+  EXPECT_EQ(resp->status_code, 200);
+  EXPECT_EQ(resp->body.size(), 6u);
+}
+
+TEST_F(ShortenHandlerTest, ViewGetRedirectsFromRedis) {
+  fake_redis->set("VIEW01", "https://view.example.com");
+  std::string uri = base_uri + "/VIEW01";
+  RequestView req;
+  req.method = "GET";
+  req.uri = uri;
+  req.version = "HTTP/1.1";
+  req.valid = true;
+
+  std::unique_ptr<Response> resp;
+  handler->handle_request_view(
+      req, [&](std::unique_ptr<Response> r) { resp = std::move(r); });
+  ASSERT_NE(resp, nullptr);
+  EXPECT_EQ(resp->status_code, 302);
+  EXPECT_EQ(resp->headers[0].value, "https://view.example.com");
+}
+
+TEST_F(ShortenHandlerTest, ViewPostIsCopiedIntoRequest) {
+  std::string body = "https://example.com/view";
+  RequestView req;
+  req.method = "POST";
+  req.uri = base_uri;
+  req.version = "HTTP/1.1";
+  req.body = body;
+  req.valid = true;
+
+  std::unique_ptr<Response> resp;
+  handler->handle_request_view(
+      req, [&](std::unique_ptr<Response> r) { resp = std::move(r); });
+  ASSERT_NE(resp, nullptr);
+  EXPECT_EQ(resp->status_code, 200);
+  EXPECT_EQ(fake_db->lookup(resp->body).value(), body);
+}
+
 //----------------------------------------------------------------------------‐
 // 10) create_from_config() should return “inline‐fake” clients when the env var
 // is set.
@@ -0,0 +1,81 @@
+#include "timer_wheel.h"
+
+#include <boost/asio.hpp>
+#include <chrono>
+#include <memory>
+
+#include "gtest/gtest.h"
+
+using namespace std::chrono_literals;
+
+class TimerWheelTest : public ::testing::Test {
+ protected:
+  void SetUp() override { wheel->start(); }
+
+  // Run the io_service for d, then stop the wheel so run() returns
+  void run_for(std::chrono::milliseconds d) {
+    boost::asio::steady_timer stop(io, d);
+    stop.async_wait([this](const boost::system::error_code&) { wheel->stop(); });
+    io.run();
+    io.restart();
+  }
+
+  boost::asio::io_service io;
+  std::shared_ptr<TimerWheel> wheel =
+      std::make_shared<TimerWheel>(io, 10ms, 8);
+};
+
+TEST_F(TimerWheelTest, FiresAfterDelay) {
+  int fired = 0;
+  TimerWheel::Timer timer([&] { ++fired; });
+  auto start = std::chrono::steady_clock::now();
+  std::chrono::steady_clock::time_point fired_at;
+  TimerWheel::Timer probe([&] { fired_at = std::chrono::steady_clock::now(); });
+  wheel->schedule(timer, 30ms);
+  wheel->schedule(probe, 30ms);
+  run_for(100ms);
+  EXPECT_EQ(fired, 1);
+  EXPECT_GE(fired_at - start, 30ms);
+}
+
+TEST_F(TimerWheelTest, CancelledTimerDoesNotFire) {
+  int fired = 0;
+  TimerWheel::Timer timer([&] { ++fired; });
+  wheel->schedule(timer, 20ms);
+  wheel->cancel(timer);
+  run_for(60ms);
+  EXPECT_EQ(fired, 0);
+}
+
+TEST_F(TimerWheelTest, RescheduleMovesDeadline) {
+  int fired = 0;
+  TimerWheel::Timer timer([&] { ++fired; });
+  wheel->schedule(timer, 20ms);
+  wheel->schedule(timer, 500ms);
+  run_for(60ms);
+  EXPECT_EQ(fired, 0);
+}
+
+TEST_F(TimerWheelTest, DelayLongerThanOneTurn) {
+  // 8 slots of 10ms: a 150ms delay needs a second turn of the wheel
+  int fired = 0;
+  TimerWheel::Timer timer([&] { ++fired; });
+  wheel->schedule(timer, 150ms);
+  run_for(100ms);
+  EXPECT_EQ(fired, 0);
+  wheel->start();
+  run_for(100ms);
+  EXPECT_EQ(fired, 1);
+}
+
+TEST_F(TimerWheelTest, DestroyedTimerIsUnlinked) {
+  int fired = 0;
+  TimerWheel::Timer survivor([&] { ++fired; });
+  {
+    TimerWheel::Timer doomed([&] { fired += 10; });
+    wheel->schedule(doomed, 20ms);
+    wheel->schedule(survivor, 20ms);
+  }
+  run_for(60ms);
+  EXPECT_EQ(fired, 1);
+}